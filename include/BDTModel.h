@@ -0,0 +1,170 @@
+#ifndef BDT_MODEL_H
+#define BDT_MODEL_H
+
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "FeatureMatrix.h"
+
+/**
+ * @brief Multiclass boosted decision trees evaluated without TMVA.
+ *
+ * The model is converted once from the TMVA weights file into a compact binary file,
+ * which is then mapped in memory when loaded. Trees are stored as flat arrays of nodes:
+ * - An internal node sends an input to its @c right child when the value of its feature is
+ *   greater than or equal to its threshold, and to its @c left child otherwise.
+ *   The cut direction of TMVA is resolved at conversion time.
+ * - A leaf has feature -1 and holds the response of the tree.
+ *
+ * Tree @c t contributes to class <tt>t%nClasses</tt>. The outputs are computed as in
+ * TMVA::MethodBDT::GetMulticlassValues(): <tt>out_j = 1/(1+sum_{k!=j} exp(t_k-t_j))</tt>,
+ * where @c t_k is the sum of the responses of the trees of class @c k.
+ *
+ * The binary file is laid out as:
+ * - A Header.
+ * - The index of the root node of each tree (32-bit integers).
+ * - All nodes.
+ * - The class names, each terminated by a null character.
+ *
+ * Models trained natively by BDTTrainer are written in the same format.
+ * For fixed models, writeSource() generates the C++ code of the trees, to be compiled into a plugin
+ * loaded by CompiledBDT.
+ */
+class BDTModel {
+
+public:
+
+  /** Node of a tree. */
+  struct Node {
+    int feature;   ///< Index of the input feature, -1 for leaves.
+    float value;   ///< Cut value for internal nodes, response for leaves.
+    int left;      ///< Index of the child taken when below the cut.
+    int right;     ///< Index of the child taken when above or at the cut.
+  };
+
+  /** Header of the binary file. */
+  struct Header {
+    char magic[8];             ///< File signature.
+    unsigned int version;      ///< Format version.
+    unsigned int nVariables;   ///< Number of input features.
+    unsigned int nClasses;     ///< Number of output classes.
+    unsigned int nTrees;       ///< Number of trees.
+    unsigned int nNodes;       ///< Total number of nodes.
+    unsigned int namesSize;    ///< Size in bytes of the class names.
+  };
+
+  /** Base name of the files of the trained BDT, as written by TMVA. */
+  static const std::string kBaseName;
+
+  /** Default constructor. */
+  BDTModel();
+
+  /** Destructor. */
+  ~BDTModel();
+
+  /** Converts a TMVA weights file to the binary format. */
+  static void convert(const std::string &xmlFile, const std::string &binaryFile);
+
+  /** Writes a binary model. */
+  static void write(const std::string &binaryFile, unsigned int nVariables,
+		    const std::vector<std::string> &classNames,
+		    const std::vector<int> &roots, const std::vector<Node> &nodes);
+
+  /** Checks whether a binary file exists and is not older than its TMVA weights file. */
+  static bool isUpToDate(const std::string &xmlFile, const std::string &binaryFile);
+
+  /** Returns a hash of the content of a file. */
+  static unsigned long long fileHash(const std::string &fileName);
+
+  /** Loads a binary model. */
+  void load(const std::string &binaryFile);
+
+  /** Writes the C++ source of a plugin evaluating the model. */
+  void writeSource(const std::string &sourceFile, unsigned long long modelHash) const;
+
+  /** Evaluates the class probabilities of a single input. */
+  void evaluate(const float *row, float *outputs) const;
+
+  /** Evaluates the class probabilities of all rows of a feature matrix. */
+  void evaluate(const FeatureMatrix &features, std::vector<float> &outputs, int nThreads) const;
+
+  /** Returns the number of input features.
+   * @return Number of features.
+   */
+  inline unsigned int nVariables() const { return m_header->nVariables; }
+
+  /** Returns the number of classes.
+   * @return Number of classes.
+   */
+  inline unsigned int nClasses() const { return m_header->nClasses; }
+
+  /** Returns the number of trees.
+   * @return Number of trees.
+   */
+  inline unsigned int nTrees() const { return m_header->nTrees; }
+
+  /** Returns the class names.
+   * @return Class names, ordered by class index.
+   */
+  inline const std::vector<std::string> &classNames() const { return m_classNames; }
+
+private:
+
+  /** Evaluates a block of rows, tree by tree. */
+  void evaluateBlock(const float *rows, unsigned int nRows, float *outputs) const;
+
+  /** Returns the response of a tree for an input. */
+  inline float treeResponse(unsigned int iTree, const float *row) const;
+
+  /** Converts summed tree responses to class probabilities. */
+  void normalize(const double *sums, float *outputs) const;
+
+  /** Writes the expression of a sub-tree. */
+  void writeNode(std::ostream &os, int iNode) const;
+
+  /** Reads the next XML tag. */
+  static bool nextTag(const std::string &text, size_t &pos, std::string &name,
+		      std::map<std::string, std::string> &attributes, bool &isEnd, bool &isEmpty);
+
+  /** Returns an attribute of an XML tag. */
+  static const std::string &attribute(const std::map<std::string, std::string> &attributes,
+				      const std::string &name);
+
+  /** Releases the mapped file. */
+  void unload();
+
+  /** Copy is not supported. */
+  BDTModel(const BDTModel &);
+
+  /** Assignment is not supported. */
+  BDTModel &operator=(const BDTModel &);
+
+private:
+
+  void *m_map;
+  size_t m_mapSize;
+
+  const Header *m_header;
+  const int *m_roots;
+  const Node *m_nodes;
+  std::vector<std::string> m_classNames;
+};
+
+
+/**
+ * @param iTree Tree index.
+ * @param row Input features.
+ * @return Response of the leaf reached by the input.
+ */
+inline float BDTModel::treeResponse(unsigned int iTree, const float *row) const
+{
+  const Node *node = m_nodes + m_roots[iTree];
+  while(node->feature >= 0) {
+    node = m_nodes + (row[node->feature] >= node->value ? node->right : node->left);
+  }
+  return node->value;
+}
+
+#endif
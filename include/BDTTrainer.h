@@ -0,0 +1,78 @@
+#ifndef BDT_TRAINER_H
+#define BDT_TRAINER_H
+
+#include <string>
+#include <vector>
+
+#include "BDTModel.h"
+#include "FeatureMatrix.h"
+#include "optparse.h"
+
+/**
+ * @brief Native multiclass gradient boosting of decision trees.
+ *
+ * Implements the gradient boosting used by TMVA for multiclass BDTs: at each iteration, one regression tree
+ * per class is fitted to the residuals <tt>y_k - p_k</tt> of the current class probabilities, and its leaves
+ * respond <tt>shrinkage*(K-1)/K * sum(r)/sum(|r|(1-|r|))</tt>. With bagging, each iteration uses
+ * Poisson-distributed event weights of mean @c \-\-bdtBaggedFraction, as TMVA does.
+ *
+ * Features are binned once into 8-bit integers: layer colors are integer averages in [0, 255],
+ * so that every possible cut is tested. Features stored as 8-bit integers are used as bins directly.
+ * Trees are grown level by level: the histograms of all nodes of a level are filled in parallel,
+ * one task per class and feature, so that the result does not depend on the number of threads.
+ *
+ * The trained model is written in the binary format of BDTModel.
+ */
+class BDTTrainer {
+
+public:
+
+  /** Full constructor. */
+  BDTTrainer(const Config &config);
+
+  /** Destructor. */
+  ~BDTTrainer();
+
+  /** Trains the model. */
+  void train(const FeatureMatrix &features, const std::vector<int> &labels,
+	     const std::vector<unsigned int> &rows, unsigned int nClasses);
+
+  /** Writes the trained model. */
+  void write(const std::string &binaryFile, const std::vector<std::string> &classNames) const;
+
+  /** Returns the number of trees.
+   * @return Number of trees.
+   */
+  inline unsigned int nTrees() const { return m_roots.size(); }
+
+private:
+
+  /** Grows the trees of one iteration, one per class. */
+  void growTrees(const std::vector<unsigned char> &bins, const std::vector<double> &residuals,
+		 const std::vector<unsigned char> &weights);
+
+  /** Appends a sub-tree to the list of nodes. */
+  int addNode(unsigned int iClass, int iHeap, const std::vector<int> &splitFeatures,
+	      const std::vector<int> &splitCuts, const std::vector<float> &responses);
+
+  /** Returns the response of a tree for a training row. */
+  float treeResponse(unsigned int iTree, const std::vector<unsigned char> &bins, unsigned int i) const;
+
+private:
+
+  int m_nIterations;
+  float m_shrinkage;
+  float m_baggedFraction;
+  int m_maxDepth;
+  float m_minNodeFraction;
+  int m_seed;
+  int m_nThreads;
+
+  unsigned int m_nVariables;
+  unsigned int m_nClasses;
+  unsigned int m_nRows;
+  std::vector<int> m_roots;
+  std::vector<BDTModel::Node> m_nodes;
+};
+
+#endif
@@ -1,10 +1,12 @@
 #ifndef CLASSIFICATIONALG_H
 #define CLASSIFICATIONALG_H
 
+#include "ColorModel.h"
 #include "DataSet.h"
 #include "optparse.h"
 
-class TPrincipal;
+class FeatureMatrix;
+class TMVAReaderPool;
 
 /**
  * @brief This class implements the classification algorithm.
@@ -28,6 +30,12 @@ public:
   /** Perform classification. */
   void classifyClusters(DataSet &trainingDS, DataSet &evaluationDS, const Config &config);
 
+  /** Performs unsupervised classification of the next frame of a sequence. */
+  void classifyFrame(DataSet &ds, const Config &config);
+
+  /** Performs unsupervised classification of selected clusters of the next frame of a sequence. */
+  void classifyFrame(DataSet &ds, const std::vector<unsigned int> &selection, const Config &config);
+
   /** Return class names. 
    * @return Class names.
    */
@@ -38,28 +46,64 @@ private:
   /** Performs unsupervised PCA-based classification. */
   void runPCA(DataSet &trainingDS, DataSet &evaluationDS, const Config &config);
 
-  /** Performs PCA training. */
-  void trainPCA(DataSet &ds, const Config &config);
+  /** Trains the PCA/k-means model and classifies clusters. */
+  void trainColorModel(DataSet &trainingDS, DataSet &evaluationDS, const Config &config);
+
+  /** Reads the saved PCA/k-means model if available. */
+  bool loadColorModel(const Config &config);
+
+  /** Classifies clusters with the current PCA/k-means model. */
+  void applyColorModel(const std::vector<Cluster*> &clusters, FeatureMatrix &features, const Config &config);
+
+  /** Returns all clusters of a data set. */
+  static std::vector<Cluster*> allClusters(DataSet &ds);
+
+  /** Computes the features of bootstrap samples of the training clusters. */
+  void bootstrapFeatures(DataSet &ds, const Config &config, FeatureMatrix &features);
 
-  /** Apply PCA transformation to a list of clusters. */
-  void applyPCA(std::vector<Cluster*> &clusters, const Config &config);
+  /** Performs PCA training. */
+  void trainPCA(const FeatureMatrix &features, const Config &config);
 
   /** Apply k-means clustering on PCA result. */
-  int runKmeansOnPCA(int kmeans, std::vector<Cluster*> &clusters,
-		     std::vector<std::vector<Cluster*> > &pcaClusters,
-		     const Config &config);
+  int runKmeansOnPCA(int kmeans, const std::vector<Point> &colors,
+		     std::vector<int> &assignments, const Config &config);
   
   /** Perform supervised MVA-based classification. */
   void runMVA(DataSet &trainingDS, DataSet &evaluationDS, const Config &config);
 
+  /** Evaluates the BDT with TMVA. */
+  void evaluateTMVA(const std::string &xmlFile, const FeatureMatrix &features,
+		    std::vector<float> &outputs, int nThreads);
+
   /** Performs MVA training. */
   void trainMVA(DataSet &ds, const Config &config);
 
+  /** Assigns the truth class to the training clusters. */
+  void labelTrainingClusters(DataSet &ds, const Config &config);
+
+  /** Trains the BDT with TMVA. */
+  void trainTMVA(const FeatureMatrix &features, const std::vector<int> &labels,
+		 const std::vector<unsigned int> &trainRows,
+		 const std::vector<unsigned int> &testRows, const Config &config);
+
+  /** Trains the BDT natively. */
+  void trainNative(const FeatureMatrix &features, const std::vector<int> &labels,
+		   const std::vector<unsigned int> &trainRows,
+		   const std::vector<unsigned int> &testRows, const Config &config);
+
+  /** Copy is not supported. */
+  ClassificationAlg(const ClassificationAlg &);
+
+  /** Assignment is not supported. */
+  ClassificationAlg &operator=(const ClassificationAlg &);
+
 private:
 
   std::vector<std::string> m_classNames;
 
-  TPrincipal *m_pca;
+  ColorModel m_colorModel;
+  unsigned int m_nFrames;
+  TMVAReaderPool *m_readerPool;
 };
 
 #endif
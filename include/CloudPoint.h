@@ -59,7 +59,17 @@ public:
 
 
   /** Returns a unique identifier of this point. */
-  inline int id() { return m_id; }
+  inline int id() const { return m_id; }
+
+  /** Returns the number of input points represented by this point. 
+   * @return Weight.
+   */
+  inline int weight() const { return m_weight; }
+
+  /** Sets the number of input points represented by this point. 
+   * @param _weight Weight.
+   */
+  inline void setWeight(int _weight) { m_weight = _weight; }
   
 private:
   
@@ -67,6 +77,7 @@ private:
   int m_g;
   int m_b;
   int m_id;
+  int m_weight;
   static int s_nextId;
 
   /** Reads data from an input stream. */
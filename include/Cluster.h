@@ -5,6 +5,8 @@
 
 #include "CloudPoint.h"
 
+class RandomStream;
+
 /**
  * @brief Class describing a cluster of cloud points.
  *
@@ -31,12 +33,25 @@ public:
   
   /** Add points from another cluster */
   void addPoints(const Cluster &cl);
+
+  /** Removes all points from the cluster */
+  void clearPoints();
   
   /** Returns a vector of individual points. 
    * @return Points components.
    */
   inline const std::vector<CloudPoint> &points() const { return m_points; }
 
+  /** Returns the number of input points represented by the cluster.
+   * @return Sum of the point weights.
+   */
+  inline float weight() const { return m_weight; }
+
+  /** Returns the maximum height of the points, or 0 if all points are below the floor.
+   * @return Maximum height.
+   */
+  inline float ymax() const { return m_ymax; }
+
   
   /** Returns the center of mass 
    * @return Center of mass position.
@@ -45,9 +60,26 @@ public:
   
   /** Return layer positions */
   const std::vector<CloudPoint> &layers(int nLayers) const;
-  
-  /** Returns a vector of sub-clusters of randomly chosen points. */
-  std::vector<Cluster> &randomSplit(int nClusters, float fPerCluster) const;
+
+  /** Fills a row of per-layer color features for a compile-time number of layers. */
+  template<int NLayers, class T>
+  int layerFeatures(T *row) const;
+
+  /** Fills a row of per-layer color features, dispatching to a compile-time kernel when available. */
+  template<class T>
+  int layerFeatures(int nLayers, T *row) const;
+
+  /** Returns the per-layer color features, computed once per number of layers. */
+  const std::vector<int> &cachedLayerFeatures(int nLayers) const;
+
+  /** Returns the number of layers with no points of the cached features.
+   * @return Number of empty layers.
+   */
+  inline int nEmptyLayers() const { return m_nEmptyLayers; }
+
+  /** Fills a row of per-layer color features from a sample of the points, up to a standard error. */
+  int sampledLayerFeatures(int nLayers, float tolerance, unsigned int maxSamples,
+			   const RandomStream &rng, unsigned long long element, int *row) const;
 
 
   /** Returns a density measure. 
@@ -106,6 +138,15 @@ public:
   void setClassId(int _classId) { m_classId = _classId; }
 
   
+private:
+
+  /** Returns the greatest common divisor of two integers. */
+  static unsigned long long gcd(unsigned long long a, unsigned long long b);
+
+  /** Fills a row of per-layer color features, for a compile-time number of layers or 0 for a runtime one. */
+  template<int NLayers, class T>
+  int layerFeaturesKernel(int nLayers, int *sums, int *nPointsPerLayer, T *row) const;
+
 private:
  
   std::vector<CloudPoint> m_points;
@@ -114,13 +155,95 @@ private:
   Point m_pcaColor;
   Cluster *m_core;
   
+  float m_weight;
+  float m_ymax;
   float m_density;
   int m_classId;
 
   mutable std::vector<CloudPoint> m_layers;
-  mutable std::vector<Cluster> m_splitClusters;
-  mutable float m_fPerCluster;
+  mutable std::vector<int> m_features;
+  mutable int m_nEmptyLayers;
 };
 
 
+/**
+ * Computes the same features as layers() in a single pass over the points, the height range being
+ * maintained as points are added. With @p NLayers known at compile time, the per-layer sums live on
+ * the stack and the final averaging loop is fully unrolled. With @p NLayers set to 0, the number of
+ * layers is @p nLayers and the sums are provided by the caller.
+ * Layer colors are averaged with integer division, as in layers(), and layers with no points get null colors.
+ *
+ * @param nLayers Number of requested layers, used only if @p NLayers is 0.
+ * @param sums Per-layer color sums, of size 3*nLayers and set to 0.
+ * @param nPointsPerLayer Per-layer point counts, of size nLayers and set to 0.
+ * @param row Output row of size 3*nLayers, ordered (r0, g0, b0, r1, g1, b1, ...).
+ * @return Number of layers with no points.
+ */
+template<int NLayers, class T>
+int Cluster::layerFeaturesKernel(int nLayers, int *sums, int *nPointsPerLayer, T *row) const
+{
+  const int n = NLayers > 0 ? NLayers : nLayers;
+  double ymax = m_ymax;
+
+  for(unsigned int i=0; i<m_points.size(); i++) {
+    const CloudPoint &p = m_points[i];
+    int iLayer = (int)(n*p.y()/ymax);
+    if(iLayer >= n) iLayer = n-1;
+    sums[3*iLayer+0] += p.r();
+    sums[3*iLayer+1] += p.g();
+    sums[3*iLayer+2] += p.b();
+    nPointsPerLayer[iLayer]++;
+  }
+
+  int nEmpty = 0;
+  for(int k=0; k<n; k++) {
+    int m = nPointsPerLayer[k];
+    if(m == 0) {
+      nEmpty++;
+      m = 1;
+    }
+    row[3*k+0] = sums[3*k+0]/m;
+    row[3*k+1] = sums[3*k+1]/m;
+    row[3*k+2] = sums[3*k+2]/m;
+  }
+  return nEmpty;
+}
+
+/**
+ * @param row Output row of size 3*NLayers, ordered (r0, g0, b0, r1, g1, b1, ...).
+ * @return Number of layers with no points.
+ */
+template<int NLayers, class T>
+int Cluster::layerFeatures(T *row) const
+{
+  int sums[3*NLayers] = {0};
+  int nPointsPerLayer[NLayers] = {0};
+  return layerFeaturesKernel<NLayers>(NLayers, sums, nPointsPerLayer, row);
+}
+
+/**
+ * Layer counts commonly used in production are instantiated at compile time,
+ * any other value runs the same kernel with sums on the heap.
+ *
+ * @param nLayers Number of requested layers.
+ * @param row Output row of size 3*nLayers, ordered (r0, g0, b0, r1, g1, b1, ...).
+ * @return Number of layers with no points.
+ */
+template<class T>
+int Cluster::layerFeatures(int nLayers, T *row) const
+{
+  switch(nLayers) {
+  case 3: return layerFeatures<3>(row);
+  case 4: return layerFeatures<4>(row);
+  case 5: return layerFeatures<5>(row);
+  case 6: return layerFeatures<6>(row);
+  default: break;
+  }
+
+  std::vector<int> sums(3*nLayers, 0);
+  std::vector<int> nPointsPerLayer(nLayers, 0);
+  return layerFeaturesKernel<0>(nLayers, &sums[0], &nPointsPerLayer[0], row);
+}
+
+
 #endif
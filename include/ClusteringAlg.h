@@ -4,6 +4,8 @@
 #include <vector>
 
 #include "DataSet.h"
+#include "TileGrid.h"
+#include "TileStore.h"
 #include "optparse.h"
 
 /**
@@ -30,19 +32,95 @@ public:
   /** Runs the clustering chain. */
   void runClustering(DataSet &ds, const Config &config);
 
+  /** Runs the clustering chain tile by tile. */
+  void runTiledClustering(DataSet &ds, const Config &config);
+
+  /** Runs the clustering chain tile by tile on points spilled to disk. */
+  void runTiledClustering(TileStore &store, DataSet &ds, const Config &config);
+
+  /** Runs the tiled clustering chain in worker processes. */
+  void runShardedClustering(DataSet &ds, const Config &config, int nShards);
+
+  /** Returns the tile size used by the tiled clustering. */
+  float tileSize(const Config &config) const;
+
+  /** Returns the halo width used by the tiled clustering. */
+  float tileHalo(const Config &config) const;
+
+  /** Finds the seed candidates owned by a tile. */
+  void findTileSeeds(DataSet &ds, const TileGrid &grid, int iTile, const Config &config,
+		     std::vector<Cluster> &candidates);
+
+  /** Selects seeds among candidates collected from all tiles. */
+  void selectSeeds(const std::vector<Cluster> &candidates, const Config &config,
+		   std::vector<Cluster> &seeds);
+
+  /** Assigns the points owned by a tile to the nearest seed. */
+  void assignTile(DataSet &ds, const TileGrid &grid, int iTile, const std::vector<Cluster> &seeds,
+		  const Config &config, std::vector<int> &assignment);
+
+  /** Fills clusters from a point to cluster assignment. */
+  void fillClusters(DataSet &ds, std::vector<int> &assignment);
+
+  /** Cleanup clusters from noise. */
+  void cleanupClusters(DataSet &ds, const Config &config);
+
+  /** Runs the in-memory clustering chain on a region of the field. */
+  float runRegionClustering(DataSet &ds, const Config &config, float dmaxMin);
+
 private:
   
   /** Runs a pre-clustering step. */
   void runPreClustering(DataSet &ds, const Config &config);
 
+  /** Runs a pre-clustering step based on connected components. */
+  void runComponentPreClustering(DataSet &ds, const Config &config);
+
   /** Compute densities of pre-clusters. */
-  void computeDensities(DataSet &ds, const Config &config);
+  float computeDensities(DataSet &ds, const Config &config, float dmaxMin = 0);
 
   /** Runs the actual clustering algorithm. */
   void runSeededClustering(DataSet &ds, const Config &config);
 
-  /** Cleanup clusters from noise. */
-  void cleanupClusters(DataSet &ds, const Config &config);
+  /** Computes unnormalized densities of pre-clusters. */
+  float countDensities(std::vector<Cluster> &preClusters, float d);
+
+  /** Estimates unnormalized densities of pre-clusters from a random sample. */
+  float estimateDensities(std::vector<Cluster> &preClusters, float d, const Config &config);
+
+  /** Flags pre-clusters which are local density maxima. */
+  void findLocalMaxima(const std::vector<Cluster> &preClusters, float d, std::vector<bool> &isLocalMax);
+
+  /** Copies the points of a tile and its halo into a working data set. */
+  void loadTile(DataSet &ds, const TileGrid &grid, int iTile, DataSet &tileDS,
+		std::vector<unsigned int> &indices);
+
+  /** Reads the points of a tile and its halo from a store and pre-clusters them. */
+  void loadTile(const TileStore &store, int iTile, const Config &config, DataSet &tileDS);
+
+  /** Appends the local density maxima of a tile centered in its core to the seed candidates. */
+  template<class InCore>
+  void findSeedCandidates(DataSet &tileDS, const InCore &inCore, float d, std::vector<Cluster> &candidates);
+
+  /** Calls a function for each point of a tile core with the index of its nearest seed. */
+  template<class Function>
+  void forEachTilePoint(const TileStore &store, int iTile, const std::vector<Cluster> &seeds,
+			const Config &config, const Function &f);
+
+  /** Runs the grid-indexed DBSCAN clustering. */
+  void runDbscanClustering(DataSet &ds, const Config &config);
+
+  /** Runs the streaming clustering on a data set read in full. */
+  void runStreamingClustering(DataSet &ds, const Config &config);
+
+  /** Calls a function for each point within a distance of a point in the (x,z) plane. */
+  template<class Function>
+  void forEachNeighbor(const TileGrid &grid, const std::vector<CloudPoint> &points,
+		       unsigned int i, float eps, const Function &f) const;
+
+  /** Returns the index of the cluster with the nearest seed for a compile-time metric. */
+  template<class Metric>
+  int findNearestSeed(const std::vector<Cluster> &clusters, const Point &p) const;
   
 };
 
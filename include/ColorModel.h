@@ -0,0 +1,114 @@
+#ifndef COLOR_MODEL_H
+#define COLOR_MODEL_H
+
+#include <string>
+#include <vector>
+
+#include "FeatureMatrix.h"
+#include "PCA.h"
+#include "Point.h"
+
+/**
+ * @brief Trained model of the unsupervised classification.
+ *
+ * Holds the moments of the training features, from which the PCA transformation is computed, the k-means
+ * centroids and the class of each centroid. Once trained on one frame, it labels the clusters of other frames
+ * with one projection and one nearest-centroid search per cluster, without retraining.
+ *
+ * The centroids are stored in the feature space, as the mean features of their members, and projected
+ * onto the 3 leading PCA components whenever the transformation changes. Since the projection is affine,
+ * they are the k-means centroids in the PCA space.
+ *
+ * For a sequence of frames, update() adapts the model to the clusters of each new frame:
+ * - The moments are decayed by a forgetting factor before the new features are merged,
+ *   and the PCA transformation is recomputed.
+ * - The centroids follow the mini-batch k-means of Sculley (2010): each new cluster moves its closest centroid
+ *   with a step inversely proportional to the centroid weight, which is decayed by the same forgetting factor.
+ *
+ * The cost of an update only depends on the number of clusters of the frame.
+ *
+ * The model file is laid out as:
+ * - A Header.
+ * - The feature moments, see PCA::Accumulator::write().
+ * - The centroid features, nVariables doubles per centroid.
+ * - The centroid weights (doubles).
+ * - The class index of each centroid (32-bit integers).
+ * - The class names, each terminated by a null character.
+ */
+class ColorModel {
+
+public:
+
+  /** Header of the model file. */
+  struct Header {
+    char magic[8];             ///< File signature.
+    unsigned int version;      ///< Format version.
+    unsigned int nVariables;   ///< Number of input features.
+    unsigned int nCentroids;   ///< Number of k-means centroids.
+    unsigned int namesSize;    ///< Size in bytes of the class names.
+  };
+
+  /** Default constructor. */
+  ColorModel();
+
+  /** Destructor. */
+  ~ColorModel();
+
+  /** Computes the PCA transformation from the moments of the training features. */
+  void train(const PCA::Accumulator &moments);
+
+  /** Sets the centroids and their classes. */
+  void setCentroids(const std::vector<double> &features, const std::vector<double> &weights,
+		    const std::vector<int> &classIds, const std::vector<std::string> &classNames);
+
+  /** Adapts the model to new features. */
+  void update(const FeatureMatrix &features, double forgetting, int nThreads, unsigned int blockSize);
+
+  /** Projects features onto the 3 leading PCA components. */
+  void project(const FeatureMatrix &features, std::vector<Point> &colors, int nThreads) const;
+
+  /** Classifies features with the closest centroid. */
+  void classify(const FeatureMatrix &features, std::vector<Point> &colors,
+		std::vector<int> &classIds, int nThreads) const;
+
+  /** Writes the model. */
+  void write(const std::string &fileName) const;
+
+  /** Reads a model written by write(). */
+  void read(const std::string &fileName);
+
+  /** Returns the PCA transformation.
+   * @return PCA transformation.
+   */
+  inline const PCA &pca() const { return m_pca; }
+
+  /** Returns the centroids.
+   * @return Centroids in the PCA space.
+   */
+  inline const std::vector<Point> &centroids() const { return m_centroids; }
+
+  /** Returns the class names.
+   * @return Class names, ordered by class index.
+   */
+  inline const std::vector<std::string> &classNames() const { return m_classNames; }
+
+private:
+
+  /** Projects the centroids onto the PCA space. */
+  void projectCentroids();
+
+  /** Returns the index of the centroid closest to a point of the PCA space. */
+  int closestCentroid(const Point &color) const;
+
+private:
+
+  PCA::Accumulator m_moments;
+  PCA m_pca;
+  std::vector<double> m_centroidFeatures;
+  std::vector<double> m_centroidWeights;
+  std::vector<Point> m_centroids;
+  std::vector<int> m_classIds;
+  std::vector<std::string> m_classNames;
+};
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef COMPILED_BDT_H
+#define COMPILED_BDT_H
+
+#include <string>
+#include <vector>
+
+#include "FeatureMatrix.h"
+
+/**
+ * @brief Multiclass boosted decision trees compiled ahead of time into a plugin.
+ *
+ * The plugin is a shared library built from the source generated by BDTModel::writeSource(),
+ * where each tree is compiled code instead of an array of nodes.
+ * It is only used if it was generated from the current model: the hash of the binary model file
+ * is embedded in the plugin and checked when loading.
+ */
+class CompiledBDT {
+
+public:
+
+  /** Default constructor. */
+  CompiledBDT();
+
+  /** Destructor. */
+  ~CompiledBDT();
+
+  /** Loads a plugin generated from a given model. */
+  bool load(const std::string &pluginFile, unsigned long long modelHash);
+
+  /** Evaluates the class probabilities of a single input. */
+  void evaluate(const float *row, float *outputs) const;
+
+  /** Evaluates the class probabilities of all rows of a feature matrix. */
+  void evaluate(const FeatureMatrix &features, std::vector<float> &outputs, int nThreads) const;
+
+  /** Returns the number of input features.
+   * @return Number of features.
+   */
+  inline unsigned int nVariables() const { return m_nVariables; }
+
+  /** Returns the number of classes.
+   * @return Number of classes.
+   */
+  inline unsigned int nClasses() const { return m_classNames.size(); }
+
+  /** Returns the class names.
+   * @return Class names, ordered by class index.
+   */
+  inline const std::vector<std::string> &classNames() const { return m_classNames; }
+
+private:
+
+  /** Releases the plugin. */
+  void unload();
+
+  /** Copy is not supported. */
+  CompiledBDT(const CompiledBDT &);
+
+  /** Assignment is not supported. */
+  CompiledBDT &operator=(const CompiledBDT &);
+
+private:
+
+  typedef void (*EvaluateFunction)(const float *rows, unsigned int nRows, float *outputs);
+
+  void *m_handle;
+  EvaluateFunction m_evaluate;
+  unsigned int m_nVariables;
+  std::vector<std::string> m_classNames;
+};
+
+#endif
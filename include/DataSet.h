@@ -1,13 +1,18 @@
 #ifndef DATASET_H
 #define DATASET_H
 
+#include <functional>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "CloudPoint.h"
 #include "Cluster.h"
 #include "optparse.h"
 
+class IngestFilter;
+class RandomStream;
+
 /**
  * @brief This class represents the data to be analysed.
  *
@@ -24,10 +29,45 @@ public:
   /** Destructor */
   ~DataSet();
 
+  /** Function called when points are added to a data set, with the index of the first new point. */
+  typedef std::function<void(DataSet &ds, unsigned int begin)> PacketCallback;
+
   /** Reads data from a text file. */
   static bool readFromFile(const Config &config,
 			   DataSet &trainingData,
-			   DataSet &evaluationData);
+			   DataSet &evaluationData,
+			   const PacketCallback &onPacket = PacketCallback());
+
+  /** Replaces points by the centroids of the occupied voxels. */
+  void downsample(float voxelSize);
+
+  /** Replaces voxels in clusters by the full resolution points they represent. */
+  void restoreFullResolution();
+
+  /** Returns whether points are voxel centroids.
+   * @return @c true if the data set was downsampled.
+   */
+  inline bool isDownsampled() const { return !m_voxelOffsets.empty(); }
+
+  /** Returns the index of the voxel represented by a point. */
+  int voxelIndex(const CloudPoint &cp) const;
+
+  /** Returns the full resolution points, grouped by voxel.
+   * @return Full resolution points.
+   */
+  inline const std::vector<CloudPoint> &fullResolutionPoints() const { return m_fullPoints; }
+
+  /** Returns the index of the first full resolution point of a voxel.
+   * @param iVoxel Voxel index.
+   * @return Index in fullResolutionPoints().
+   */
+  inline unsigned int voxelBegin(int iVoxel) const { return m_voxelOffsets[iVoxel]; }
+
+  /** Returns the index past the last full resolution point of a voxel.
+   * @param iVoxel Voxel index.
+   * @return Index in fullResolutionPoints().
+   */
+  inline unsigned int voxelEnd(int iVoxel) const { return m_voxelOffsets[iVoxel+1]; }
 
   /** Returns the minimum of a coordinate */
   float getCoordinateMin(int coordinate);
@@ -35,6 +75,11 @@ public:
   /** Returns the maximum of a coordinate */
   float getCoordinateMax(int coordinate);
   
+  /** Returns the fraction of the input points held by this data set.
+   * @return Sampling fraction.
+   */
+  inline float samplingFraction() const { return m_samplingFraction; }
+
   /** Returns cloud points. 
    * @return All Cloud Points.
    */
@@ -50,14 +95,27 @@ public:
    */
   inline std::vector<Cluster> &clusters() { return m_clusters; }
   
+private:
+
+  /** Adds a batch of points read from the input. */
+  static void addPoints(std::vector<CloudPoint> &batch, float evalFrac,
+			const RandomStream &rng, unsigned long long &nRead, IngestFilter &filter,
+			DataSet &trainingData, DataSet &evaluationData,
+			bool &isFirst, std::vector<float> &mins, std::vector<float> &maxs);
+
 private:
 
   std::vector<CloudPoint> m_points;
   std::vector<Cluster> m_preClusters;
   std::vector<Cluster> m_clusters;
 
+  float m_samplingFraction;
   std::vector<float> m_mins;
   std::vector<float> m_maxs;
+
+  std::vector<CloudPoint> m_fullPoints;
+  std::vector<unsigned int> m_voxelOffsets;
+  std::unordered_map<int, int> m_voxelIds;
 };
 
 #endif
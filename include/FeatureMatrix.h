@@ -0,0 +1,142 @@
+#ifndef FEATURE_MATRIX_H
+#define FEATURE_MATRIX_H
+
+#include <string>
+#include <vector>
+
+#include "Cluster.h"
+#include "optparse.h"
+
+/**
+ * @brief Per-layer color features of a list of clusters.
+ *
+ * Features are stored as a contiguous row-major matrix with one row of 3*nLayers values
+ * (r0, g0, b0, r1, g1, b1, ...) per cluster. The storage is aligned on a cache line.
+ *
+ * Layer colors are integer averages of 8-bit colors, so that they can be stored as 8-bit integers
+ * without any loss, in a quarter of the memory of floats. This is meant for the large bootstrap matrices
+ * of the training. Rows of 8-bit matrices are converted to floats on the fly with row(unsigned int, float*),
+ * the direct accessors row(unsigned int) and data() are only valid for float matrices.
+ *
+ * The features of fill() can be computed from a sample of the points of each cluster, stopping when
+ * the layer color means are known to a given standard error (see setSampling() and
+ * Cluster::sampledLayerFeatures()), so that their cost does not grow with the density of the clusters.
+ * Thin layers, with a small fraction of the points of a cluster, stop being sampled after a fixed number of
+ * visited points, and @c \-\-featureMaxSamples caps the points sampled from layers with a large color spread.
+ */
+class FeatureMatrix {
+
+public:
+
+  /** Storage type of the features. */
+  enum Storage {
+    kFloat,   ///< 32-bit floats.
+    kUInt8    ///< 8-bit integers.
+  };
+
+  /** Largest number of layers, bounding the size of a row. */
+  static const int kMaxLayers = 64;
+
+  /** Full constructor. */
+  FeatureMatrix(int nLayers, Storage storage = kFloat);
+
+  /** Destructor. */
+  ~FeatureMatrix();
+
+  /** Sets the point sampling of fill() from the configuration. */
+  void setSampling(const Config &config);
+
+  /** Computes the features of a list of clusters. */
+  void fill(const std::vector<const Cluster*> &clusters, int nThreads);
+
+  /** Computes the features of random samples of the points of a list of clusters. */
+  void fillBootstrap(const std::vector<const Cluster*> &clusters, int nSamples, float fraction,
+		     unsigned long long seed, int nThreads);
+
+  /** Converts a storage name of the configuration. */
+  static Storage storageFromName(const std::string &name);
+
+  /** Returns the storage type.
+   * @return Storage type of the features.
+   */
+  inline Storage storage() const { return m_storage; }
+
+  /** Returns the number of layers.
+   * @return Number of layers.
+   */
+  inline int nLayers() const { return m_nLayers; }
+
+  /** Returns the number of rows.
+   * @return Number of clusters.
+   */
+  inline unsigned int nRows() const { return m_nRows; }
+
+  /** Returns the number of columns.
+   * @return Number of features per cluster.
+   */
+  inline unsigned int nColumns() const { return 3*m_nLayers; }
+
+  /** Returns the memory used by the features.
+   * @return Size in bytes.
+   */
+  inline size_t memorySize() const { return (size_t)m_nRows*nColumns()*elementSize(); }
+
+  /** Returns the features of a cluster of a float matrix.
+   * @param i Row index.
+   * @return Pointer to the first feature of the row.
+   */
+  inline const float *row(unsigned int i) const { return static_cast<const float*>(m_data) + i*nColumns(); }
+
+  /** Returns the features of a cluster of an 8-bit matrix.
+   * @param i Row index.
+   * @return Pointer to the first feature of the row.
+   */
+  inline const unsigned char *quantizedRow(unsigned int i) const {
+    return static_cast<const unsigned char*>(m_data) + i*nColumns();
+  }
+
+  /** Returns the features of a cluster as floats, whatever the storage.
+   * @param i Row index.
+   * @param buffer Buffer of nColumns() floats, filled for 8-bit matrices.
+   * @return Pointer to the first feature of the row, in the matrix or in the buffer.
+   */
+  inline const float *row(unsigned int i, float *buffer) const {
+    if(m_storage == kFloat) return row(i);
+    const unsigned char *values = quantizedRow(i);
+    for(unsigned int j=0; j<nColumns(); j++) buffer[j] = values[j];
+    return buffer;
+  }
+
+  /** Returns the whole matrix of a float matrix.
+   * @return Pointer to the first feature of the first row.
+   */
+  inline const float *data() const { return static_cast<const float*>(m_data); }
+
+private:
+
+  /** Returns the size of a feature.
+   * @return Size in bytes.
+   */
+  inline size_t elementSize() const { return m_storage == kFloat ? sizeof(float) : sizeof(unsigned char); }
+
+  /** Allocates storage for a number of rows. */
+  void allocate(unsigned int nRows);
+
+  /** Copy is not supported. */
+  FeatureMatrix(const FeatureMatrix &);
+
+  /** Assignment is not supported. */
+  FeatureMatrix &operator=(const FeatureMatrix &);
+
+private:
+
+  int m_nLayers;
+  Storage m_storage;
+  float m_tolerance;
+  unsigned int m_maxSamples;
+  int m_seed;
+  unsigned int m_nRows;
+  void *m_data;
+};
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef INCREMENTAL_CLUSTERING_H
+#define INCREMENTAL_CLUSTERING_H
+
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "DataSet.h"
+#include "optparse.h"
+
+/**
+ * @brief Clustering of consecutive frames which only recomputes the regions that changed.
+ *
+ * Points are counted on a raster of square cells. Cells whose count changed with respect to the
+ * previous frame by more than the tolerance are dirty, and the dirty region is extended by the
+ * range over which points influence pre-clusters and densities. \n
+ * Clusters of the previous frame whose core lies outside the dirty region are reused as they are,
+ * including the layer features cached for the classification (see Cluster::cachedLayerFeatures()). Only the points of the dirty region are clustered again.
+ */
+class IncrementalClustering {
+
+public:
+
+  /** Full constructor. */
+  IncrementalClustering(const Config &config);
+
+  /** Destructor. */
+  ~IncrementalClustering();
+
+  /** Clusters the points of the next frame. */
+  void processFrame(DataSet &ds);
+
+  /** Returns the number of frames processed.
+   * @return Number of frames.
+   */
+  inline unsigned int nFrames() const { return m_nFrames; }
+
+  /** Returns the fraction of the occupied cells recomputed in the last frame.
+   * @return Fraction of cells.
+   */
+  inline float dirtyFraction() const { return m_dirtyFraction; }
+
+  /** Returns the fraction of the points clustered again in the last frame.
+   * @return Fraction of points.
+   */
+  inline float reclusteredFraction() const { return m_reclusteredFraction; }
+
+  /** Returns the number of clusters reused from the previous frame.
+   * @return Number of clusters.
+   */
+  inline unsigned int nReused() const { return m_nReused; }
+
+private:
+
+  /** Returns the key of the cell containing a position. */
+  long long cellKey(float x, float z) const;
+
+  /** Returns the key of a cell from its indices. */
+  static long long cellKey(int ix, int iz);
+
+  /** Marks the cells within the margin of a changed cell as dirty. */
+  void markDirty(long long key, std::unordered_set<long long> &dirty) const;
+
+private:
+
+  Config m_config;
+  float m_cellSize;
+  float m_tolerance;
+  int m_margin;
+
+  std::unordered_map<long long, float> m_counts;
+  std::vector<Cluster> m_clusters;
+  float m_dmax;
+
+  unsigned int m_nFrames;
+  float m_dirtyFraction;
+  float m_reclusteredFraction;
+  unsigned int m_nReused;
+};
+
+#endif
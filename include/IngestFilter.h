@@ -0,0 +1,85 @@
+#ifndef INGEST_FILTER_H
+#define INGEST_FILTER_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "CloudPoint.h"
+#include "optparse.h"
+
+/**
+ * @brief Region of interest and height band selection applied while reading the input data.
+ *
+ * Points are dropped if they are:
+ * - outside the field polygon in the (x,z) plane,
+ * - outside the allowed height band in y,
+ * - within a tolerance of the floor plane.
+ *
+ * Points are processed in batches stored as separate coordinate arrays,
+ * so that the selection loops can be vectorized by the compiler.
+ */
+class IngestFilter {
+
+public:
+
+  /** Full constructor. */
+  IngestFilter(const Config &config);
+
+  /** Destructor. */
+  ~IngestFilter();
+
+  /** Returns whether any selection is configured.
+   * @return @c true if points may be dropped.
+   */
+  inline bool isActive() const { return m_hasPolygon || m_hasMinHeight || m_hasMaxHeight || m_floorTolerance > 0; }
+
+  /** Removes rejected points from a batch. */
+  void apply(std::vector<CloudPoint> &batch);
+
+  /** Prints the number of dropped points. */
+  void print(std::ostream &out) const;
+
+  /** Returns the number of points seen.
+   * @return Number of points.
+   */
+  inline unsigned long nInput() const { return m_nInput; }
+
+  /** Returns the number of points dropped.
+   * @return Number of points.
+   */
+  inline unsigned long nDropped() const { return m_nOutsideField + m_nOutsideHeight + m_nFloor; }
+
+private:
+
+  /** Parses a polygon given as "x1,z1;x2,z2;...". */
+  bool parsePolygon(const std::string &str);
+
+private:
+
+  bool m_hasPolygon;
+  std::vector<float> m_polyX;
+  std::vector<float> m_polyZ;
+
+  bool m_hasMinHeight;
+  bool m_hasMaxHeight;
+  float m_minHeight;
+  float m_maxHeight;
+
+  float m_floorHeight;
+  float m_floorTolerance;
+
+  std::vector<float> m_x;
+  std::vector<float> m_y;
+  std::vector<float> m_z;
+  std::vector<unsigned char> m_inField;
+  std::vector<unsigned char> m_inBand;
+  std::vector<unsigned char> m_offFloor;
+
+  unsigned long m_nInput;
+  unsigned long m_nOutsideField;
+  unsigned long m_nOutsideHeight;
+  unsigned long m_nFloor;
+};
+
+#endif
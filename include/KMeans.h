@@ -0,0 +1,98 @@
+#ifndef KMEANS_H
+#define KMEANS_H
+
+#include <vector>
+
+#include "Point.h"
+#include "optparse.h"
+
+/**
+ * @brief Weighted k-means clustering of points in the 3D PCA space.
+ *
+ * - Seeding: k-means++, each center being drawn with a probability proportional to its weighted squared
+ *   distance to the closest center already chosen.
+ * - Iterations: Lloyd's algorithm with the bounds of Hamerly. An upper bound on the distance to the assigned
+ *   centroid and a lower bound on the distance to the second closest one are kept per point and updated with
+ *   the centroid shifts, so that most points are confirmed without computing any distance.
+ *   The result is the same as without pruning.
+ * - Restarts: @c \-\-kmeansRestarts independent runs are made in parallel, and the one with the smallest
+ *   inertia (weighted sum of squared distances to the centroids) is kept.
+ * - Coreset: if @c \-\-kmeansCoresetSize is positive and smaller than the number of points, the runs use
+ *   a lightweight coreset (Bachem et al., 2018): points sampled with a probability mixing the uniform
+ *   distribution and the squared distance to the mean, weighted by their inverse probability.
+ *
+ * The final centroids are sorted by coordinates, so that their order does not depend on the seeding.
+ * All random numbers come from counter-based streams, so the result does not depend on the number of threads.
+ */
+class KMeans {
+
+public:
+
+  /** Full constructor. */
+  KMeans(const Config &config);
+
+  /** Destructor. */
+  ~KMeans();
+
+  /** Computes the centroids of a set of points. */
+  int fit(int k, const std::vector<Point> &points);
+
+  /** Assigns points to the closest centroid. */
+  void assign(const std::vector<Point> &points, std::vector<int> &assignments) const;
+
+  /** Returns the centroids.
+   * @return Centroids, sorted by coordinates.
+   */
+  inline const std::vector<Point> &centroids() const { return m_centroids; }
+
+  /** Returns the inertia of the fit.
+   * @return Weighted sum of squared distances of the fitted points to their centroid.
+   */
+  inline double inertia() const { return m_inertia; }
+
+private:
+
+  /** Runs k-means once from k-means++ seeds. */
+  int run(unsigned int iRestart, const std::vector<double> &coords, const std::vector<double> &weights,
+	  int nThreads, std::vector<double> &centroids, double &inertia) const;
+
+  /** Chooses the initial centroids with k-means++. */
+  void seed(unsigned int iRestart, const std::vector<double> &coords, const std::vector<double> &weights,
+	    std::vector<double> &centroids) const;
+
+  /** Samples a weighted coreset of the points. */
+  void sampleCoreset(const std::vector<double> &coords, std::vector<double> &coreset,
+		     std::vector<double> &weights) const;
+
+  /** Returns the squared distance between two 3D points. */
+  static inline double distSq(const double *a, const double *b);
+
+private:
+
+  int m_k;
+  int m_seed;
+  int m_nIterationsMax;
+  int m_nRestarts;
+  unsigned int m_coresetSize;
+  int m_nThreads;
+  unsigned int m_blockSize;
+
+  std::vector<Point> m_centroids;
+  double m_inertia;
+};
+
+
+/**
+ * @param a First point.
+ * @param b Second point.
+ * @return Squared distance.
+ */
+inline double KMeans::distSq(const double *a, const double *b)
+{
+  double dx = a[0] - b[0];
+  double dy = a[1] - b[1];
+  double dz = a[2] - b[2];
+  return dx*dx + dy*dy + dz*dz;
+}
+
+#endif
@@ -0,0 +1,9 @@
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#include "optparse.h"
+
+/** Parses command line arguments shared by all executables. */
+void parseCommandLine(Config &config, int argc, char **argv);
+
+#endif
@@ -0,0 +1,134 @@
+#ifndef PCA_H
+#define PCA_H
+
+#include <istream>
+#include <ostream>
+#include <vector>
+
+#include "FeatureMatrix.h"
+
+/**
+ * @brief Principal Component Analysis of cluster features.
+ *
+ * Equivalent to a TPrincipal with the "ND" options: the features are normalized to zero mean and unit variance,
+ * and the principal components are the eigenvectors of their correlation matrix, ordered by decreasing eigenvalue.
+ * The sign of each component is fixed so that its largest coefficient is positive.
+ *
+ * The means and covariances are accumulated in a single pass with the updating formulas of Welford and
+ * Chan et al.: partial Accumulator objects of disjoint sets of rows can be merged, so that the training
+ * data is processed in parallel blocks. The correlation matrix is diagonalized with the cyclic Jacobi method,
+ * which is accurate and fast for the small matrices used here (15x15 for 5 layers).
+ *
+ * The normalization is folded into the projection matrix, so that projecting a row onto the leading components
+ * only costs one dot product per component.
+ *
+ * For slowly changing inputs, the accumulated moments can be decayed before merging new rows, so that
+ * the principal components follow the recent rows with a bounded cost per update.
+ */
+class PCA {
+
+public:
+
+  /**
+   * @brief Mergeable accumulator of the means and covariances of a set of rows.
+   */
+  class Accumulator {
+
+  public:
+
+    /** Full constructor. */
+    Accumulator(unsigned int nVariables);
+
+    /** Adds a row. */
+    void add(const float *row);
+
+    /** Merges the moments of a disjoint set of rows. */
+    void merge(const Accumulator &other);
+
+    /** Scales down the weight of the accumulated rows. */
+    void decay(double factor);
+
+    /** Writes the moments in binary form. */
+    void write(std::ostream &os) const;
+
+    /** Reads moments written by write(). */
+    void read(std::istream &is, unsigned int nVariables);
+
+    /** Returns the number of variables.
+     * @return Number of variables.
+     */
+    inline unsigned int nVariables() const { return m_mean.size(); }
+
+    /** Returns the number of rows.
+     * @return Number of accumulated rows, weighted by their decay.
+     */
+    inline double count() const { return m_count; }
+
+    /** Returns the mean of a variable.
+     * @param i Variable index.
+     * @return Mean value.
+     */
+    inline double mean(unsigned int i) const { return m_mean[i]; }
+
+    /** Returns a covariance, normalized to the number of rows as in TPrincipal.
+     * @param i First variable index.
+     * @param j Second variable index.
+     * @return Covariance.
+     */
+    inline double covariance(unsigned int i, unsigned int j) const {
+      return m_count > 0 ? m_comoments[i*nVariables()+j]/m_count : 0;
+    }
+
+  private:
+
+    double m_count;
+    std::vector<double> m_mean;
+    std::vector<double> m_comoments;
+  };
+
+  /** Default constructor. */
+  PCA();
+
+  /** Destructor. */
+  ~PCA();
+
+  /** Accumulates the moments of all rows of a feature matrix. */
+  static Accumulator accumulate(const FeatureMatrix &features, int nThreads, unsigned int blockSize);
+
+  /** Computes the principal components of a feature matrix. */
+  void train(const FeatureMatrix &features, int nThreads, unsigned int blockSize);
+
+  /** Computes the principal components from accumulated moments. */
+  void train(const Accumulator &moments);
+
+  /** Projects a row onto the leading principal components. */
+  void project(const double *row, unsigned int nComponents, double *components) const;
+
+  /** Projects all rows of a feature matrix onto the leading principal components. */
+  void project(const FeatureMatrix &features, unsigned int nComponents,
+	       std::vector<float> &outputs, int nThreads) const;
+
+  /** Returns the number of variables.
+   * @return Number of input variables, 0 before training.
+   */
+  inline unsigned int nVariables() const { return m_eigenvalues.size(); }
+
+  /** Returns the eigenvalues of the correlation matrix.
+   * @return Eigenvalues, in decreasing order.
+   */
+  inline const std::vector<double> &eigenvalues() const { return m_eigenvalues; }
+
+private:
+
+  /** Diagonalizes a symmetric matrix. */
+  static void diagonalize(unsigned int n, std::vector<double> &matrix,
+			  std::vector<double> &values, std::vector<double> &vectors);
+
+private:
+
+  std::vector<double> m_eigenvalues;
+  std::vector<double> m_projection;
+  std::vector<double> m_offsets;
+};
+
+#endif
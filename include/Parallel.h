@@ -0,0 +1,113 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <thread>
+#include <vector>
+
+#include "optparse.h"
+
+/**
+ * @brief Returns the number of worker threads requested in the configuration.
+ *
+ * A value of 0 selects the number of hardware threads.
+ *
+ * @param config Configuration.
+ * @return Number of threads, at least 1.
+ */
+inline int threadCount(const Config &config)
+{
+  int nThreads = config.get("nThreads");
+  if(nThreads <= 0) nThreads = std::thread::hardware_concurrency();
+  if(nThreads <= 0) nThreads = 1;
+  return nThreads;
+}
+
+/**
+ * @brief Returns the block size of parallel reductions.
+ *
+ * In deterministic mode, reductions use blocks of fixed size so that the results do not depend on the
+ * number of threads. Otherwise, 0 is returned and reductions use one block per thread.
+ *
+ * @param config Configuration.
+ * @return Block size, or 0 for one block per thread.
+ */
+inline unsigned int reductionBlockSize(const Config &config)
+{
+  if(config.get("deterministic")) return 1024;
+  return 0;
+}
+
+/**
+ * @brief Calls a function for each index in [0, n) using several threads.
+ *
+ * The index range is split into contiguous chunks, one per thread.
+ * The function must be safe to call concurrently for different indices.
+ *
+ * @param n Number of indices.
+ * @param nThreads Number of threads. With 1 thread, the calls are made in order by the calling thread.
+ * @param f Function called with each index.
+ */
+template<class Function>
+void parallelFor(unsigned int n, int nThreads, const Function &f)
+{
+  if(nThreads > (int)n) nThreads = n;
+  if(nThreads <= 1) {
+    for(unsigned int i=0; i<n; i++) f(i);
+    return;
+  }
+
+  std::vector<std::thread> threads;
+  for(int t=0; t<nThreads; t++) {
+    unsigned int begin = (unsigned long long)n*t/nThreads;
+    unsigned int end = (unsigned long long)n*(t+1)/nThreads;
+    threads.push_back(std::thread([&f, begin, end]() {
+	  for(unsigned int i=begin; i<end; i++) f(i);
+	}));
+  }
+  for(unsigned int t=0; t<threads.size(); t++) {
+    threads[t].join();
+  }
+}
+
+/**
+ * @brief Reduces the index range [0, n) using several threads.
+ *
+ * The range is split into contiguous blocks, which are reduced in parallel.
+ * The block results are then combined by a pairwise tree in block order.
+ * With a fixed block size, the shape of the reduction and thus the rounding of floating point sums
+ * are independent of the number of threads.
+ *
+ * @param n Number of indices.
+ * @param nThreads Number of threads.
+ * @param blockSize Number of indices per block. Put 0 to use one block per thread.
+ * @param init Result of an empty range.
+ * @param f Function reducing a block, called with the begin and end indices.
+ * @param combine Function combining the results of two consecutive blocks.
+ * @return Reduced result.
+ */
+template<class T, class Function, class Combine>
+T parallelReduce(unsigned int n, int nThreads, unsigned int blockSize, const T &init,
+		 const Function &f, const Combine &combine)
+{
+  if(n == 0) return init;
+  if(nThreads > (int)n) nThreads = n;
+  if(nThreads < 1) nThreads = 1;
+  if(blockSize == 0) blockSize = (n+nThreads-1)/nThreads;
+
+  unsigned int nBlocks = (n+blockSize-1)/blockSize;
+  std::vector<T> results(nBlocks, init);
+  parallelFor(nBlocks, nThreads, [&](unsigned int iBlock) {
+      unsigned int begin = iBlock*blockSize;
+      unsigned int end = begin+blockSize < n ? begin+blockSize : n;
+      results[iBlock] = f(begin, end);
+    });
+
+  for(unsigned int step=1; step<nBlocks; step*=2) {
+    for(unsigned int i=0; i+step<nBlocks; i+=2*step) {
+      results[i] = combine(results[i], results[i+step]);
+    }
+  }
+  return results[0];
+}
+
+#endif
@@ -0,0 +1,87 @@
+#ifndef PLAYER_TRACKER_H
+#define PLAYER_TRACKER_H
+
+#include <vector>
+
+#include "ClassificationAlg.h"
+#include "DataSet.h"
+#include "Point.h"
+#include "optparse.h"
+
+/**
+ * @brief Tracking of the players across frames, which reuses their classification.
+ *
+ * The team of a player does not change, so that a cluster continuing a track of the previous frame
+ * inherits its class, without computing its features or running the classification. \n
+ * Clusters are associated with the tracks by gated global nearest neighbor: the pairs closer than
+ * @c \-\-trackingGate, in the horizontal plane, are matched by increasing distance, each cluster and track
+ * being used at most once. Only the following clusters are classified again, with
+ * ClassificationAlg::classifyFrame():
+ * - New clusters, matching no track.
+ * - Ambiguous clusters, with tracks of different classes within the gate, e.g. players of both teams
+ *   crossing each other.
+ * - Clusters of tracks classified @c \-\-trackingRefresh frames ago or more.
+ *
+ * Tracks that are not matched for more than @c \-\-trackingMaxMissed frames are dropped.
+ * During steady play, only the periodic refreshes are classified. The first refresh of each new track is
+ * staggered by its cluster index, so that tracks created together, e.g. on the first frame, are refreshed
+ * over @c \-\-trackingRefresh frames rather than all at once.
+ */
+class PlayerTracker {
+
+public:
+
+  /** Full constructor. */
+  PlayerTracker(const Config &config);
+
+  /** Destructor. */
+  ~PlayerTracker();
+
+  /** Classifies the clusters of the next frame. */
+  void processFrame(DataSet &ds, ClassificationAlg &classAlg);
+
+  /** Returns the number of frames processed.
+   * @return Number of frames.
+   */
+  inline unsigned int nFrames() const { return m_nFrames; }
+
+  /** Returns the number of tracks.
+   * @return Number of tracks after the last frame.
+   */
+  inline unsigned int nTracks() const { return m_tracks.size(); }
+
+  /** Returns the number of clusters classified in the last frame.
+   * @return Number of clusters.
+   */
+  inline unsigned int nClassified() const { return m_nClassified; }
+
+  /** Returns the number of ambiguous clusters of the last frame.
+   * @return Number of clusters.
+   */
+  inline unsigned int nAmbiguous() const { return m_nAmbiguous; }
+
+private:
+
+  /** Track of a player. */
+  struct Track {
+    Point position;              ///< Center of mass of the last matched cluster.
+    int classId;                 ///< Class index.
+    int classified;              ///< Frame of the last classification, earlier for new tracks to stagger their refresh.
+    int nMissed;                 ///< Number of consecutive frames without match.
+  };
+
+private:
+
+  Config m_config;
+  float m_gate;
+  int m_refresh;
+  int m_maxMissed;
+
+  std::vector<Track> m_tracks;
+
+  unsigned int m_nFrames;
+  unsigned int m_nClassified;
+  unsigned int m_nAmbiguous;
+};
+
+#endif
@@ -57,6 +57,13 @@ public:
 
   /** Returns 3D squared distance in the (x,y,z) space */
   float dist3DSq(const Point &p) const;
+
+  /** Returns the squared distance for a compile-time metric.
+   * @param p Point with respect to which the distance is calculated.
+   * @return Squared distance as defined by @c Metric.
+   */
+  template<class Metric>
+  inline float distSq(const Point &p) const { return Metric::distSq(*this, p); }
   
 protected:
 
@@ -65,4 +72,41 @@ protected:
   float m_z;
 };
 
+
+/**
+ * @brief Squared euclidean distance in @c Dim dimensions.
+ *
+ * Used as a template parameter to select the distance at compile time:
+ * - Metric<2> uses the horizontal (x,z) plane.
+ * - Metric<3> uses the full (x,y,z) space.
+ */
+template<int Dim>
+struct Metric;
+
+/** @brief Squared distance in the horizontal (x,z) plane. */
+template<>
+struct Metric<2> {
+  enum { Dimension = 2 };
+  static inline float distSq(const Point &a, const Point &b) {
+    float dx = b.x()-a.x();
+    float dz = b.z()-a.z();
+    return dx*dx + dz*dz;
+  }
+};
+
+/** @brief Squared distance in the (x,y,z) space. */
+template<>
+struct Metric<3> {
+  enum { Dimension = 3 };
+  static inline float distSq(const Point &a, const Point &b) {
+    float dx = b.x()-a.x();
+    float dy = b.y()-a.y();
+    float dz = b.z()-a.z();
+    return dx*dx + dy*dy + dz*dz;
+  }
+};
+
+typedef Metric<2> MetricXZ;
+typedef Metric<3> MetricXYZ;
+
 #endif
@@ -0,0 +1,113 @@
+#ifndef RANDOM_STREAM_H
+#define RANDOM_STREAM_H
+
+/**
+ * @brief Counter-based generator of pseudo-random numbers.
+ *
+ * A stream is identified by a seed and a processing stage. Each random number is a pure function
+ * of the stream, of the element it is drawn for (a point, a cluster, a sample...) and of the draw index
+ * for that element: there is no hidden state, so that parallel tasks produce the same numbers
+ * whatever the thread running them and the order of execution.
+ *
+ * Numbers are obtained by hashing the counters with the SplitMix64 finalizer.
+ */
+class RandomStream {
+
+public:
+
+  /** Processing stages drawing random numbers, each with its own stream. */
+  enum Stage {
+    kDataSplit = 1,        ///< Training/evaluation split of input points.
+    kBootstrap = 2,        ///< Random samples of training clusters.
+    kKmeansSeeding = 3,    ///< Choice of the initial k-means centroids.
+    kMvaSplit = 4,         ///< Training/test split of the MVA inputs.
+    kDensitySampling = 5,  ///< Stratified sample of pre-clusters for density estimation.
+    kBoosting = 6,         ///< Bagging weights of the native BDT training.
+    kCoreset = 7,          ///< Coreset sample of the k-means inputs.
+    kFeatureSampling = 8   ///< Order of the points sampled for the layer features.
+  };
+
+  /** Full constructor. */
+  RandomStream(unsigned long long seed, unsigned int stage);
+
+  /** Destructor. */
+  ~RandomStream();
+
+  /** Returns a 64-bit random integer. */
+  inline unsigned long long bits(unsigned long long element, unsigned long long draw) const;
+
+  /** Returns a random number uniformly distributed in [0, 1). */
+  inline double uniform(unsigned long long element, unsigned long long draw) const;
+
+  /** Returns consecutive random numbers uniformly distributed in [0, 1) for an element. */
+  void uniform(unsigned long long element, unsigned long long firstDraw, unsigned int n, double *out) const;
+
+private:
+
+  /** Returns the key of an element. */
+  inline unsigned long long elementKey(unsigned long long element) const;
+
+  /** SplitMix64 finalizer. */
+  static inline unsigned long long mix(unsigned long long z);
+
+  /** Converts the 53 most significant bits of an integer to [0, 1). */
+  static inline double toUniform(unsigned long long z);
+
+private:
+
+  static const unsigned long long kGolden = 0x9e3779b97f4a7c15ULL;
+
+  unsigned long long m_key;
+};
+
+
+/**
+ * @param element Element index.
+ * @param draw Draw index for that element.
+ * @return Random integer.
+ */
+inline unsigned long long RandomStream::bits(unsigned long long element, unsigned long long draw) const
+{
+  return mix(elementKey(element) + (draw+1)*kGolden);
+}
+
+/**
+ * @param element Element index.
+ * @param draw Draw index for that element.
+ * @return Random number.
+ */
+inline double RandomStream::uniform(unsigned long long element, unsigned long long draw) const
+{
+  return toUniform(bits(element, draw));
+}
+
+/**
+ * @param element Element index.
+ * @return Key from which the draws of the element are counted.
+ */
+inline unsigned long long RandomStream::elementKey(unsigned long long element) const
+{
+  return mix(m_key ^ mix(element + kGolden));
+}
+
+/**
+ * @param z Input integer.
+ * @return Mixed integer.
+ */
+inline unsigned long long RandomStream::mix(unsigned long long z)
+{
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+/**
+ * @param z Input integer.
+ * @return Number in [0, 1).
+ */
+inline double RandomStream::toUniform(unsigned long long z)
+{
+  return (z >> 11) * (1.0 / 9007199254740992.0);
+}
+
+#endif
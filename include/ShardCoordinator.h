@@ -0,0 +1,71 @@
+#ifndef SHARD_COORDINATOR_H
+#define SHARD_COORDINATOR_H
+
+#include <vector>
+
+#include "ClusteringAlg.h"
+#include "DataSet.h"
+#include "TileGrid.h"
+#include "optparse.h"
+
+/**
+ * @brief Runs the tiled clustering chain in worker processes, one per field shard.
+ *
+ * The field is cut into x/z tiles which are grouped into contiguous shards of balanced point counts.
+ * Each shard is handled by a forked worker process which inherits the data set from the coordinator
+ * and talks to it through a local stream socket:
+ * - The worker sends the seed candidates found in its tiles.
+ * - The coordinator selects the seeds over all shards and sends them back to every worker.
+ * - The worker sends the (point index, seed index) pairs of the points owned by its tiles.
+ *
+ * Messages are flat arrays of fixed-width records, so a worker on another host would only need
+ * the input data and a TCP socket in place of the local one.
+ */
+class ShardCoordinator {
+
+public:
+
+  /** Full constructor. */
+  ShardCoordinator(int nShards);
+
+  /** Destructor. */
+  ~ShardCoordinator();
+
+  /** Clusters a data set with one worker process per shard. */
+  void runClustering(ClusteringAlg &alg, DataSet &ds, const Config &config);
+
+  /** Returns the number of shards.
+   * @return Number of shards.
+   */
+  inline int nShards() const { return m_nShards; }
+
+private:
+
+  /** Groups tiles into contiguous shards of balanced point counts. */
+  void makeShards(const TileGrid &grid);
+
+  /** Runs the worker side of the protocol for one shard. */
+  bool runWorker(int iShard, int fd, ClusteringAlg &alg, DataSet &ds,
+		 const TileGrid &grid, const Config &config);
+
+  /** Writes a block of records to a socket. */
+  static bool writeRecords(int fd, const std::vector<float> &records);
+  static bool writeRecords(int fd, const std::vector<unsigned int> &records);
+
+  /** Reads a block of records from a socket. */
+  static bool readRecords(int fd, std::vector<float> &records);
+  static bool readRecords(int fd, std::vector<unsigned int> &records);
+
+  /** Writes a buffer to a socket. */
+  static bool writeAll(int fd, const void *buffer, size_t size);
+
+  /** Reads a buffer from a socket. */
+  static bool readAll(int fd, void *buffer, size_t size);
+
+private:
+
+  int m_nShards;
+  std::vector<int> m_firstTile;
+};
+
+#endif
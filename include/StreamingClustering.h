@@ -0,0 +1,85 @@
+#ifndef STREAMING_CLUSTERING_H
+#define STREAMING_CLUSTERING_H
+
+#include <unordered_map>
+#include <vector>
+
+#include "DataSet.h"
+#include "optparse.h"
+
+/**
+ * @brief Clustering engine fed with packets of points as they arrive.
+ *
+ * Points are accumulated into square cells of the size of the pre-clusters.
+ * The density of a cell is the total weight of the cells within the density window around it,
+ * and cells which are local density maxima are kept as seed candidates.
+ * Both are updated with each packet, so that only the seed selection, the assignment of the points
+ * and the outlier removal are left once the end of the frame is reached.
+ */
+class StreamingClustering {
+
+public:
+
+  /** Full constructor. */
+  StreamingClustering(const Config &config);
+
+  /** Destructor. */
+  ~StreamingClustering();
+
+  /** Adds a packet of points. */
+  void addPoints(const std::vector<CloudPoint> &points, unsigned int begin, unsigned int end);
+
+  /** Selects seeds among candidates and fills the clusters of the data set. */
+  void finish(DataSet &ds);
+
+  /** Returns the number of packets added.
+   * @return Number of packets.
+   */
+  inline unsigned int nPackets() const { return m_nPackets; }
+
+  /** Returns the number of occupied cells.
+   * @return Number of cells.
+   */
+  inline unsigned int nCells() const { return m_cells.size(); }
+
+  /** Returns the number of seed candidates.
+   * @return Number of candidates.
+   */
+  inline unsigned int nCandidates() const { return m_nCandidates; }
+
+private:
+
+  /** Accumulated points and density of a cell. */
+  struct Cell {
+    double weight;
+    double sumX;
+    double sumY;
+    double sumZ;
+    double density;
+    bool isCandidate;
+  };
+
+  /** Returns the key of the cell containing a position. */
+  long long cellKey(float x, float z) const;
+
+  /** Returns the key of a cell from its indices. */
+  static long long cellKey(int ix, int iz);
+
+  /** Adds weight to a cell and updates the densities around it. */
+  void addWeight(long long key, const Cell &delta);
+
+  /** Checks whether a cell is a local density maximum. */
+  bool isLocalMax(long long key, const Cell &cell) const;
+
+private:
+
+  Config m_config;
+  float m_cellSize;
+  int m_window;
+
+  std::unordered_map<long long, Cell> m_cells;
+  unsigned int m_nCandidates;
+  unsigned int m_nPackets;
+};
+
+#endif
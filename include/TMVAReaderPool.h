@@ -0,0 +1,70 @@
+#ifndef TMVA_READER_POOL_H
+#define TMVA_READER_POOL_H
+
+#include <string>
+#include <vector>
+
+#include "FeatureMatrix.h"
+
+namespace TMVA {
+  class Reader;
+}
+
+/**
+ * @brief Pool of TMVA readers for the parallel evaluation of the BDT.
+ *
+ * A TMVA::Reader evaluates the variables bound to it with AddVariable(), so that a single reader
+ * can only evaluate one row at a time. The pool books one reader per worker thread, each bound to its own
+ * variable buffer, once when constructed. A batch of rows is split into contiguous chunks,
+ * one per reader, which are evaluated concurrently.
+ *
+ * The readers are booked sequentially, since booking is not thread safe. With several readers,
+ * the thread safety of ROOT is enabled before booking.
+ * The pool is meant to be kept for as long as the weights file does not change.
+ */
+class TMVAReaderPool {
+
+public:
+
+  /** Full constructor. */
+  TMVAReaderPool(const std::string &xmlFile, int nLayers, int nReaders);
+
+  /** Destructor. */
+  ~TMVAReaderPool();
+
+  /** Evaluates the class probabilities of all rows of a feature matrix. */
+  void evaluate(const FeatureMatrix &features, std::vector<float> &outputs);
+
+  /** Returns the weights file.
+   * @return Name of the TMVA weights file.
+   */
+  inline const std::string &xmlFile() const { return m_xmlFile; }
+
+  /** Returns the number of readers.
+   * @return Number of readers, i.e. of worker threads.
+   */
+  inline int nReaders() const { return m_readers.size(); }
+
+  /** Returns the class names.
+   * @return Class names, ordered by class index.
+   */
+  inline const std::vector<std::string> &classNames() const { return m_classNames; }
+
+private:
+
+  /** Copy is not supported. */
+  TMVAReaderPool(const TMVAReaderPool &);
+
+  /** Assignment is not supported. */
+  TMVAReaderPool &operator=(const TMVAReaderPool &);
+
+private:
+
+  std::string m_xmlFile;
+  int m_nLayers;
+  std::vector<TMVA::Reader*> m_readers;
+  std::vector< std::vector<float> > m_vars;
+  std::vector<std::string> m_classNames;
+};
+
+#endif
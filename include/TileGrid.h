@@ -0,0 +1,97 @@
+#ifndef TILE_GRID_H
+#define TILE_GRID_H
+
+#include <vector>
+
+#include "CloudPoint.h"
+
+/**
+ * @brief Partition of the horizontal (x,z) plane into square tiles.
+ *
+ * Each point belongs to the core of exactly one tile.
+ * A tile can be extended by a halo so that algorithms running on a single tile
+ * see the neighborhood of the points at its borders.
+ */
+class TileGrid {
+
+public:
+
+  /** Full constructor. */
+  TileGrid(const std::vector<CloudPoint> &points, float tileSize, float halo);
+
+  /** Destructor. */
+  ~TileGrid();
+
+  /** Returns the number of tiles. 
+   * @return Number of tiles.
+   */
+  inline int nTiles() const { return m_nx*m_nz; }
+
+  /** Returns the halo width.
+   * @return Halo width.
+   */
+  inline float halo() const { return m_halo; }
+
+  /** Returns the index of the tile whose core contains a position. */
+  int tileIndex(float x, float z) const;
+
+  /** Checks whether a position is inside the core of a tile.
+   * @param iTile Tile index.
+   * @param x x position.
+   * @param z z position.
+   * @return @c true if the position is in the tile core.
+   */
+  inline bool inCore(int iTile, float x, float z) const { return tileIndex(x, z) == iTile; }
+
+  /** Returns the indices of the points inside a tile extended by its halo. */
+  void tilePoints(int iTile, std::vector<unsigned int> &indices) const;
+
+  /** Returns the number of points in the core of a tile.
+   * @param iTile Tile index.
+   * @return Number of points.
+   */
+  inline unsigned int nCorePoints(int iTile) const { return m_offsets[iTile+1] - m_offsets[iTile]; }
+
+  /** Returns the number of tiles along x.
+   * @return Number of tiles.
+   */
+  inline int nx() const { return m_nx; }
+
+  /** Returns the number of tiles along z.
+   * @return Number of tiles.
+   */
+  inline int nz() const { return m_nz; }
+
+  /** Returns the position of the first core point of a tile in the tile ordering.
+   * @param iTile Tile index.
+   * @return Position to pass to corePoint().
+   */
+  inline unsigned int coreBegin(int iTile) const { return m_offsets[iTile]; }
+
+  /** Returns the position past the last core point of a tile in the tile ordering.
+   * @param iTile Tile index.
+   * @return Position to pass to corePoint().
+   */
+  inline unsigned int coreEnd(int iTile) const { return m_offsets[iTile+1]; }
+
+  /** Returns the index of a point from its position in the tile ordering.
+   * @param k Position in the tile ordering.
+   * @return Point index.
+   */
+  inline unsigned int corePoint(unsigned int k) const { return m_indices[k]; }
+
+private:
+
+  const std::vector<CloudPoint> &m_points;
+  float m_tileSize;
+  float m_halo;
+  float m_xmin;
+  float m_zmin;
+  int m_nx;
+  int m_nz;
+
+  std::vector<unsigned int> m_offsets;
+  std::vector<unsigned int> m_indices;
+};
+
+#endif
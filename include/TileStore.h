@@ -0,0 +1,74 @@
+#ifndef TILE_STORE_H
+#define TILE_STORE_H
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "CloudPoint.h"
+
+/**
+ * @brief Points of a frame spilled to disk, one temporary file per x/z tile.
+ *
+ * Points are added packet by packet while the input is read. Each point is written to the file of
+ * the tile whose core contains it and to the files of the neighboring tiles whose halo reaches it,
+ * so that a tile and its halo are loaded without reading the rest of the frame. \n
+ * Tiles are aligned on the origin of the (x,z) plane, so that points can be spilled before
+ * the extent of the frame is known. Writes are buffered for all tiles together, so that the memory
+ * held by the store is bounded by the buffer size whatever the number of points. \n
+ * The files are removed when the store is destroyed.
+ */
+class TileStore {
+
+public:
+
+  /** Full constructor. */
+  TileStore(float tileSize, float halo);
+
+  /** Destructor. */
+  ~TileStore();
+
+  /** Adds points to the tiles. */
+  void addPoints(const std::vector<CloudPoint> &points, unsigned int begin, unsigned int end);
+
+  /** Writes the buffered points to the tile files. */
+  void flush();
+
+  /** Reads the points of a tile and its halo. */
+  void loadTile(int iTile, std::vector<CloudPoint> &points) const;
+
+  /** Checks whether a position is inside the core of a tile. */
+  bool inCore(int iTile, float x, float z) const;
+
+  /** Returns the number of tiles holding points.
+   * @return Number of tiles.
+   */
+  inline int nTiles() const { return m_keys.size(); }
+
+  /** Returns the number of points added.
+   * @return Number of points.
+   */
+  inline unsigned long long nPoints() const { return m_nPoints; }
+
+private:
+
+  /** Returns the key of a tile from its indices. */
+  static long long tileKey(int ix, int iz);
+
+  /** Returns the index of a tile, creating it if needed. */
+  int tileIndex(int ix, int iz);
+
+private:
+
+  float m_tileSize;
+  float m_halo;
+  std::string m_dir;
+
+  std::vector<long long> m_keys;
+  std::unordered_map<long long, int> m_tiles;
+  std::vector< std::vector<float> > m_buffers;
+  unsigned int m_nBuffered;
+  unsigned long long m_nPoints;
+};
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef UNION_FIND_H
+#define UNION_FIND_H
+
+#include <atomic>
+#include <vector>
+
+/**
+ * @brief Disjoint sets of indices which can be merged concurrently from several threads.
+ *
+ * Roots are linked with compare-and-swap operations and paths are compressed by halving,
+ * so that no lock is needed.
+ * A root is always linked below a root of lower index: once all merges are done,
+ * the representative of each set is its smallest index whatever the order of the merges.
+ */
+class UnionFind {
+
+public:
+
+  /** Full constructor. */
+  UnionFind(unsigned int n);
+
+  /** Destructor. */
+  ~UnionFind();
+
+  /** Returns the representative of the set containing an index. */
+  unsigned int find(unsigned int i);
+
+  /** Merges the sets containing two indices. */
+  void unite(unsigned int i, unsigned int j);
+
+  /** Returns the number of indices.
+   * @return Number of indices.
+   */
+  inline unsigned int size() const { return m_parents.size(); }
+
+private:
+
+  std::vector<std::atomic<unsigned int> > m_parents;
+};
+
+#endif
@@ -0,0 +1,549 @@
+#include "BDTModel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Parallel.h"
+
+const std::string BDTModel::kBaseName = "outputs/weights/TMVAMulticlass_BDT";
+
+BDTModel::BDTModel() :
+  m_map(0),
+  m_mapSize(0),
+  m_header(0),
+  m_roots(0),
+  m_nodes(0)
+{
+}
+
+BDTModel::~BDTModel()
+{
+  unload();
+}
+
+/**
+ * Only the features written by TMVA for BDTs without input transformations nor Fisher cuts are supported.
+ * Leaves hold the node response for regression trees, as used by gradient boosting,
+ * and the node purity otherwise, following TMVA::DecisionTree::CheckEvent().
+ *
+ * @param xmlFile TMVA weights file.
+ * @param binaryFile Output binary file.
+ */
+void BDTModel::convert(const std::string &xmlFile, const std::string &binaryFile)
+{
+
+  std::ifstream ifile(xmlFile.c_str(), std::ios::in);
+  if(!ifile) {
+    throw std::runtime_error("ERROR: could not open BDT weights file " + xmlFile);
+  }
+  std::stringstream buffer;
+  buffer << ifile.rdbuf();
+  const std::string text = buffer.str();
+
+
+  //
+  // Parse trees
+  //
+  unsigned int nVariables = 0;
+  std::vector<std::string> classNames;
+  std::vector<int> roots;
+  std::vector<Node> nodes;
+  std::vector<int> cutTypes;
+  std::vector<int> stack;
+  int analysisType = -1;
+
+  size_t pos = 0;
+  std::string name;
+  std::map<std::string, std::string> attributes;
+  bool isEnd = false;
+  bool isEmpty = false;
+  while(nextTag(text, pos, name, attributes, isEnd, isEmpty)) {
+
+    if(name == "MethodSetup" && !isEnd) {
+      if(attribute(attributes, "Method") != "BDT::BDT") {
+	throw std::runtime_error("ERROR: " + xmlFile + " does not describe a BDT");
+      }
+    }
+    else if(name == "Variables" && !isEnd) {
+      nVariables = atoi(attribute(attributes, "NVar").c_str());
+    }
+    else if(name == "Class" && !isEnd) {
+      unsigned int index = atoi(attribute(attributes, "Index").c_str());
+      if(index >= classNames.size()) classNames.resize(index+1);
+      classNames[index] = attribute(attributes, "Name");
+    }
+    else if(name == "Transformations" && !isEnd) {
+      if(atoi(attribute(attributes, "NTransformations").c_str()) != 0) {
+	throw std::runtime_error("ERROR: input transformations are not supported in " + xmlFile);
+      }
+    }
+    else if(name == "Weights" && !isEnd) {
+      // Older TMVA versions write the tree type in a dedicated attribute
+      if(attributes.count("TreeType")) {
+	analysisType = atoi(attributes["TreeType"].c_str());
+      }else{
+	analysisType = atoi(attribute(attributes, "AnalysisType").c_str());
+      }
+    }
+    else if(name == "BinaryTree" && !isEnd) {
+      roots.push_back(nodes.size());
+      stack.clear();
+    }
+    else if(name == "Node" && !isEnd) {
+      if(atoi(attribute(attributes, "NCoef").c_str()) != 0) {
+	throw std::runtime_error("ERROR: Fisher cuts are not supported in " + xmlFile);
+      }
+      if(roots.empty()) {
+	throw std::runtime_error("ERROR: node found outside of a tree in " + xmlFile);
+      }
+
+      Node node;
+      node.left = -1;
+      node.right = -1;
+      if(atoi(attribute(attributes, "nType").c_str()) == 0) {
+	node.feature = atoi(attribute(attributes, "IVar").c_str());
+	node.value = atof(attribute(attributes, "Cut").c_str());
+      }else{
+	node.feature = -1;
+	node.value = atof(attribute(attributes, analysisType == 1 ? "res" : "purity").c_str());
+      }
+      int iNode = nodes.size();
+      nodes.push_back(node);
+      cutTypes.push_back(atoi(attribute(attributes, "cType").c_str()));
+
+      // Resolve the cut direction: with cType=0, the "right" child of TMVA is taken below the cut
+      if(!stack.empty()) {
+	Node &parent = nodes[stack.back()];
+	bool isRight = attribute(attributes, "pos") == "r";
+	if(isRight == (cutTypes[stack.back()] == 1)) parent.right = iNode;
+	else parent.left = iNode;
+      }
+      if(!isEmpty) {
+	stack.push_back(iNode);
+      }
+    }
+    else if(name == "Node" && isEnd) {
+      stack.pop_back();
+    }
+  }
+
+  if(analysisType < 0 || roots.empty()) {
+    throw std::runtime_error("ERROR: no trees found in " + xmlFile);
+  }
+  for(unsigned int i=0; i<nodes.size(); i++) {
+    const Node &node = nodes[i];
+    if(node.feature >= (int)nVariables ||
+       (node.feature >= 0 && (node.left < 0 || node.right < 0))) {
+      throw std::runtime_error("ERROR: malformed tree in " + xmlFile);
+    }
+  }
+  if(classNames.empty()) {
+    throw std::runtime_error("ERROR: no classes found in " + xmlFile);
+  }
+
+  write(binaryFile, nVariables, classNames, roots, nodes);
+}
+
+/**
+ * @param binaryFile Output binary file.
+ * @param nVariables Number of input features.
+ * @param classNames Class names, ordered by class index.
+ * @param roots Index of the root node of each tree, tree @c t contributing to class <tt>t%nClasses</tt>.
+ * @param nodes Nodes of all trees.
+ */
+void BDTModel::write(const std::string &binaryFile, unsigned int nVariables,
+		     const std::vector<std::string> &classNames,
+		     const std::vector<int> &roots, const std::vector<Node> &nodes)
+{
+  Header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, "PCBDT\0\0\0", 8);
+  header.version = 1;
+
+  std::string names;
+  for(unsigned int i=0; i<classNames.size(); i++) {
+    names += classNames[i];
+    names += '\0';
+  }
+  header.nVariables = nVariables;
+  header.nClasses = classNames.size();
+  header.nTrees = roots.size();
+  header.nNodes = nodes.size();
+  header.namesSize = names.size();
+
+  // Create the parent directories, as TMVA does for its weights files
+  for(size_t pos=binaryFile.find('/', 1); pos!=std::string::npos; pos=binaryFile.find('/', pos+1)) {
+    mkdir(binaryFile.substr(0, pos).c_str(), 0755);
+  }
+
+  std::ofstream ofile(binaryFile.c_str(), std::ios::out | std::ios::binary);
+  if(!ofile) {
+    throw std::runtime_error("ERROR: could not write BDT model " + binaryFile);
+  }
+  ofile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  ofile.write(reinterpret_cast<const char*>(&roots[0]), roots.size()*sizeof(int));
+  ofile.write(reinterpret_cast<const char*>(&nodes[0]), nodes.size()*sizeof(Node));
+  ofile.write(names.data(), names.size());
+  if(!ofile) {
+    throw std::runtime_error("ERROR: could not write BDT model " + binaryFile);
+  }
+}
+
+/**
+ * @param xmlFile TMVA weights file.
+ * @param binaryFile Binary model file.
+ * @return @c true if the binary file can be used as is.
+ */
+bool BDTModel::isUpToDate(const std::string &xmlFile, const std::string &binaryFile)
+{
+  struct stat xmlStat;
+  struct stat binaryStat;
+  if(stat(binaryFile.c_str(), &binaryStat) != 0) return false;
+  if(stat(xmlFile.c_str(), &xmlStat) != 0) return true;
+  return binaryStat.st_mtime >= xmlStat.st_mtime;
+}
+
+/**
+ * Uses the 64-bit FNV-1a hash.
+ *
+ * @param fileName File name.
+ * @return Hash of the file content, 0 if the file cannot be read.
+ */
+unsigned long long BDTModel::fileHash(const std::string &fileName)
+{
+  std::ifstream ifile(fileName.c_str(), std::ios::in | std::ios::binary);
+  if(!ifile) return 0;
+
+  unsigned long long hash = 0xcbf29ce484222325ULL;
+  char buffer[4096];
+  while(ifile.read(buffer, sizeof(buffer)) || ifile.gcount() > 0) {
+    for(std::streamsize i=0; i<ifile.gcount(); i++) {
+      hash ^= (unsigned char)buffer[i];
+      hash *= 0x100000001b3ULL;
+    }
+  }
+  return hash;
+}
+
+/**
+ * The file is mapped read-only in memory: nothing is parsed nor copied apart from the class names.
+ *
+ * @param binaryFile Binary model file, as written by convert().
+ */
+void BDTModel::load(const std::string &binaryFile)
+{
+  unload();
+
+  int fd = open(binaryFile.c_str(), O_RDONLY);
+  if(fd < 0) {
+    throw std::runtime_error("ERROR: could not open BDT model " + binaryFile);
+  }
+  struct stat st;
+  if(fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(Header)) {
+    close(fd);
+    throw std::runtime_error("ERROR: invalid BDT model " + binaryFile);
+  }
+  m_mapSize = st.st_size;
+  m_map = mmap(0, m_mapSize, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(m_map == MAP_FAILED) {
+    m_map = 0;
+    throw std::runtime_error("ERROR: could not map BDT model " + binaryFile);
+  }
+
+  const char *data = static_cast<const char*>(m_map);
+  m_header = reinterpret_cast<const Header*>(data);
+  size_t rootsOffset = sizeof(Header);
+  size_t nodesOffset = rootsOffset + (size_t)m_header->nTrees*sizeof(int);
+  size_t namesOffset = nodesOffset + (size_t)m_header->nNodes*sizeof(Node);
+  if(memcmp(m_header->magic, "PCBDT\0\0\0", 8) != 0 || m_header->version != 1 ||
+     namesOffset + m_header->namesSize != m_mapSize ||
+     m_header->namesSize == 0 || data[m_mapSize-1] != '\0') {
+    unload();
+    throw std::runtime_error("ERROR: invalid BDT model " + binaryFile);
+  }
+  m_roots = reinterpret_cast<const int*>(data + rootsOffset);
+  m_nodes = reinterpret_cast<const Node*>(data + nodesOffset);
+
+  const char *names = data + namesOffset;
+  for(unsigned int i=0; i<m_header->namesSize; i += strlen(names+i)+1) {
+    m_classNames.push_back(names+i);
+  }
+  if(m_classNames.size() != m_header->nClasses) {
+    unload();
+    throw std::runtime_error("ERROR: invalid BDT model " + binaryFile);
+  }
+}
+
+/**
+ * @param row Input features.
+ * @param outputs Output probabilities, one per class.
+ */
+void BDTModel::evaluate(const float *row, float *outputs) const
+{
+  evaluateBlock(row, 1, outputs);
+}
+
+/**
+ * Rows are processed in blocks: all trees are applied to a block before moving to the next one,
+ * so that the nodes of a tree stay in cache while they are used. Blocks run in parallel.
+ *
+ * @param features Input float features, with one column per model variable.
+ * @param outputs Output probabilities, row-major with one row of nClasses() values per input.
+ * @param nThreads Number of threads.
+ */
+void BDTModel::evaluate(const FeatureMatrix &features, std::vector<float> &outputs, int nThreads) const
+{
+  if(features.nColumns() != nVariables()) {
+    throw std::runtime_error("ERROR: BDT model expects a different number of features");
+  }
+  if(features.storage() != FeatureMatrix::kFloat) {
+    throw std::runtime_error("ERROR: BDT model expects float features");
+  }
+
+  const unsigned int blockSize = 64;
+  unsigned int nRows = features.nRows();
+  unsigned int nBlocks = (nRows + blockSize - 1)/blockSize;
+  outputs.resize((size_t)nRows*nClasses());
+
+  parallelFor(nBlocks, nThreads, [&](unsigned int iBlock) {
+      unsigned int begin = iBlock*blockSize;
+      unsigned int n = std::min(blockSize, nRows - begin);
+      evaluateBlock(features.row(begin), n, &outputs[(size_t)begin*nClasses()]);
+    });
+}
+
+/**
+ * Responses are summed in double precision and in tree order, as in TMVA.
+ * The sums of a full block fit on the stack for usual class counts, so that single rows do not allocate.
+ *
+ * @param rows Input rows, contiguous.
+ * @param nRows Number of rows.
+ * @param outputs Output probabilities.
+ */
+void BDTModel::evaluateBlock(const float *rows, unsigned int nRows, float *outputs) const
+{
+  unsigned int nVars = nVariables();
+  unsigned int nCl = nClasses();
+  double stackSums[256];
+  std::vector<double> heapSums;
+  double *sums = stackSums;
+  if(nRows*nCl > 256) {
+    heapSums.resize(nRows*nCl);
+    sums = &heapSums[0];
+  }
+  std::fill(sums, sums + nRows*nCl, 0.);
+
+  for(unsigned int t=0; t<nTrees(); t++) {
+    unsigned int iClass = t % nCl;
+    for(unsigned int i=0; i<nRows; i++) {
+      sums[i*nCl+iClass] += treeResponse(t, rows + i*nVars);
+    }
+  }
+
+  for(unsigned int i=0; i<nRows; i++) {
+    normalize(&sums[i*nCl], outputs + i*nCl);
+  }
+}
+
+/**
+ * @param sums Summed tree responses, one per class.
+ * @param outputs Output probabilities.
+ */
+void BDTModel::normalize(const double *sums, float *outputs) const
+{
+  for(unsigned int j=0; j<nClasses(); j++) {
+    double norm = 0;
+    for(unsigned int k=0; k<nClasses(); k++) {
+      if(k != j) norm += exp(sums[k]-sums[j]);
+    }
+    outputs[j] = 1.0/(1.0+norm);
+  }
+}
+
+/**
+ * Each tree becomes a nested conditional expression with the cuts and responses as literals,
+ * which the compiler can turn into conditional moves instead of node lookups.
+ * Responses are summed in the same order and precision as evaluate(), so that both give the same outputs.
+ * The plugin exports the functions used by CompiledBDT, including the hash of the binary model it was
+ * generated from.
+ *
+ * @param sourceFile Output C++ file.
+ * @param modelHash Hash of the binary model file, see fileHash().
+ */
+void BDTModel::writeSource(const std::string &sourceFile, unsigned long long modelHash) const
+{
+  std::ofstream ofile(sourceFile.c_str(), std::ios::out);
+  if(!ofile) {
+    throw std::runtime_error("ERROR: could not write BDT source " + sourceFile);
+  }
+  ofile << std::scientific << std::setprecision(8);
+
+  ofile << "// BDT plugin generated by generateBDT.exe, do not edit.\n"
+	<< "#include <cmath>\n"
+	<< "\n"
+	<< "namespace {\n"
+	<< "\n"
+	<< "const unsigned int nVariables = " << nVariables() << ";\n"
+	<< "const unsigned int nClasses = " << nClasses() << ";\n"
+	<< "const char *classNames[nClasses] = {";
+  for(unsigned int i=0; i<nClasses(); i++) {
+    ofile << (i ? ", " : "") << "\"" << m_classNames[i] << "\"";
+  }
+  ofile << "};\n"
+	<< "\n"
+	<< "inline void addTrees(const float *x, double *t)\n"
+	<< "{\n";
+  for(unsigned int t=0; t<nTrees(); t++) {
+    ofile << "  t[" << t % nClasses() << "] += ";
+    writeNode(ofile, m_roots[t]);
+    ofile << ";\n";
+  }
+  ofile << "}\n"
+	<< "\n"
+	<< "}\n"
+	<< "\n"
+	<< "extern \"C\" {\n"
+	<< "\n"
+	<< "unsigned int bdtPluginVersion() { return 1; }\n"
+	<< "unsigned long long bdtModelHash() { return 0x" << std::hex << modelHash << std::dec << "ULL; }\n"
+	<< "unsigned int bdtNVariables() { return nVariables; }\n"
+	<< "unsigned int bdtNClasses() { return nClasses; }\n"
+	<< "const char *bdtClassName(unsigned int i) { return classNames[i]; }\n"
+	<< "\n"
+	<< "void bdtEvaluate(const float *rows, unsigned int nRows, float *outputs)\n"
+	<< "{\n"
+	<< "  for(unsigned int i=0; i<nRows; i++) {\n"
+	<< "    double t[nClasses] = {0};\n"
+	<< "    addTrees(rows + i*nVariables, t);\n"
+	<< "    for(unsigned int j=0; j<nClasses; j++) {\n"
+	<< "      double norm = 0;\n"
+	<< "      for(unsigned int k=0; k<nClasses; k++) {\n"
+	<< "        if(k != j) norm += exp(t[k]-t[j]);\n"
+	<< "      }\n"
+	<< "      outputs[i*nClasses+j] = 1.0/(1.0+norm);\n"
+	<< "    }\n"
+	<< "  }\n"
+	<< "}\n"
+	<< "\n"
+	<< "}\n";
+
+  if(!ofile) {
+    throw std::runtime_error("ERROR: could not write BDT source " + sourceFile);
+  }
+}
+
+/**
+ * @param os Output stream.
+ * @param iNode Index of the root node of the sub-tree.
+ */
+void BDTModel::writeNode(std::ostream &os, int iNode) const
+{
+  const Node &node = m_nodes[iNode];
+  if(node.feature < 0) {
+    os << node.value << "f";
+    return;
+  }
+  os << "(x[" << node.feature << "] >= " << node.value << "f ? ";
+  writeNode(os, node.right);
+  os << " : ";
+  writeNode(os, node.left);
+  os << ")";
+}
+
+/**
+ * Declarations, comments and text content are skipped.
+ *
+ * @param text XML document.
+ * @param pos Current position, updated.
+ * @param name Output tag name.
+ * @param attributes Output tag attributes.
+ * @param isEnd Output flag for closing tags.
+ * @param isEmpty Output flag for self-closing tags.
+ * @return @c false at the end of the document.
+ */
+bool BDTModel::nextTag(const std::string &text, size_t &pos, std::string &name,
+		       std::map<std::string, std::string> &attributes, bool &isEnd, bool &isEmpty)
+{
+  while(true) {
+    pos = text.find('<', pos);
+    if(pos == std::string::npos) return false;
+    if(text.compare(pos, 4, "<!--") == 0) {
+      pos = text.find("-->", pos);
+      if(pos == std::string::npos) return false;
+      continue;
+    }
+    if(text[pos+1] == '?' || text[pos+1] == '!') {
+      pos = text.find('>', pos);
+      if(pos == std::string::npos) return false;
+      continue;
+    }
+    break;
+  }
+
+  size_t end = text.find('>', pos);
+  if(end == std::string::npos) return false;
+  std::string tag = text.substr(pos+1, end-pos-1);
+  pos = end+1;
+
+  isEnd = !tag.empty() && tag[0] == '/';
+  isEmpty = !tag.empty() && tag[tag.size()-1] == '/';
+  if(isEnd) tag.erase(0, 1);
+  if(isEmpty) tag.erase(tag.size()-1);
+
+  size_t i = tag.find_first_of(" \t\r\n");
+  name = tag.substr(0, i);
+  attributes.clear();
+  while(i != std::string::npos && i < tag.size()) {
+    size_t eq = tag.find('=', i);
+    if(eq == std::string::npos) break;
+    size_t keyBegin = tag.find_first_not_of(" \t\r\n", i);
+    size_t keyEnd = tag.find_last_not_of(" \t\r\n", eq-1);
+    size_t valueBegin = tag.find('"', eq);
+    size_t valueEnd = tag.find('"', valueBegin+1);
+    if(valueBegin == std::string::npos || valueEnd == std::string::npos) break;
+    attributes[tag.substr(keyBegin, keyEnd-keyBegin+1)] = tag.substr(valueBegin+1, valueEnd-valueBegin-1);
+    i = valueEnd+1;
+  }
+
+  return true;
+}
+
+/**
+ * @param attributes Tag attributes.
+ * @param name Attribute name.
+ * @return Attribute value.
+ */
+const std::string &BDTModel::attribute(const std::map<std::string, std::string> &attributes,
+				       const std::string &name)
+{
+  std::map<std::string, std::string>::const_iterator it = attributes.find(name);
+  if(it == attributes.end()) {
+    throw std::runtime_error("ERROR: missing attribute " + name + " in BDT weights file");
+  }
+  return it->second;
+}
+
+void BDTModel::unload()
+{
+  if(m_map) {
+    munmap(m_map, m_mapSize);
+  }
+  m_map = 0;
+  m_mapSize = 0;
+  m_header = 0;
+  m_roots = 0;
+  m_nodes = 0;
+  m_classNames.clear();
+}
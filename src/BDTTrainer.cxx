@@ -0,0 +1,327 @@
+#include "BDTTrainer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include "Parallel.h"
+#include "RandomStream.h"
+
+/**
+ * @param config Configuration.
+ */
+BDTTrainer::BDTTrainer(const Config &config) :
+  m_minNodeFraction(0.05),
+  m_nVariables(0),
+  m_nClasses(0),
+  m_nRows(0)
+{
+  m_nIterations = config.get("bdtTrees");
+  m_shrinkage = config.get("bdtShrinkage");
+  m_baggedFraction = config.get("bdtBaggedFraction");
+  m_maxDepth = config.get("bdtMaxDepth");
+  m_seed = config.get("randomSeed");
+  m_nThreads = threadCount(config);
+
+  if(m_maxDepth < 1 || m_maxDepth > 8) {
+    throw std::runtime_error("ERROR: BDT depth must be between 1 and 8");
+  }
+}
+
+BDTTrainer::~BDTTrainer()
+{
+}
+
+/**
+ * Nodes smaller than 5% of the training weight are not split, as with the default MinNodeSize of TMVA.
+ *
+ * @param features Input features.
+ * @param labels Class index of each row of features.
+ * @param rows Rows of features used for training.
+ * @param nClasses Number of classes.
+ */
+void BDTTrainer::train(const FeatureMatrix &features, const std::vector<int> &labels,
+		       const std::vector<unsigned int> &rows, unsigned int nClasses)
+{
+
+  m_nVariables = features.nColumns();
+  m_nClasses = nClasses;
+  m_nRows = rows.size();
+  m_roots.clear();
+  m_nodes.clear();
+  if(m_nRows == 0) {
+    throw std::runtime_error("ERROR: no training data for the BDT");
+  }
+
+  unsigned int n = m_nRows;
+  unsigned int nVars = m_nVariables;
+  unsigned int nCl = m_nClasses;
+
+
+  //
+  // Bin features, one column per variable
+  //
+  std::vector<unsigned char> bins((size_t)nVars*n);
+  parallelFor(n, m_nThreads, [&](unsigned int i) {
+      if(features.storage() == FeatureMatrix::kUInt8) {
+	const unsigned char *row = features.quantizedRow(rows[i]);
+	for(unsigned int v=0; v<nVars; v++) {
+	  bins[(size_t)v*n+i] = row[v];
+	}
+	return;
+      }
+      const float *row = features.row(rows[i]);
+      for(unsigned int v=0; v<nVars; v++) {
+	float x = row[v];
+	bins[(size_t)v*n+i] = x <= 0 ? 0 : (x >= 255 ? 255 : (unsigned char)x);
+      }
+    });
+
+
+  //
+  // Boosting iterations
+  //
+  std::vector<double> scores((size_t)n*nCl, 0.);
+  std::vector<double> residuals((size_t)n*nCl);
+  std::vector<unsigned char> weights(n, 1);
+  const RandomStream rng(m_seed, RandomStream::kBoosting);
+  double lambda = m_baggedFraction;
+
+  for(int iIteration=0; iIteration<m_nIterations; iIteration++) {
+
+    parallelFor(n, m_nThreads, [&](unsigned int i) {
+
+	// Class probabilities and residuals
+	const double *f = &scores[(size_t)i*nCl];
+	for(unsigned int k=0; k<nCl; k++) {
+	  double norm = 0;
+	  for(unsigned int j=0; j<nCl; j++) {
+	    if(j != k) norm += exp(f[j]-f[k]);
+	  }
+	  double y = labels[rows[i]] == (int)k ? 1 : 0;
+	  residuals[(size_t)i*nCl+k] = y - 1.0/(1.0+norm);
+	}
+
+	// Poisson bagging weight, drawn by inversion
+	if(lambda > 0) {
+	  double u = rng.uniform(iIteration, i);
+	  double p = exp(-lambda);
+	  double cdf = p;
+	  int w = 0;
+	  while(u > cdf && w < 255) {
+	    w++;
+	    p *= lambda/w;
+	    cdf += p;
+	  }
+	  weights[i] = w;
+	}
+      });
+
+    growTrees(bins, residuals, weights);
+
+    unsigned int firstTree = m_roots.size() - nCl;
+    parallelFor(n, m_nThreads, [&](unsigned int i) {
+	for(unsigned int k=0; k<nCl; k++) {
+	  scores[(size_t)i*nCl+k] += treeResponse(firstTree+k, bins, i);
+	}
+      });
+  }
+}
+
+/**
+ * Nodes are identified by their heap index: the root is 1 and the children of node @c h are
+ * @c 2h (below the cut) and @c 2h+1 (above or at the cut).
+ *
+ * @param bins Binned features, one column of nRows values per variable.
+ * @param residuals Residuals, nClasses values per row.
+ * @param weights Event weights, 0 for events out of the bag.
+ */
+void BDTTrainer::growTrees(const std::vector<unsigned char> &bins, const std::vector<double> &residuals,
+			   const std::vector<unsigned char> &weights)
+{
+
+  const int nBins = 256;
+  unsigned int n = m_nRows;
+  unsigned int nVars = m_nVariables;
+  unsigned int nCl = m_nClasses;
+  int nHeap = 1 << (m_maxDepth+1);
+
+  double totalWeight = 0;
+  for(unsigned int i=0; i<n; i++) {
+    totalWeight += weights[i];
+  }
+  double minWeight = std::max(1., m_minNodeFraction*totalWeight);
+
+  // Node of each row in the tree of each class, 0 for rows out of the bag
+  std::vector<int> nodes((size_t)nCl*n);
+  for(unsigned int k=0; k<nCl; k++) {
+    for(unsigned int i=0; i<n; i++) {
+      nodes[(size_t)k*n+i] = weights[i] ? 1 : 0;
+    }
+  }
+  std::vector<int> splitFeatures(nCl*nHeap, -1);
+  std::vector<int> splitCuts(nCl*nHeap, 0);
+
+
+  //
+  // Grow trees level by level
+  //
+  for(int depth=0; depth<m_maxDepth; depth++) {
+    int first = 1 << depth;
+    int nLevel = first;
+
+    // Histograms of the weights and weighted residuals, per class, node, variable and bin
+    size_t histSize = (size_t)nCl*nLevel*nVars*nBins;
+    std::vector<double> histW(histSize, 0.);
+    std::vector<double> histR(histSize, 0.);
+    parallelFor(nCl*nVars, m_nThreads, [&](unsigned int task) {
+	unsigned int k = task / nVars;
+	unsigned int v = task % nVars;
+	const unsigned char *column = &bins[(size_t)v*n];
+	const int *node = &nodes[(size_t)k*n];
+	for(unsigned int i=0; i<n; i++) {
+	  int j = node[i] - first;
+	  if(j < 0 || j >= nLevel) continue;
+	  size_t h = (((size_t)k*nLevel + j)*nVars + v)*nBins + column[i];
+	  histW[h] += weights[i];
+	  histR[h] += weights[i]*residuals[(size_t)i*nCl+k];
+	}
+      });
+
+    // Best split of each node, maximizing the decrease of the residual variance
+    parallelFor(nCl*nLevel, m_nThreads, [&](unsigned int task) {
+	unsigned int k = task / nLevel;
+	int j = task % nLevel;
+	const double *nodeW = &histW[((size_t)k*nLevel + j)*nVars*nBins];
+	const double *nodeR = &histR[((size_t)k*nLevel + j)*nVars*nBins];
+
+	double w = 0;
+	double r = 0;
+	for(int b=0; b<nBins; b++) {
+	  w += nodeW[b];
+	  r += nodeR[b];
+	}
+	if(w < 2*minWeight) return;
+
+	double bestGain = 0;
+	for(unsigned int v=0; v<nVars; v++) {
+	  double wl = 0;
+	  double rl = 0;
+	  for(int c=1; c<nBins; c++) {
+	    wl += nodeW[v*nBins+c-1];
+	    rl += nodeR[v*nBins+c-1];
+	    double wr = w - wl;
+	    double rr = r - rl;
+	    if(wl < minWeight) continue;
+	    if(wr < minWeight) break;
+	    double gain = rl*rl/wl + rr*rr/wr - r*r/w;
+	    if(gain > bestGain) {
+	      bestGain = gain;
+	      splitFeatures[k*nHeap + first+j] = v;
+	      splitCuts[k*nHeap + first+j] = c;
+	    }
+	  }
+	}
+      });
+
+    // Move rows to the children
+    parallelFor(n, m_nThreads, [&](unsigned int i) {
+	for(unsigned int k=0; k<nCl; k++) {
+	  int &h = nodes[(size_t)k*n+i];
+	  if(h < first) continue;
+	  int v = splitFeatures[k*nHeap + h];
+	  if(v < 0) continue;
+	  h = 2*h + (bins[(size_t)v*n+i] >= splitCuts[k*nHeap + h] ? 1 : 0);
+	}
+      });
+  }
+
+
+  //
+  // Leaf responses
+  //
+  std::vector<float> responses(nCl*nHeap, 0);
+  parallelFor(nCl, m_nThreads, [&](unsigned int k) {
+      std::vector<double> sumR(nHeap, 0.);
+      std::vector<double> sumD(nHeap, 0.);
+      for(unsigned int i=0; i<n; i++) {
+	int h = nodes[(size_t)k*n+i];
+	if(h == 0) continue;
+	double r = residuals[(size_t)i*nCl+k];
+	sumR[h] += weights[i]*r;
+	sumD[h] += weights[i]*fabs(r)*(1-fabs(r));
+      }
+      for(int h=1; h<nHeap; h++) {
+	if(sumD[h] > 1e-10) {
+	  responses[k*nHeap+h] = m_shrinkage*(nCl-1.0)/nCl*sumR[h]/sumD[h];
+	}
+      }
+    });
+
+  for(unsigned int k=0; k<nCl; k++) {
+    m_roots.push_back(addNode(k, 1, splitFeatures, splitCuts, responses));
+  }
+}
+
+/**
+ * @param iClass Class of the tree.
+ * @param iHeap Heap index of the root of the sub-tree.
+ * @param splitFeatures Split variable of each node, -1 for leaves.
+ * @param splitCuts Split bin of each node.
+ * @param responses Response of each leaf.
+ * @return Index of the root of the sub-tree in the list of nodes.
+ */
+int BDTTrainer::addNode(unsigned int iClass, int iHeap, const std::vector<int> &splitFeatures,
+			const std::vector<int> &splitCuts, const std::vector<float> &responses)
+{
+  int nHeap = 1 << (m_maxDepth+1);
+  int iNode = m_nodes.size();
+
+  BDTModel::Node node;
+  node.feature = splitFeatures[iClass*nHeap + iHeap];
+  node.left = -1;
+  node.right = -1;
+  if(node.feature >= 0) {
+    node.value = splitCuts[iClass*nHeap + iHeap];
+    m_nodes.push_back(node);
+    int left = addNode(iClass, 2*iHeap, splitFeatures, splitCuts, responses);
+    int right = addNode(iClass, 2*iHeap+1, splitFeatures, splitCuts, responses);
+    m_nodes[iNode].left = left;
+    m_nodes[iNode].right = right;
+  }else{
+    node.value = responses[iClass*nHeap + iHeap];
+    m_nodes.push_back(node);
+  }
+
+  return iNode;
+}
+
+/**
+ * The cuts are bin indices, so that the binned features reach the same leaves as the original ones.
+ *
+ * @param iTree Tree index.
+ * @param bins Binned features, one column of nRows values per variable.
+ * @param i Row index.
+ * @return Response of the leaf reached by the row.
+ */
+float BDTTrainer::treeResponse(unsigned int iTree, const std::vector<unsigned char> &bins, unsigned int i) const
+{
+  const BDTModel::Node *node = &m_nodes[m_roots[iTree]];
+  while(node->feature >= 0) {
+    unsigned char bin = bins[(size_t)node->feature*m_nRows+i];
+    node = &m_nodes[bin >= node->value ? node->right : node->left];
+  }
+  return node->value;
+}
+
+/**
+ * @param binaryFile Output binary file.
+ * @param classNames Class names, ordered by class index.
+ */
+void BDTTrainer::write(const std::string &binaryFile, const std::vector<std::string> &classNames) const
+{
+  if(classNames.size() != m_nClasses) {
+    throw std::runtime_error("ERROR: wrong number of class names for the BDT");
+  }
+  BDTModel::write(binaryFile, m_nVariables, classNames, m_roots, m_nodes);
+}
@@ -6,17 +6,32 @@
 #include "TMVA/Reader.h"
 
 #include "TFile.h"
-#include "TPrincipal.h"
 #include "TStopwatch.h"
 
-#include <set>
-
-ClassificationAlg::ClassificationAlg()
+#include "BDTModel.h"
+#include "BDTTrainer.h"
+#include "ColorModel.h"
+#include "CompiledBDT.h"
+#include "FeatureMatrix.h"
+#include "KMeans.h"
+#include "PCA.h"
+#include "Parallel.h"
+#include "RandomStream.h"
+#include "TMVAReaderPool.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+ClassificationAlg::ClassificationAlg() :
+  m_nFrames(0),
+  m_readerPool(0)
 {
 }
 
 ClassificationAlg::~ClassificationAlg()
 {
+  delete m_readerPool;
 }
 
 
@@ -53,11 +68,127 @@ void ClassificationAlg::classifyClusters(DataSet &trainingDS, DataSet &evaluatio
  * Training data is used to compute the PCA transformation. \n
  * For classification, performs a k-means clustering to the PCA space reduced to the leading 3 components.
  *
+ * With @c \-\-pcaModelFile, the trained model is saved, and later runs only apply it to the clusters
+ * of their frame, unless @c \-\-runMVATraining requests retraining.
+ *
  * @param trainingDS Data set to be used for training.
  * @param evaluationDS Data set to be classified.
  * @param config Configuration.
  */
 void ClassificationAlg::runPCA(DataSet &trainingDS, DataSet &evaluationDS, const Config &config)
+{
+
+  if(loadColorModel(config)) {
+    TStopwatch sw;
+    bool verbose = config.get("verbose");
+    if(verbose) {
+      sw.Start();
+    }
+
+    FeatureMatrix features(config.get("nLayersPerCluster"));
+    applyColorModel(allClusters(trainingDS), features, config);
+    applyColorModel(allClusters(evaluationDS), features, config);
+
+    if(verbose) {
+      sw.Stop();
+      std::cout << std::endl
+		<< "Classification with the saved PCA/Kmeans model done."
+		<< std::endl;
+      sw.Print("m");
+    }
+  }else{
+    trainColorModel(trainingDS, evaluationDS, config);
+    std::string modelFile = config.get("pcaModelFile");
+    if(modelFile != "None") {
+      m_colorModel.write(modelFile);
+    }
+  }
+}
+
+/**
+ * Classifies the clusters of the next frame of a sequence with the unsupervised classification. \n
+ * The first frame uses the model of @c \-\-pcaModelFile if available, and otherwise trains it on its own
+ * clusters. The model is then adapted to each following frame, with the forgetting factor
+ * @c \-\-pcaForgetting. Every @c \-\-checkpointInterval frames, the model is saved to
+ * @c \-\-pcaModelFile.
+ *
+ * @param ds Data set of the frame, with all its clusters.
+ * @param config Configuration.
+ */
+void ClassificationAlg::classifyFrame(DataSet &ds, const Config &config)
+{
+  std::vector<unsigned int> selection(ds.clusters().size());
+  for(unsigned int i=0; i<selection.size(); i++) {
+    selection[i] = i;
+  }
+  classifyFrame(ds, selection, config);
+}
+
+/**
+ * Same as classifyFrame(DataSet&, const Config&) for a selection of the clusters of the frame,
+ * the other ones keeping their class. The model is only adapted to the selected clusters.
+ * A first frame without saved model is trained on all its clusters.
+ *
+ * @param ds Data set of the frame, with all its clusters.
+ * @param selection Indices of the clusters to be classified.
+ * @param config Configuration.
+ */
+void ClassificationAlg::classifyFrame(DataSet &ds, const std::vector<unsigned int> &selection,
+				      const Config &config)
+{
+
+  int nLayers = config.get("nLayersPerCluster");
+  float forgetting = config.get("pcaForgetting");
+  int checkpointInterval = config.get("checkpointInterval");
+  std::string modelFile = config.get("pcaModelFile");
+
+  if(m_nFrames == 0 && !loadColorModel(config)) {
+    DataSet noEvaluation;
+    trainColorModel(ds, noEvaluation, config);
+  }else{
+    std::vector<Cluster*> clusters;
+    for(unsigned int i=0; i<selection.size(); i++) {
+      clusters.push_back(&ds.clusters()[selection[i]]);
+    }
+    FeatureMatrix features(nLayers);
+    applyColorModel(clusters, features, config);
+    m_colorModel.update(features, forgetting, threadCount(config), reductionBlockSize(config));
+  }
+  m_nFrames++;
+
+  if(modelFile != "None" && checkpointInterval > 0 && m_nFrames%checkpointInterval == 0) {
+    m_colorModel.write(modelFile);
+  }
+}
+
+/**
+ * @param config Configuration.
+ * @return Whether a model was read from @c \-\-pcaModelFile.
+ */
+bool ClassificationAlg::loadColorModel(const Config &config)
+{
+  std::string modelFile = config.get("pcaModelFile");
+  bool retrain = config.get("runMVATraining");
+  if(modelFile == "None" || retrain) return false;
+
+  std::ifstream ifile(modelFile.c_str(), std::ios::in | std::ios::binary);
+  if(!ifile.good()) return false;
+  ifile.close();
+
+  m_colorModel.read(modelFile);
+  m_classNames = m_colorModel.classNames();
+  return true;
+}
+
+/**
+ * The k-means clustering runs on the training clusters, their bootstrap samples and the evaluation clusters
+ * together. The smallest k-means cluster is labeled as referees.
+ *
+ * @param trainingDS Data set to be used for training.
+ * @param evaluationDS Data set to be classified.
+ * @param config Configuration.
+ */
+void ClassificationAlg::trainColorModel(DataSet &trainingDS, DataSet &evaluationDS, const Config &config)
 {
 
   TStopwatch sw;
@@ -65,11 +196,19 @@ void ClassificationAlg::runPCA(DataSet &trainingDS, DataSet &evaluationDS, const
   if(verbose) {
     sw.Start();
   }
+
+  std::vector<Cluster> &trainingClusters = trainingDS.clusters();
+  std::vector<Cluster> &evaluationClusters = evaluationDS.clusters();
+  int nLayers = config.get("nLayersPerCluster");
+  int nSplit = config.get("trainingClustersSplitN");
+  int nThreads = threadCount(config);
   
   //
   // Train a Principal Component Analysis
   //
-  trainPCA(trainingDS, config);
+  FeatureMatrix bootstrap(nLayers, FeatureMatrix::storageFromName(config.get("featureStorage")));
+  bootstrapFeatures(trainingDS, config, bootstrap);
+  trainPCA(bootstrap, config);
 
   if(verbose) {
     sw.Stop();
@@ -83,25 +222,51 @@ void ClassificationAlg::runPCA(DataSet &trainingDS, DataSet &evaluationDS, const
 
   //
   // Apply PCA to all data
-  // and reduce phase space to the 3 leading components
+  // and reduce phase space to the 3 leading components.
+  // Each training cluster is followed by its bootstrap samples.
   //
-  std::vector<Cluster> &trainingClusters = trainingDS.clusters();
-  std::vector<Cluster> &evaluationClusters = evaluationDS.clusters();
-  std::vector<Cluster*> kmeansInputs;
-  int nSplit = config.get("trainingClustersSplitN");
-  float splitFrac = config.get("trainingClustersSplitF");
+  std::vector<const Cluster*> trainingCores;
+  for(unsigned int i=0; i<trainingClusters.size(); i++) {
+    trainingCores.push_back(&trainingClusters[i].core());
+  }
+  std::vector<const Cluster*> evaluationCores;
+  for(unsigned int i=0; i<evaluationClusters.size(); i++) {
+    evaluationCores.push_back(&evaluationClusters[i].core());
+  }
+  FeatureMatrix trainingFeatures(nLayers);
+  trainingFeatures.setSampling(config);
+  trainingFeatures.fill(trainingCores, nThreads);
+  FeatureMatrix evaluationFeatures(nLayers);
+  evaluationFeatures.setSampling(config);
+  evaluationFeatures.fill(evaluationCores, nThreads);
+
+  std::vector<Point> trainingColors;
+  std::vector<Point> bootstrapColors;
+  std::vector<Point> evaluationColors;
+  m_colorModel.project(trainingFeatures, trainingColors, nThreads);
+  m_colorModel.project(bootstrap, bootstrapColors, nThreads);
+  m_colorModel.project(evaluationFeatures, evaluationColors, nThreads);
+
+  std::vector<Point> kmeansInputs;
+  std::vector<std::pair<const FeatureMatrix*, unsigned int> > kmeansRows;
+  std::vector<int> trainingIndices;
+  std::vector<int> evaluationIndices;
   for(unsigned int i=0; i<trainingClusters.size(); i++) {
-    Cluster &bigCl = trainingClusters[i];
-    std::vector<Cluster> &splitClusters = bigCl.core().randomSplit(nSplit, splitFrac);
-    kmeansInputs.push_back(&bigCl.core());
-    for(unsigned int j=0; j<splitClusters.size(); j++) {
-      kmeansInputs.push_back(&splitClusters[j]);
+    trainingClusters[i].core().setPcaColor(trainingColors[i]);
+    trainingIndices.push_back(kmeansInputs.size());
+    kmeansInputs.push_back(trainingColors[i]);
+    kmeansRows.push_back(std::make_pair(&trainingFeatures, i));
+    for(int j=0; j<nSplit; j++) {
+      kmeansInputs.push_back(bootstrapColors[i*nSplit+j]);
+      kmeansRows.push_back(std::make_pair(&bootstrap, i*nSplit+j));
     }
   }
   for(unsigned int i=0; i<evaluationClusters.size(); i++) {
-    kmeansInputs.push_back(&evaluationClusters[i].core());
+    evaluationClusters[i].core().setPcaColor(evaluationColors[i]);
+    evaluationIndices.push_back(kmeansInputs.size());
+    kmeansInputs.push_back(evaluationColors[i]);
+    kmeansRows.push_back(std::make_pair(&evaluationFeatures, i));
   }
-  applyPCA(kmeansInputs, config);
   
   if(verbose) {
     sw.Stop();
@@ -117,8 +282,8 @@ void ClassificationAlg::runPCA(DataSet &trainingDS, DataSet &evaluationDS, const
   // Run k-meam clustering on PCA data
   //
   const int kmeans = 3;
-  std::vector<std::vector<Cluster*> > pcaClusters(kmeans);
-  int nIterations = runKmeansOnPCA(kmeans, kmeansInputs, pcaClusters, config);
+  std::vector<int> assignments;
+  int nIterations = runKmeansOnPCA(kmeans, kmeansInputs, assignments, config);
   
   if(verbose) {
     sw.Stop();
@@ -136,34 +301,59 @@ void ClassificationAlg::runPCA(DataSet &trainingDS, DataSet &evaluationDS, const
   m_classNames.push_back("TeamA");
   m_classNames.push_back("TeamB");
   m_classNames.push_back("Referees");  
+  std::vector<unsigned int> kmeansSizes(kmeans, 0);
+  for(unsigned int i=0; i<assignments.size(); i++) {
+    kmeansSizes[assignments[i]]++;
+  }
   int iReferees = -1;
   unsigned int minSize = 999;
-  for(unsigned int i=0; i<pcaClusters.size(); i++) {
-    if(pcaClusters[i].size() < minSize) {
-      minSize = pcaClusters[i].size();
+  for(int i=0; i<kmeans; i++) {
+    if(kmeansSizes[i] < minSize) {
+      minSize = kmeansSizes[i];
       iReferees = i;
     }
   }
     
+  std::vector<int> classIds(kmeans);
   int classId = 0;
-  for(unsigned int i=0; i<pcaClusters.size(); i++) {
-    int thisClassId = classId;
-    if((int)i==iReferees) {
-      thisClassId = pcaClusters.size()-1;
+  for(int i=0; i<kmeans; i++) {
+    if(i==iReferees) {
+      classIds[i] = kmeans-1;
     }else{
-      thisClassId = classId;
+      classIds[i] = classId;
       classId++;
     }
-    for(unsigned int j=0; j<pcaClusters[i].size(); j++) {
-      pcaClusters[i][j]->setClassId(thisClassId);
+  }
+
+  // Centroids in the feature space, for the model updates, weighted as one frame of clusters
+  unsigned int nVariables = bootstrap.nColumns();
+  std::vector<double> centroidFeatures(kmeans*nVariables, 0.);
+  std::vector<double> centroidWeights(kmeans);
+  float buffer[3*FeatureMatrix::kMaxLayers];
+  for(unsigned int i=0; i<assignments.size(); i++) {
+    double *centroid = &centroidFeatures[assignments[i]*nVariables];
+    const float *row = kmeansRows[i].first->row(kmeansRows[i].second, buffer);
+    for(unsigned int v=0; v<nVariables; v++) {
+      centroid[v] += row[v];
+    }
+  }
+  double clusterWeight = (double)(trainingClusters.size()+evaluationClusters.size())/kmeansInputs.size();
+  for(int i=0; i<kmeans; i++) {
+    centroidWeights[i] = kmeansSizes[i]*clusterWeight;
+    for(unsigned int v=0; v<nVariables && kmeansSizes[i]>0; v++) {
+      centroidFeatures[i*nVariables+v] /= kmeansSizes[i];
     }
   }
+  m_colorModel.setCentroids(centroidFeatures, centroidWeights, classIds, m_classNames);
+
   for(unsigned int i=0; i<trainingClusters.size(); i++) {
     Cluster &cl = trainingClusters[i];
+    cl.core().setClassId(classIds[assignments[trainingIndices[i]]]);
     cl.setClassId(cl.core().classId());
   }
   for(unsigned int i=0; i<evaluationClusters.size(); i++) {
     Cluster &cl = evaluationClusters[i];
+    cl.core().setClassId(classIds[assignments[evaluationIndices[i]]]);
     cl.setClassId(cl.core().classId());
   }
   
@@ -181,151 +371,108 @@ void ClassificationAlg::runPCA(DataSet &trainingDS, DataSet &evaluationDS, const
 
 
 /**
- * Computes the PCA transformation parameters based on the training data.
+ * Labels clusters with the closest centroid of the current model.
  *
- * @param ds Input data set.
+ * @param clusters Clusters to be classified.
+ * @param features Output features of the cluster cores.
  * @param config Configuration.
  */
-void ClassificationAlg::trainPCA(DataSet &ds, const Config &config)
+void ClassificationAlg::applyColorModel(const std::vector<Cluster*> &clusters, FeatureMatrix &features,
+					const Config &config)
 {
-  
-  std::vector<Cluster> &trainingClusters = ds.clusters();
 
-  
-  //
-  // Prepare PCA
-  //
-  int nLayers = config.get("nLayersPerCluster");
-  
-  int pcaDataSize = 3*nLayers;
-  m_pca = new TPrincipal(pcaDataSize, "ND");
-  double *pcaDataRow = new double[pcaDataSize];
+  int nThreads = threadCount(config);
+  std::vector<const Cluster*> cores;
+  for(unsigned int i=0; i<clusters.size(); i++) {
+    cores.push_back(&clusters[i]->core());
+  }
+  features.setSampling(config);
+  features.fill(cores, nThreads);
 
-  //
-  // Load training data
-  // 
-  int nSplit = config.get("trainingClustersSplitN");
-  float splitFrac = config.get("trainingClustersSplitF");
-  for(unsigned int i=0; i<trainingClusters.size(); i++) {
-    const Cluster &bigCl = trainingClusters[i];
-    const std::vector<Cluster> &splitClusters = bigCl.core().randomSplit(nSplit, splitFrac);
-    for(unsigned int j=0; j<splitClusters.size(); j++) {
-      const Cluster &pl = splitClusters[j];
-      const std::vector<CloudPoint> &layers = pl.layers(nLayers);
-      for(unsigned int k=0; k<layers.size(); k++) {
-	const CloudPoint &p = layers[k];
-	pcaDataRow[3*k+0] = p.r();
-	pcaDataRow[3*k+1] = p.g();
-        pcaDataRow[3*k+2] = p.b();
-      }
-      m_pca->AddRow(pcaDataRow);
-    }
+  std::vector<Point> colors;
+  std::vector<int> classIds;
+  m_colorModel.classify(features, colors, classIds, nThreads);
+  for(unsigned int i=0; i<clusters.size(); i++) {
+    Cluster &cl = *clusters[i];
+    cl.core().setPcaColor(colors[i]);
+    cl.core().setClassId(classIds[i]);
+    cl.setClassId(classIds[i]);
   }
+}
 
 
-  //
-  // Run PCA
-  //
-  m_pca->MakePrincipals();
 
-  delete [] pcaDataRow;
+/**
+ * @param ds Data set.
+ * @return Pointers to all clusters of the data set.
+ */
+std::vector<Cluster*> ClassificationAlg::allClusters(DataSet &ds)
+{
+  std::vector<Cluster*> clusters;
+  for(unsigned int i=0; i<ds.clusters().size(); i++) {
+    clusters.push_back(&ds.clusters()[i]);
+  }
+  return clusters;
 }
 
 
+
 /**
- * @param clusters Input clusters.
+ * Bootstrap samples of the training cluster cores are drawn with @c trainingClustersSplitN samples
+ * per cluster, each point being kept with probability @c trainingClustersSplitF.
+ * Sample @c j of cluster @c i is stored in row <tt>i*trainingClustersSplitN+j</tt>.
+ *
+ * @param ds Training data set.
  * @param config Configuration.
+ * @param features Output features.
  */
-void ClassificationAlg::applyPCA(std::vector<Cluster*> &clusters, const Config &config)
+void ClassificationAlg::bootstrapFeatures(DataSet &ds, const Config &config, FeatureMatrix &features)
 {
 
-  int nLayers = config.get("nLayersPerCluster");
-  int pcaDataSize = 3*nLayers;
-  double *pcaInDataRow = new double[pcaDataSize];
-  double *pcaOutDataRow = new double[pcaDataSize];
-
-  for(unsigned int i=0; i<clusters.size(); i++) {
-    Cluster &cl = *clusters[i];
-    const std::vector<CloudPoint> &layers = cl.layers(nLayers);
-
-    for(unsigned int k=0; k<layers.size(); k++) {
-      const CloudPoint &p = layers[k];
-      pcaInDataRow[3*k+0] = p.r();
-      pcaInDataRow[3*k+1] = p.g();
-      pcaInDataRow[3*k+2] = p.b();
-    }
+  std::vector<Cluster> &trainingClusters = ds.clusters();
+  int nSplit = config.get("trainingClustersSplitN");
+  float splitFrac = config.get("trainingClustersSplitF");
+  int seed = config.get("randomSeed");
 
-    m_pca->X2P(pcaInDataRow, pcaOutDataRow);
-    Point pcaColor(pcaOutDataRow[0], pcaOutDataRow[1], pcaOutDataRow[2]);
-    cl.setPcaColor(pcaColor);
+  std::vector<const Cluster*> cores;
+  for(unsigned int i=0; i<trainingClusters.size(); i++) {
+    cores.push_back(&trainingClusters[i].core());
   }
-  delete [] pcaInDataRow;
-  delete [] pcaOutDataRow;
+  features.fillBootstrap(cores, nSplit, splitFrac, seed, threadCount(config));
 }
 
+
 /**
- * @param kmeans Number of output clusters.
- * @param clusters Input clusters.
- * @param pcaClusters Output clusters.
+ * Computes the PCA transformation parameters based on the training data.
+ *
+ * @param features Features of the training samples.
  * @param config Configuration.
  */
-int ClassificationAlg::runKmeansOnPCA(int kmeans, std::vector<Cluster*> &clusters,
-			       std::vector<std::vector<Cluster*> > &pcaClusters,
-			       const Config &config)
+void ClassificationAlg::trainPCA(const FeatureMatrix &features, const Config &config)
 {
+  // Each training cluster weighs as one row in the later model updates
+  int nSplit = config.get("trainingClustersSplitN");
+  PCA::Accumulator moments = PCA::accumulate(features, threadCount(config), reductionBlockSize(config));
+  moments.decay(1./nSplit);
+  m_colorModel.train(moments);
+}
 
-  std::vector<Point> seeds;
-  std::set<int> used;
-  for(int i=0; i<kmeans; i++) {
-    int iCl = rand()%clusters.size();
-    while(used.find(iCl) != used.end()) {
-      iCl = rand()%clusters.size();
-    }
-    used.insert(iCl);
-    seeds.push_back(clusters[iCl]->pcaColor());
-  }
-
-  bool converged = false;
-  int nIterations = 0;
-  int nIterationsMax = config.get("maxKmeansIterations");
-  while(!converged && nIterations < nIterationsMax) {
-
-    // Assignment step
-    for(unsigned int i=0; i<pcaClusters.size(); i++) {
-      pcaClusters[i].clear();
-    }
-    for(unsigned int i=0; i<clusters.size(); i++) {
-      int jj = -1;
-      float minDist = 99999.;
-      for(unsigned int j=0; j<seeds.size(); j++) {
-	float dist = clusters[i]->pcaColor().dist3DSq(seeds[j]);
-	if(dist < minDist) {
-	  minDist = dist;
-	  jj = j;
-	}
-      }
-      pcaClusters[jj].push_back(clusters[i]);
-    }
-
-    // Update step
-    converged = true;
-    for(unsigned int i=0; i<pcaClusters.size(); i++) {
-      Point oldSeed = seeds[i];
-      Point newSeed;
-      for(unsigned int j=0; j<pcaClusters[i].size(); j++) {
-	newSeed.setX(newSeed.x() + pcaClusters[i][j]->pcaColor().x());
-	newSeed.setY(newSeed.y() + pcaClusters[i][j]->pcaColor().y());
-	newSeed.setZ(newSeed.z() + pcaClusters[i][j]->pcaColor().z());
-      }
-      newSeed.setX(newSeed.x()/pcaClusters[i].size());
-      newSeed.setY(newSeed.y()/pcaClusters[i].size());
-      newSeed.setZ(newSeed.z()/pcaClusters[i].size());
-      seeds[i] = newSeed;
-      if(newSeed.dist3DSq(oldSeed) > 0.001) converged = false;
-    }
-    nIterations++;
-  }
 
+/**
+ * See KMeans for the seeding, pruning, restarts and coreset options.
+ *
+ * @param kmeans Number of output clusters.
+ * @param colors Input positions in the PCA space.
+ * @param assignments Output index of the k-means cluster of each input.
+ * @param config Configuration.
+ * @return Number of iterations.
+ */
+int ClassificationAlg::runKmeansOnPCA(int kmeans, const std::vector<Point> &colors,
+				      std::vector<int> &assignments, const Config &config)
+{
+  KMeans km(config);
+  int nIterations = km.fit(kmeans, colors);
+  km.assign(colors, assignments);
   return nIterations;
 }
 
@@ -371,45 +518,52 @@ void ClassificationAlg::runMVA(DataSet &trainingDS, DataSet &evaluationDS, const
 
   
   //
-  // Initialize MVA
+  // Compute features
   //
-  TMVA::Tools::Instance();
-  
-  TMVA::Reader *reader = new TMVA::Reader( "!Color:Silent" );
-
-  std::vector<float> vars(3*nLayers);
-  for(int k=0; k<nLayers; k++) {
-    TString suffix = TString::Format("%d", k);
-    reader->AddVariable( "r"+suffix, &vars[3*k+0] );
-    reader->AddVariable( "g"+suffix, &vars[3*k+1] );
-    reader->AddVariable( "b"+suffix, &vars[3*k+2] );
+  std::vector<const Cluster*> cores;
+  for(unsigned int i=0; i<clusters.size(); i++) {
+    cores.push_back(&clusters[i].core());
   }
-  
-  reader->BookMVA( "BDT", "outputs/weights/TMVAMulticlass_BDT.weights.xml" );
+  FeatureMatrix features(nLayers);
+  features.setSampling(config);
+  features.fill(cores, threadCount(config));
 
 
   //
   // Classify clusters
   //
-  m_classNames.clear();
-  for(unsigned int i=0; i<reader->DataInfo().GetNClasses(); i++) {
-    m_classNames.push_back(reader->DataInfo().GetClassInfo(i)->GetName());
+  const std::string xmlFile = BDTModel::kBaseName + ".weights.xml";
+  std::string engine = config.get("mvaEngine");
+  std::vector<float> outputs;
+  if(engine == "native") {
+    const std::string binaryFile = BDTModel::kBaseName + ".bin";
+    if(!BDTModel::isUpToDate(xmlFile, binaryFile)) {
+      BDTModel::convert(xmlFile, binaryFile);
+    }
+    CompiledBDT compiled;
+    if(compiled.load(BDTModel::kBaseName + ".so", BDTModel::fileHash(binaryFile))) {
+      m_classNames = compiled.classNames();
+      compiled.evaluate(features, outputs, threadCount(config));
+    }else{
+      BDTModel model;
+      model.load(binaryFile);
+      m_classNames = model.classNames();
+      model.evaluate(features, outputs, threadCount(config));
+    }
+  }
+  else if(engine == "tmva") {
+    evaluateTMVA(xmlFile, features, outputs, threadCount(config));
+  }
+  else {
+    throw std::runtime_error("ERROR: unknown MVA engine " + engine);
   }
+
+  unsigned int nClasses = m_classNames.size();
   for(unsigned int i=0; i<clusters.size(); i++) {
-    const Cluster &pl = clusters[i].core();
-    const std::vector<CloudPoint> &layers = pl.layers(nLayers);
-
-    for(unsigned int k=0; k<layers.size(); k++) {
-      const CloudPoint &p = layers[k];
-      vars[3*k+0] = p.r();
-      vars[3*k+1] = p.g();
-      vars[3*k+2] = p.b();
-    }
-    
-    const std::vector< float > &res = reader->EvaluateMulticlass("BDT");
+    const float *res = &outputs[i*nClasses];
     
     int classId = -1;
-    for(unsigned int ic=0; ic<res.size(); ic++) {
+    for(unsigned int ic=0; ic<nClasses; ic++) {
       if(classId == -1 || res[ic] > res[classId]) {
 	classId = ic;
       }
@@ -425,12 +579,40 @@ void ClassificationAlg::runMVA(DataSet &trainingDS, DataSet &evaluationDS, const
     sw.Print("m");
     sw.Start();
   }
-  
-  delete reader;
+}
+
+/**
+ * Reference implementation of the BDT inference with TMVA readers, evaluating the rows in parallel
+ * with one reader per thread. The readers are booked at the first call and kept for the following ones,
+ * unless the weights file or the number of threads changed.
+ * The class names are updated from the weights file.
+ *
+ * @param xmlFile TMVA weights file.
+ * @param features Input features.
+ * @param outputs Output probabilities, row-major with one row per input and one column per class.
+ * @param nThreads Number of threads.
+ */
+void ClassificationAlg::evaluateTMVA(const std::string &xmlFile, const FeatureMatrix &features,
+				     std::vector<float> &outputs, int nThreads)
+{
+  if(m_readerPool && (m_readerPool->xmlFile() != xmlFile || m_readerPool->nReaders() != nThreads)) {
+    delete m_readerPool;
+    m_readerPool = 0;
+  }
+  if(!m_readerPool) {
+    m_readerPool = new TMVAReaderPool(xmlFile, features.nLayers(), nThreads);
+  }
+
+  m_classNames = m_readerPool->classNames();
+  m_readerPool->evaluate(features, outputs);
 }
 
   
 /**
+ * Labels the training clusters with the truth information, computes the features of bootstrap samples
+ * of the clusters and splits them randomly in equal training and test samples.
+ * The BDT is then trained with TMVA or natively with BDTTrainer, depending on @c \-\-mvaTrainer.
+ *
  * @param ds Data set to be classified.
  * @param config Configuration.
  */
@@ -438,28 +620,62 @@ void ClassificationAlg::trainMVA(DataSet &ds, const Config &config)
 {
 
   std::vector<Cluster> &trainingClusters = ds.clusters();
-  
   int nLayers = config.get("nLayersPerCluster");
+  labelTrainingClusters(ds, config);
+
+  // The weights file is rewritten, the readers booked from it are stale
+  delete m_readerPool;
+  m_readerPool = 0;
+
 
-  
   //
-  // Initialize MVA
+  // Compute features and split training and test samples
   //
-  TMVA::Tools::Instance();
-  
-  std::string outfileName = config.get("tmvaOutputFile"); 
-  TFile* outputFile=0;
-  TMVA::Factory *factory=0;
+  int nSplit = config.get("trainingClustersSplitN");
+  int seed = config.get("randomSeed");
+  const RandomStream rng(seed, RandomStream::kMvaSplit);
+  FeatureMatrix features(nLayers, FeatureMatrix::storageFromName(config.get("featureStorage")));
+  bootstrapFeatures(ds, config, features);
+
+  std::vector<int> labels(features.nRows());
+  std::vector<unsigned int> trainRows;
+  std::vector<unsigned int> testRows;
+  for(unsigned int i=0; i<features.nRows(); i++) {
+    labels[i] = trainingClusters[i/nSplit].classId();
+    if(rng.uniform(i, 0) < 0.5) {
+      trainRows.push_back(i);
+    }else{
+      testRows.push_back(i);
+    }
+  }
 
-  TString factoryOptions = "!V:Silent:!DrawProgressBar:!Color:Transformations=I:AnalysisType=Auto";
-  if(outfileName != "None") {
-    outputFile = TFile::Open( outfileName.c_str(), "RECREATE" );
-    factory = new TMVA::Factory( "TMVAMulticlass", outputFile, factoryOptions );
-  }else{
-    factory = new TMVA::Factory( "TMVAMulticlass", factoryOptions );
+
+  //
+  // Perform training
+  //
+  std::string trainer = config.get("mvaTrainer");
+  if(trainer == "native") {
+    trainNative(features, labels, trainRows, testRows, config);
   }
+  else if(trainer == "tmva") {
+    trainTMVA(features, labels, trainRows, testRows, config);
+  }
+  else {
+    throw std::runtime_error("ERROR: unknown MVA trainer " + trainer);
+  }
+}
 
-  TMVA::DataLoader *dataLoader = new TMVA::DataLoader("outputs");
+/**
+ * Reads the truth player positions and assigns to each cluster the class of the closest one.
+ * The class names are the teams found in the truth file, in alphabetical order.
+ *
+ * @param ds Data set to be labeled.
+ * @param config Configuration.
+ */
+void ClassificationAlg::labelTrainingClusters(DataSet &ds, const Config &config)
+{
+
+  std::vector<Cluster> &trainingClusters = ds.clusters();
 
   
   //
@@ -494,7 +710,7 @@ void ClassificationAlg::trainMVA(DataSet &ds, const Config &config)
   for(unsigned int i=0; i<trainingClusters.size(); i++) {
     Cluster &cl = trainingClusters[i];
     float distMin = 99999.;
-    TString className = "";
+    std::string className = "";
     for(std::map<std::string, std::vector<Point> >::iterator itr=truePositions.begin();
 	itr != truePositions.end(); itr++) {
       for(unsigned int j=0; j<itr->second.size(); j++) {
@@ -512,6 +728,43 @@ void ClassificationAlg::trainMVA(DataSet &ds, const Config &config)
       }
     }
   }
+}
+
+/**
+ * Trains the BDT with TMVA, which writes the weights file read by the inference engines.
+ *
+ * @param features Features of the training clusters.
+ * @param labels Class index of each row of features.
+ * @param trainRows Rows used for training.
+ * @param testRows Rows used for testing.
+ * @param config Configuration.
+ */
+void ClassificationAlg::trainTMVA(const FeatureMatrix &features, const std::vector<int> &labels,
+				  const std::vector<unsigned int> &trainRows,
+				  const std::vector<unsigned int> &testRows, const Config &config)
+{
+
+  int nLayers = features.nLayers();
+
+  
+  //
+  // Initialize MVA
+  //
+  TMVA::Tools::Instance();
+  
+  std::string outfileName = config.get("tmvaOutputFile"); 
+  TFile* outputFile=0;
+  TMVA::Factory *factory=0;
+
+  TString factoryOptions = "!V:Silent:!DrawProgressBar:!Color:Transformations=I:AnalysisType=Auto";
+  if(outfileName != "None") {
+    outputFile = TFile::Open( outfileName.c_str(), "RECREATE" );
+    factory = new TMVA::Factory( "TMVAMulticlass", outputFile, factoryOptions );
+  }else{
+    factory = new TMVA::Factory( "TMVAMulticlass", factoryOptions );
+  }
+
+  TMVA::DataLoader *dataLoader = new TMVA::DataLoader("outputs");
 
 
   //
@@ -526,32 +779,16 @@ void ClassificationAlg::trainMVA(DataSet &ds, const Config &config)
     dataLoader->AddVariable( "b"+suffix, 'F' );
   }
 
-  int nSplit = config.get("trainingClustersSplitN");
-  float splitFrac = config.get("trainingClustersSplitF");
-  for(unsigned int i=0; i<trainingClusters.size(); i++) {
-    const Cluster &bigCl = trainingClusters[i];
-    std::vector<Cluster> splitClusters = bigCl.core().randomSplit(nSplit, splitFrac);
-    std::string className = m_classNames[bigCl.classId()];
-    for(unsigned int j=0; j<splitClusters.size(); j++) {
-
-      const Cluster &pl = splitClusters[j];
-      
-      const std::vector<CloudPoint> &layers = pl.layers(nLayers);
-      
-      for(unsigned int k=0; k<layers.size(); k++) {
-	const CloudPoint &p = layers[k];
-	vars[3*k+0] = p.r();
-	vars[3*k+1] = p.g();
-        vars[3*k+2] = p.b();
-      }
-
-      int r = rand() % 2;
-      if(r) {
-	dataLoader->AddTrainingEvent(className.c_str(), vars, 1);
-      }else{
-	dataLoader->AddTestEvent(className.c_str(), vars, 1);
-      }
-    }
+  float buffer[3*FeatureMatrix::kMaxLayers];
+  for(unsigned int i=0; i<trainRows.size(); i++) {
+    const float *row = features.row(trainRows[i], buffer);
+    vars.assign(row, row+features.nColumns());
+    dataLoader->AddTrainingEvent(m_classNames[labels[trainRows[i]]].c_str(), vars, 1);
+  }
+  for(unsigned int i=0; i<testRows.size(); i++) {
+    const float *row = features.row(testRows[i], buffer);
+    vars.assign(row, row+features.nColumns());
+    dataLoader->AddTestEvent(m_classNames[labels[testRows[i]]].c_str(), vars, 1);
   }
    
   dataLoader->PrepareTrainingAndTestTree( "", "!V" );
@@ -560,15 +797,21 @@ void ClassificationAlg::trainMVA(DataSet &ds, const Config &config)
   //
   // Perform training
   //
+  int nTrees = config.get("bdtTrees");
+  float shrinkage = config.get("bdtShrinkage");
+  float baggedFraction = config.get("bdtBaggedFraction");
+  int maxDepth = config.get("bdtMaxDepth");
+  TString bagging = baggedFraction > 0 ?
+    TString::Format("UseBaggedBoost:BaggedSampleFraction=%.2f:", baggedFraction) : TString("");
   factory->BookMethod( dataLoader, TMVA::Types::kBDT, "BDT",
-		       "!H:!V:"
-		       "NTrees=200:"
-		       "BoostType=Grad:"
-		       "Shrinkage=0.30:"
-		       "UseBaggedBoost:"
-		       "BaggedSampleFraction=0.50:"
-		       "nCuts=20:"
-		       "MaxDepth=2:");
+		       TString::Format("!H:!V:"
+				       "NTrees=%d:"
+				       "BoostType=Grad:"
+				       "Shrinkage=%.2f:"
+				       "%s"
+				       "nCuts=20:"
+				       "MaxDepth=%d:",
+				       nTrees, shrinkage, bagging.Data(), maxDepth) );
 
   factory->TrainAllMethods();
 
@@ -582,3 +825,43 @@ void ClassificationAlg::trainMVA(DataSet &ds, const Config &config)
   delete factory;
   delete dataLoader;
 }
+
+/**
+ * Trains the BDT with BDTTrainer and writes the binary model used by the native inference engine.
+ * In verbose mode, reports the fraction of test rows classified correctly.
+ *
+ * @param features Features of the training clusters.
+ * @param labels Class index of each row of features.
+ * @param trainRows Rows used for training.
+ * @param testRows Rows used for testing.
+ * @param config Configuration.
+ */
+void ClassificationAlg::trainNative(const FeatureMatrix &features, const std::vector<int> &labels,
+				    const std::vector<unsigned int> &trainRows,
+				    const std::vector<unsigned int> &testRows, const Config &config)
+{
+
+  const std::string binaryFile = BDTModel::kBaseName + ".bin";
+
+  BDTTrainer trainer(config);
+  trainer.train(features, labels, trainRows, m_classNames.size());
+  trainer.write(binaryFile, m_classNames);
+
+  bool verbose = config.get("verbose");
+  if(verbose && !testRows.empty()) {
+    BDTModel model;
+    model.load(binaryFile);
+    std::vector<float> outputs(m_classNames.size());
+    float buffer[3*FeatureMatrix::kMaxLayers];
+    int nCorrect = 0;
+    for(unsigned int i=0; i<testRows.size(); i++) {
+      model.evaluate(features.row(testRows[i], buffer), &outputs[0]);
+      int classId = std::max_element(outputs.begin(), outputs.end()) - outputs.begin();
+      if(classId == labels[testRows[i]]) nCorrect++;
+    }
+    std::cout << std::endl
+	      << "BDT trained with " << trainer.nTrees() << " trees, test accuracy: "
+	      << (float)nCorrect/testRows.size()
+	      << std::endl;
+  }
+}
@@ -21,7 +21,8 @@ CloudPoint::CloudPoint() :
 CloudPoint::CloudPoint(float _x, float _y, float _z, int _r, int _g,  int _b) :
   Point(_x, _y, _z),
   m_r(_r), m_g(_g), m_b(_b),
-  m_id(s_nextId)
+  m_id(s_nextId),
+  m_weight(1)
 {
   s_nextId++;
 }
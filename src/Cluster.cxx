@@ -1,4 +1,5 @@
 #include "Cluster.h"
+#include "RandomStream.h"
 
 #include <iostream>
 
@@ -10,9 +11,11 @@ Cluster::Cluster() :
   m_seed(Point(0,0,0)),
   m_pcaColor(Point(0,0,0)),
   m_core(0),
+  m_weight(0),
+  m_ymax(0),
   m_density(0),
   m_classId(-1),
-  m_fPerCluster(0)
+  m_nEmptyLayers(0)
 {
 }
 
@@ -25,11 +28,13 @@ Cluster::Cluster(const Cluster &cl) :
   m_seed(cl.m_seed),
   m_pcaColor(cl.m_pcaColor),
   m_core(0),
+  m_weight(cl.m_weight),
+  m_ymax(cl.m_ymax),
   m_density(cl.m_density),
   m_classId(cl.m_classId),
   m_layers(cl.m_layers),
-  m_splitClusters(cl.m_splitClusters),
-  m_fPerCluster(cl.m_fPerCluster)
+  m_features(cl.m_features),
+  m_nEmptyLayers(cl.m_nEmptyLayers)
 {
   if(cl.m_core != 0) {
     m_core = new Cluster(*cl.m_core);
@@ -44,15 +49,19 @@ Cluster::~Cluster()
 /**
  * @param cp Cloud point to add.
  * 
- * Adds the point to the cluster and updates the center of mass.
+ * Adds the point to the cluster and updates the center of mass, weighted by the point weight,
+ * and the maximum height.
  */
 void Cluster::addPoint(const CloudPoint &cp) {
-  m_com.setX( ( m_com.x() * m_points.size() + cp.x() ) / (m_points.size()+1.) );
-  m_com.setY( ( m_com.y() * m_points.size() + cp.y() ) / (m_points.size()+1.) );
-  m_com.setZ( ( m_com.z() * m_points.size() + cp.z() ) / (m_points.size()+1.) );
+  float w = cp.weight();
+  m_com.setX( ( m_com.x() * m_weight + cp.x() * w ) / (m_weight + w) );
+  m_com.setY( ( m_com.y() * m_weight + cp.y() * w ) / (m_weight + w) );
+  m_com.setZ( ( m_com.z() * m_weight + cp.z() * w ) / (m_weight + w) );
+  m_weight += w;
+  if(cp.y() > m_ymax) m_ymax = cp.y();
   m_points.push_back(cp);
   m_layers.clear();
-  m_splitClusters.clear();
+  m_features.clear();
 }
 
 /**
@@ -64,6 +73,18 @@ void Cluster::addPoints(const Cluster &cl) {
   }
 }
 
+/**
+ * Other properties such as the seed and the density are kept.
+ */
+void Cluster::clearPoints() {
+  m_points.clear();
+  m_com = Point(0,0,0);
+  m_weight = 0;
+  m_ymax = 0;
+  m_layers.clear();
+  m_features.clear();
+}
+
 /**
  * @param nLayers Number of requested layers.
  * @return Vector of layers.
@@ -75,10 +96,8 @@ const std::vector<CloudPoint> &Cluster::layers(int nLayers) const {
 
   if(nLayers == (int)m_layers.size()) return m_layers;
   
-  double ymax = 0;
-  for(unsigned int i=0; i<m_points.size(); i++) {
-    if(m_points[i].y() > ymax) ymax = m_points[i].y();
-  }
+  double ymax = m_ymax;
+  m_layers.clear();
   m_layers.resize(nLayers);
   std::vector<int> nPointsPerLayer(nLayers, 0);
   
@@ -111,31 +130,135 @@ const std::vector<CloudPoint> &Cluster::layers(int nLayers) const {
 }
 
 /**
- * @param nClusters Number of random sub-clusters to generate.
- * @param fPerCluster Franction of points per cluster.
- * @return Random sub-clusters
+ * The features are those of layerFeatures(), kept until points are added or cleared, so that
+ * clusters carried over from a previous frame are not scanned again by the classification.
  *
- * This is intended to be used during training. 
- * 
+ * @param nLayers Number of requested layers.
+ * @return Row of size 3*nLayers, ordered (r0, g0, b0, r1, g1, b1, ...).
+ */
+const std::vector<int> &Cluster::cachedLayerFeatures(int nLayers) const {
+
+  if(3*nLayers == (int)m_features.size()) return m_features;
+
+  m_features.assign(3*nLayers, 0);
+  m_nEmptyLayers = layerFeatures(nLayers, &m_features[0]);
+  return m_features;
+}
+
+/**
+ * Points are visited in a random order without repetition: a stride coprime with the number of points,
+ * from a random offset. Each point is added to its layer until the standard error of the three color means
+ * of that layer is below @p tolerance, with at least 8 points, and the points of the completed layers are
+ * skipped. The standard errors are checked every 4 points of a layer. \n
+ * Thin layers would never reach 8 points, so that a layer still below 8 points after 128 visited points
+ * per layer, i.e. holding less than about 1/16 of its even share of the points, is complete as well and
+ * keeps the mean of its samples. The sampling stops when all layers are complete, or after @p maxSamples
+ * points added to the layers. \n
+ * The number of points visited therefore depends on the color spread and on the height fraction of the
+ * smallest layer above the thin ones, not on the total number of points. If no layer completes, all points
+ * are visited and the features are the same as layerFeatures().
+ * Layer colors are averaged with integer division, and layers with no sampled points get null colors.
+ *
+ * @param nLayers Number of requested layers.
+ * @param tolerance Standard error of the layer color means at which a layer is complete.
+ * @param maxSamples Largest number of points added to the layers. Put 0 for no limit.
+ * @param rng Random stream of the visiting order.
+ * @param element Element of the random stream.
+ * @param row Output row of size 3*nLayers, ordered (r0, g0, b0, r1, g1, b1, ...).
+ * @return Number of layers with no points.
  */
-std::vector<Cluster> &Cluster::randomSplit(int nClusters, float fPerCluster) const
+int Cluster::sampledLayerFeatures(int nLayers, float tolerance, unsigned int maxSamples,
+				  const RandomStream &rng, unsigned long long element, int *row) const
 {
+  const int kMinSamples = 8;
+  const int kCheckInterval = 4;
+  const int kThinVisits = 128;
 
-  if(nClusters == (int)m_splitClusters.size() &&
-     fPerCluster == m_fPerCluster) {
-    return m_splitClusters;
+  unsigned long long n = m_points.size();
+  unsigned long long offset = n > 0 ? rng.bits(element, 0) % n : 0;
+  unsigned long long stride = 1;
+  if(n > 2) {
+    stride = 1 + rng.bits(element, 1) % (n-1);
+    while(gcd(stride, n) != 1) stride++;
   }
 
-  m_splitClusters.resize(nClusters);
+  double ymax = m_ymax;
+  double toleranceSq = (double)tolerance*tolerance;
+  std::vector<long long> sums(3*nLayers, 0);
+  std::vector<long long> sumsSq(3*nLayers, 0);
+  std::vector<int> nPointsPerLayer(nLayers, 0);
+  std::vector<char> complete(nLayers, 0);
+  int nComplete = 0;
+  unsigned long long nAdded = 0;
 
-  for(unsigned int i=0; i<m_splitClusters.size(); i++) {
-    for(unsigned int j=0; j<m_points.size(); j++) {
-      double f = rand() / (double)(RAND_MAX);
-      if(f < fPerCluster) {
-	m_splitClusters[i].addPoint(m_points[j]);
+  unsigned long long thinVisits = (unsigned long long)kThinVisits*nLayers;
+  unsigned long long index = offset;
+  for(unsigned long long j=0; j<n && nComplete<nLayers && (maxSamples == 0 || nAdded < maxSamples); j++) {
+    if(j == thinVisits) {
+      for(int k=0; k<nLayers; k++) {
+	if(complete[k] || nPointsPerLayer[k] >= kMinSamples) continue;
+	complete[k] = 1;
+	nComplete++;
       }
+      if(nComplete == nLayers) break;
+    }
+
+    const CloudPoint &p = m_points[index];
+    index += stride;
+    if(index >= n) index -= n;
+    int iLayer = (int)(nLayers*p.y()/ymax);
+    if(iLayer >= nLayers) iLayer = nLayers-1;
+    if(complete[iLayer]) continue;
+
+    int color[3] = {p.r(), p.g(), p.b()};
+    long long *sum = &sums[3*iLayer];
+    long long *sumSq = &sumsSq[3*iLayer];
+    for(int c=0; c<3; c++) {
+      sum[c] += color[c];
+      sumSq[c] += color[c]*color[c];
+    }
+    nAdded++;
+    int m = ++nPointsPerLayer[iLayer];
+    if(m < kMinSamples || m%kCheckInterval != 0) continue;
+
+    // Squared standard errors of the means, from the unbiased variances
+    bool converged = true;
+    for(int c=0; c<3 && converged; c++) {
+      double variance = (sumSq[c] - (double)sum[c]*sum[c]/m)/(m-1);
+      converged = variance <= toleranceSq*m;
+    }
+    if(converged) {
+      complete[iLayer] = 1;
+      nComplete++;
     }
   }
 
-  return m_splitClusters;
+
+  int nEmpty = 0;
+  for(int k=0; k<nLayers; k++) {
+    int m = nPointsPerLayer[k];
+    if(m == 0) {
+      nEmpty++;
+      m = 1;
+    }
+    row[3*k+0] = sums[3*k+0]/m;
+    row[3*k+1] = sums[3*k+1]/m;
+    row[3*k+2] = sums[3*k+2]/m;
+  }
+  return nEmpty;
+}
+
+/**
+ * @param a First integer.
+ * @param b Second integer.
+ * @return Greatest common divisor.
+ */
+unsigned long long Cluster::gcd(unsigned long long a, unsigned long long b)
+{
+  while(b != 0) {
+    unsigned long long r = a % b;
+    a = b;
+    b = r;
+  }
+  return a;
 }
@@ -1,9 +1,17 @@
 #include "ClusteringAlg.h"
 
+#include <algorithm>
 #include <cmath>
 #include <iostream>
+#include <unordered_map>
 
+#include "Parallel.h"
+#include "RandomStream.h"
+#include "ShardCoordinator.h"
+#include "StreamingClustering.h"
 #include "TStopwatch.h"
+#include "TileStore.h"
+#include "UnionFind.h"
 
 ClusteringAlg::ClusteringAlg()
 {
@@ -20,13 +28,36 @@ ClusteringAlg::~ClusteringAlg()
  * - Full clustering.
  * - Outlier removal.
  *
- * See @ref index for detailed documentation of the underlying algorithms.
+ * See @ref index for detailed documentation of the underlying algorithms. \n
+ * The tiled, sharded, DBSCAN and streaming variants are selected from the configuration.
  *
  * @param ds Data set to be clustered.
  * @param config Configuration.
  */
 void ClusteringAlg::runClustering(DataSet &ds, const Config &config) {
 
+  std::string engine = config.get("clusteringEngine");
+  if(engine == "dbscan") {
+    runDbscanClustering(ds, config);
+    return;
+  }
+  if(engine == "streaming") {
+    runStreamingClustering(ds, config);
+    return;
+  }
+
+  int nShards = config.get("nShards");
+  if(nShards > 1) {
+    runShardedClustering(ds, config, nShards);
+    return;
+  }
+
+  float tileSize = config.get("tileSize");
+  if(tileSize > 0) {
+    runTiledClustering(ds, config);
+    return;
+  }
+
   bool verbose = config.get("verbose");
   
   TStopwatch sw;
@@ -107,10 +138,16 @@ void ClusteringAlg::runClustering(DataSet &ds, const Config &config) {
 void ClusteringAlg::runPreClustering(DataSet &ds, const Config &config)
 {
 
+  bool skipPreClustering = config.get("skipPreClustering");
+  std::string mode = config.get("preClusteringMode");
+  if(mode == "components" && !skipPreClustering) {
+    runComponentPreClustering(ds, config);
+    return;
+  }
+
   const std::vector<CloudPoint> &points = ds.points();
   std::vector<Cluster> &clusters = ds.preClusters();
 
-  bool skipPreClustering = config.get("skipPreClustering");
   float dmin = config.get("preClusteringSize");
 
   for(unsigned int i=0; i<points.size(); i++) {
@@ -139,19 +176,94 @@ void ClusteringAlg::runPreClustering(DataSet &ds, const Config &config)
 
 }
 
+
+
+/**
+ * Pre-clusters are the connected components of the graph linking points closer than
+ * @c preClusteringLinkLength in the (x,z) plane.
+ * Unlike the greedy pre-clustering, the result does not depend on the order of the input points
+ * and the links are found in parallel, merging components through a lock-free union-find.
+ * Pre-clusters are ordered by their first point, and points keep the input order within a pre-cluster.
+ *
+ * The link length should stay below the spacing between neighboring point columns,
+ * otherwise whole players are chained into a single pre-cluster.
+ *
+ * @param ds Data set to be clustered.
+ * @param config Configuration.
+ */
+void ClusteringAlg::runComponentPreClustering(DataSet &ds, const Config &config)
+{
+
+  const std::vector<CloudPoint> &points = ds.points();
+  std::vector<Cluster> &clusters = ds.preClusters();
+
+  float link = config.get("preClusteringLinkLength");
+  int nThreads = threadCount(config);
+
+  TileGrid grid(points, link, 0);
+  UnionFind components(points.size());
+  parallelFor(points.size(), nThreads, [&](unsigned int i) {
+      forEachNeighbor(grid, points, i, link, [&](unsigned int j) {
+	  if(j > i) components.unite(i, j);
+	});
+    });
+
+  std::vector<int> clusterIndex(points.size(), -1);
+  for(unsigned int i=0; i<points.size(); i++) {
+    unsigned int root = components.find(i);
+    if(clusterIndex[root] < 0) {
+      clusterIndex[root] = clusters.size();
+      clusters.push_back(Cluster());
+    }
+    clusters[clusterIndex[root]].addPoint(points[i]);
+  }
+
+}
+
   
 /**
  * Compute densities by couting cloud points in a neighborhood.
+ * If @c densitySampleRate is below 1, the counts are estimated from a sample of the pre-clusters
+ * (see estimateDensities()).
+ * Densities are normalized to the maximum density, or to @p dmaxMin if larger.
  *
  * @param ds Data set to be clustered.
  * @param config Configuration.
+ * @param dmaxMin Minimum normalization.
+ * @return Normalization.
  */
-void ClusteringAlg::computeDensities(DataSet &ds, const Config &config) {
+float ClusteringAlg::computeDensities(DataSet &ds, const Config &config, float dmaxMin) {
   
   float d = config.get("densityWindow");
-  float dmax = 0;
+  float sampleRate = config.get("densitySampleRate");
 
   std::vector<Cluster> &preClusters = ds.preClusters();
+  float dmax = 0;
+  if(sampleRate < 1) {
+    dmax = estimateDensities(preClusters, d, config);
+  }else{
+    dmax = countDensities(preClusters, d);
+  }
+  if(dmax < dmaxMin) dmax = dmaxMin;
+  for(unsigned int i=0; i<preClusters.size(); i++) {
+    Cluster &cli = preClusters[i];
+    cli.setDensity(cli.density()/dmax);
+  }
+
+  return dmax;
+}
+
+
+/**
+ * The density of a pre-cluster is the number of input points in pre-clusters within a square window around it.
+ *
+ * @param preClusters Pre-clusters whose densities are set.
+ * @param d Half-size of the density window.
+ * @return Maximum density.
+ */
+float ClusteringAlg::countDensities(std::vector<Cluster> &preClusters, float d) {
+
+  float dmax = 0;
   for(unsigned int i=0; i<preClusters.size(); i++) {
     Cluster &cli = preClusters[i];
     float density = 0;
@@ -159,18 +271,221 @@ void ClusteringAlg::computeDensities(DataSet &ds, const Config &config) {
       const Cluster &clj = preClusters[j];
       if(fabs(clj.com().x()-cli.com().x()) > d) continue;
       if(fabs(clj.com().z()-cli.com().z()) > d) continue;
-      density+=clj.points().size();
+      density+=clj.weight();
     }
     cli.setDensity(density);
     if(density > dmax) {
       dmax = density;
     }
   }
-  for(unsigned int i=0; i<preClusters.size(); i++) {
-    Cluster &cli = preClusters[i];
-    cli.setDensity(cli.density()/dmax);
+  return dmax;
+}
+
+
+/**
+ * Approximate version of countDensities() for large frames:
+ * - Pre-clusters are bucketed into cells of the size of the density window. In each cell, a fraction
+ *   @c densitySampleRate of the pre-clusters, and at least two, is drawn at random.
+ * - The density of each pre-cluster is estimated from the sampled pre-clusters of the neighboring cells,
+ *   each cell being scaled by its inverse sampling fraction. The cells are used as strata to compute
+ *   the standard error of the estimate, and the confidence interval extends over @c densityConfidence
+ *   standard errors.
+ * - Densities whose interval reaches @c seedDensityThreshold times a lower bound of the maximum density
+ *   are re-computed exactly. The others are too low for the pre-cluster to become a seed or to prevent a
+ *   neighbor from being one, so that the seeds match the exact computation unless an estimate falls
+ *   out of its interval.
+ *
+ * @param preClusters Pre-clusters whose densities are set.
+ * @param d Half-size of the density window.
+ * @param config Configuration.
+ * @return Maximum density.
+ */
+float ClusteringAlg::estimateDensities(std::vector<Cluster> &preClusters, float d, const Config &config) {
+
+  bool verbose = config.get("verbose");
+  float sampleRate = config.get("densitySampleRate");
+  float nSigmas = config.get("densityConfidence");
+  float densityTh = config.get("seedDensityThreshold");
+  int seed = config.get("randomSeed");
+  int nThreads = threadCount(config);
+
+  unsigned int n = preClusters.size();
+  if(n == 0) return 0;
+
+  //
+  // Bucket pre-clusters into cells of the size of the density window
+  //
+  float xmin = preClusters[0].com().x();
+  float zmin = preClusters[0].com().z();
+  float xmax = xmin;
+  float zmax = zmin;
+  for(unsigned int i=1; i<n; i++) {
+    const Point &com = preClusters[i].com();
+    xmin = std::min(xmin, com.x());
+    zmin = std::min(zmin, com.z());
+    xmax = std::max(xmax, com.x());
+    zmax = std::max(zmax, com.z());
+  }
+  int nx = int((xmax-xmin)/d) + 1;
+  int nz = int((zmax-zmin)/d) + 1;
+  int nCells = nx*nz;
+
+  std::vector<int> cellX(n);
+  std::vector<int> cellZ(n);
+  std::vector<unsigned int> cellBegin(nCells+1, 0);
+  for(unsigned int i=0; i<n; i++) {
+    cellX[i] = std::min(int((preClusters[i].com().x()-xmin)/d), nx-1);
+    cellZ[i] = std::min(int((preClusters[i].com().z()-zmin)/d), nz-1);
+    cellBegin[cellX[i]*nz+cellZ[i]+1]++;
+  }
+  for(int c=0; c<nCells; c++) {
+    cellBegin[c+1] += cellBegin[c];
+  }
+  std::vector<unsigned int> members(n);
+  std::vector<unsigned int> fill(cellBegin.begin(), cellBegin.end()-1);
+  for(unsigned int i=0; i<n; i++) {
+    members[fill[cellX[i]*nz+cellZ[i]]++] = i;
+  }
+
+
+  //
+  // Draw a stratified sample: the first pre-clusters of each cell after a partial shuffle
+  //
+  std::vector<unsigned int> sampleEnd(nCells);
+  const RandomStream rng(seed, RandomStream::kDensitySampling);
+  for(int c=0; c<nCells; c++) {
+    unsigned int nCell = cellBegin[c+1] - cellBegin[c];
+    unsigned int nSample = (unsigned int)ceil(sampleRate*nCell);
+    if(nSample < 2) nSample = std::min(nCell, 2u);
+    for(unsigned int k=0; k<nSample; k++) {
+      unsigned int l = k + rng.bits(c, k)%(nCell-k);
+      std::swap(members[cellBegin[c]+k], members[cellBegin[c]+l]);
+    }
+    sampleEnd[c] = cellBegin[c] + nSample;
   }
 
+
+  //
+  // Estimate densities and their confidence intervals
+  //
+  std::vector<float> densities(n);
+  std::vector<float> errors(n);
+  parallelFor(n, nThreads, [&](unsigned int i) {
+      const Point &comi = preClusters[i].com();
+      double density = 0;
+      double variance = 0;
+      for(int cx=std::max(cellX[i]-1, 0); cx<=std::min(cellX[i]+1, nx-1); cx++) {
+	for(int cz=std::max(cellZ[i]-1, 0); cz<=std::min(cellZ[i]+1, nz-1); cz++) {
+	  int c = cx*nz+cz;
+	  double nCell = cellBegin[c+1] - cellBegin[c];
+	  double nSample = sampleEnd[c] - cellBegin[c];
+	  if(nSample == 0) continue;
+	  double sy = 0;
+	  double syy = 0;
+	  for(unsigned int k=cellBegin[c]; k<sampleEnd[c]; k++) {
+	    const Cluster &clj = preClusters[members[k]];
+	    if(fabs(clj.com().x()-comi.x()) > d) continue;
+	    if(fabs(clj.com().z()-comi.z()) > d) continue;
+	    sy += clj.weight();
+	    syy += clj.weight()*clj.weight();
+	  }
+	  density += nCell/nSample*sy;
+	  if(nSample > 1 && nSample < nCell) {
+	    double s2 = (syy - sy*sy/nSample)/(nSample-1);
+	    variance += nCell*nCell*(1-nSample/nCell)*s2/nSample;
+	  }
+	}
+      }
+      densities[i] = density;
+      errors[i] = nSigmas*sqrt(variance);
+    });
+
+
+  //
+  // Re-check exactly the pre-clusters which may be seeds or have the maximum density
+  //
+  float dmaxLow = 0;
+  for(unsigned int i=0; i<n; i++) {
+    dmaxLow = std::max(dmaxLow, densities[i]-errors[i]);
+  }
+  std::vector<bool> recheck(n);
+  for(unsigned int i=0; i<n; i++) {
+    recheck[i] = densities[i]+errors[i] >= densityTh*dmaxLow;
+  }
+  parallelFor(n, nThreads, [&](unsigned int i) {
+      if(!recheck[i]) return;
+      const Point &comi = preClusters[i].com();
+      float density = 0;
+      for(int cx=std::max(cellX[i]-1, 0); cx<=std::min(cellX[i]+1, nx-1); cx++) {
+	for(int cz=std::max(cellZ[i]-1, 0); cz<=std::min(cellZ[i]+1, nz-1); cz++) {
+	  int c = cx*nz+cz;
+	  for(unsigned int k=cellBegin[c]; k<cellBegin[c+1]; k++) {
+	    const Cluster &clj = preClusters[members[k]];
+	    if(fabs(clj.com().x()-comi.x()) > d) continue;
+	    if(fabs(clj.com().z()-comi.z()) > d) continue;
+	    density += clj.weight();
+	  }
+	}
+      }
+      densities[i] = density;
+      errors[i] = 0;
+    });
+
+  float dmax = 0;
+  unsigned int nSampled = 0;
+  unsigned int nRechecked = 0;
+  double sumErrors = 0;
+  for(unsigned int i=0; i<n; i++) {
+    preClusters[i].setDensity(densities[i]);
+    dmax = std::max(dmax, densities[i]);
+    if(recheck[i]) nRechecked++;
+    sumErrors += errors[i];
+  }
+  for(int c=0; c<nCells; c++) {
+    nSampled += sampleEnd[c] - cellBegin[c];
+  }
+
+  if(verbose) {
+    std::cout << std::endl
+	      << "Densities estimated from " << nSampled << " of " << n << " pre-clusters, "
+	      << nRechecked << " re-checked exactly." << std::endl
+	      << "Mean confidence interval of the other densities: +/- "
+	      << (n > nRechecked ? sumErrors/(n-nRechecked)/dmax : 0.)
+	      << " (normalized to the maximum density)." << std::endl;
+  }
+
+  return dmax;
+}
+
+
+/**
+ * A pre-cluster is a local maximum if no other pre-cluster within the density window has a higher density.
+ * Ties are resolved in favor of the pre-cluster with the highest index.
+ *
+ * @param preClusters Pre-clusters with densities.
+ * @param d Half-size of the density window.
+ * @param isLocalMax Output flags, one per pre-cluster.
+ */
+void ClusteringAlg::findLocalMaxima(const std::vector<Cluster> &preClusters, float d,
+				    std::vector<bool> &isLocalMax) {
+
+  isLocalMax.assign(preClusters.size(), true);
+  for(unsigned int i=0; i<preClusters.size(); i++) {
+    const Cluster &cli = preClusters[i];
+    for(unsigned int j=0; j<preClusters.size(); j++) {
+      if(i==j) continue;
+      const Cluster &clj = preClusters[j];
+      if(fabs(clj.com().x()-cli.com().x()) > d) continue;
+      if(fabs(clj.com().z()-cli.com().z()) > d) continue;
+      if(clj.density() > cli.density()) {
+	isLocalMax[i] = false;
+	break;
+      }
+      if(clj.density() == cli.density() && i<j) {
+	isLocalMax[i] = false;
+      }
+    }
+  }
 }
  
 /**
@@ -193,23 +508,11 @@ void ClusteringAlg::runSeededClustering(DataSet &ds, const Config &config) {
   std::vector<Cluster> seeds;
   std::vector<Cluster> leftovers;
   float d = config.get("densityWindow");
+  std::vector<bool> isLocalMax;
+  findLocalMaxima(preClusters, d, isLocalMax);
   for(unsigned int i=0; i<preClusters.size(); i++) {
     const Cluster &cli = preClusters[i];
-    bool isLocalMax = true;
-    for(unsigned int j=0; j<preClusters.size(); j++) {
-      if(i==j) continue;
-      const Cluster &clj = preClusters[j];
-      if(fabs(clj.com().x()-cli.com().x()) > d) continue;
-      if(fabs(clj.com().z()-cli.com().z()) > d) continue;
-      if(clj.density() > cli.density()) {
-	isLocalMax = false;
-	break;
-      }
-      if(clj.density() == cli.density() && i<j) {
-	isLocalMax = false;
-      }
-    }
-    if(isLocalMax) {
+    if(isLocalMax[i]) {
       Cluster cl;
       cl.addPoints(cli);
       cl.setDensity(cli.density());
@@ -240,56 +543,90 @@ void ClusteringAlg::runSeededClustering(DataSet &ds, const Config &config) {
   //
   // Assign each pre-cluster to the nearest seed
   //
+  if(clusters.empty()) return;
   for(unsigned int i=0; i<leftovers.size(); i++) {
     const Cluster &cli = leftovers[i];
-    int icl = 0;   
-    float minDist2DSq = clusters[icl].seed().dist2DSq(cli.com());    
-    for(unsigned int j=1; j<clusters.size(); j++) {
-      const Cluster &cl = clusters[j];
-      float dist2DSq = cl.seed().dist2DSq(cli.com());
-      if(dist2DSq < minDist2DSq) {
-  	minDist2DSq = dist2DSq;
-  	icl = j;
-      }
-    }
+    int icl = findNearestSeed<MetricXZ>(clusters, cli.com());
     clusters[icl].addPoints(cli);
   }
 }
 
 
 /**
+ * The metric is a template parameter so that the distance computation is inlined in the search loop.
+ *
+ * @param clusters Clusters with seeds. Must not be empty.
+ * @param p Position to match.
+ * @return Index of the cluster with the nearest seed.
+ */
+template<class Metric>
+int ClusteringAlg::findNearestSeed(const std::vector<Cluster> &clusters, const Point &p) const
+{
+  int icl = 0;
+  float minDistSq = clusters[icl].seed().distSq<Metric>(p);
+  for(unsigned int j=1; j<clusters.size(); j++) {
+    float distSq = clusters[j].seed().distSq<Metric>(p);
+    if(distSq < minDistSq) {
+      minDistSq = distSq;
+      icl = j;
+    }
+  }
+  return icl;
+}
+
+
+/**
+ * Outliers are removed from the full resolution points when the data set was downsampled.
+ * The spread of the points around the seeds is summed over clusters with a parallel reduction,
+ * whose result does not depend on the number of threads in deterministic mode.
+ *
  * @param ds Data set to be clustered.
  * @param config Configuration.
  */
 void ClusteringAlg::cleanupClusters(DataSet &ds, const Config &config) {
   
+  if(ds.isDownsampled()) {
+    ds.restoreFullResolution();
+  }
+
   std::vector<Cluster> &clusters = ds.clusters();
+  int nThreads = threadCount(config);
 
-  float sx = 0;
-  float sz = 0;
-  float sxx = 0;
-  float szz = 0;
-  float sxz = 0;
-  float nPoints = 0;
-  for(unsigned int i=0; i<clusters.size(); i++) {
-    const Cluster &cl = clusters[i];
-    const Point &clPos = cl.seed();
-    for(unsigned int j=0; j<cl.points().size(); j++) {
-      float dx = clPos.x() - cl.points()[j].x();
-      float dz = clPos.z() - cl.points()[j].z();
-      sx += dx;
-      sz += dz;
-      sxx += dx*dx;
-      szz += dz*dz;
-      sxz += dx*dz;
-      nPoints++;
+  //
+  // Sums of the point offsets to the seeds: x, z, xx, zz, xz and number of points
+  //
+  auto sumOffsets = [&](unsigned int begin, unsigned int end) {
+    std::vector<float> s(6, 0.);
+    for(unsigned int i=begin; i<end; i++) {
+      const Cluster &cl = clusters[i];
+      const Point &clPos = cl.seed();
+      for(unsigned int j=0; j<cl.points().size(); j++) {
+	float dx = clPos.x() - cl.points()[j].x();
+	float dz = clPos.z() - cl.points()[j].z();
+	s[0] += dx;
+	s[1] += dz;
+	s[2] += dx*dx;
+	s[3] += dz*dz;
+	s[4] += dx*dz;
+	s[5]++;
+      }
     }
-  }
-  sx /= nPoints;
-  sz /= nPoints;
-  sxx /= nPoints;
-  szz /= nPoints;
-  sxz /= nPoints;
+    return s;
+  };
+  auto addSums = [](const std::vector<float> &a, const std::vector<float> &b) {
+    std::vector<float> s(a);
+    for(unsigned int k=0; k<s.size(); k++) s[k] += b[k];
+    return s;
+  };
+  std::vector<float> sums = parallelReduce(clusters.size(), nThreads, reductionBlockSize(config),
+					   std::vector<float>(6, 0.), sumOffsets, addSums);
+
+  float nPoints = sums[5];
+  float sx = sums[0]/nPoints;
+  float sz = sums[1]/nPoints;
+  float sxx = sums[2]/nPoints;
+  float szz = sums[3]/nPoints;
+  float sxz = sums[4]/nPoints;
   sxx -= sx*sx;
   szz -= sz*sz;
   sxz -= sx*sz;
@@ -299,21 +636,691 @@ void ClusteringAlg::cleanupClusters(DataSet &ds, const Config &config) {
   float smax = config.get("clusterCoreSize");
   smax = smax*smax;
   
+  parallelFor(clusters.size(), nThreads, [&](unsigned int i) {
+      Cluster &cl = clusters[i];
+      const Point &clPos = cl.seed();
+      Cluster *core = new Cluster();
+      for(unsigned int j=0; j<cl.points().size(); j++) {
+	float dx = (clPos.x() - cl.points()[j].x());
+	float dz = (clPos.z() - cl.points()[j].z());
+	float dS = (dx*dx*szz + dz*dz*sxx - 2*dx*dz*sxz) / D;
+	bool selected = true;
+	if(dS > smax) selected = false;
+	if(selected) {
+	  core->addPoint(cl.points()[j]);
+	}
+      }
+      cl.setCore(core);
+    });
+
+}
+
+
+/**
+ * Same as the in-memory chain of runClustering(), for the points of a region of the field.
+ * Seeds are selected with densities normalized to at least @p dmaxMin, so that the seed threshold
+ * can refer to the maximum density over the whole field rather than over the region.
+ *
+ * @param ds Data set holding the points of the region.
+ * @param config Configuration.
+ * @param dmaxMin Minimum density normalization, typically the maximum density outside the region.
+ * @return Density normalization used, the maximum of @p dmaxMin and of the densities in the region.
+ */
+float ClusteringAlg::runRegionClustering(DataSet &ds, const Config &config, float dmaxMin) {
+
+  runPreClustering(ds, config);
+  float dmax = computeDensities(ds, config, dmaxMin);
+  runSeededClustering(ds, config);
+  if(!ds.clusters().empty()) {
+    cleanupClusters(ds, config);
+  }
+  return dmax;
+}
+
+
+/**
+ * The points of the data set are spilled to a TileStore and clustered as in the other overload.
+ * Voxels are replaced by the full resolution points they represent, which are downsampled again tile by tile.
+ *
+ * @param ds Data set to be clustered.
+ * @param config Configuration.
+ */
+void ClusteringAlg::runTiledClustering(DataSet &ds, const Config &config) {
+
+  const std::vector<CloudPoint> &points = ds.isDownsampled() ? ds.fullResolutionPoints() : ds.points();
+  TileStore store(tileSize(config), tileHalo(config));
+  store.addPoints(points, 0, points.size());
+  runTiledClustering(store, ds, config);
+}
+
+
+/**
+ * Runs the clustering chain on x/z tiles extended by a halo, loading one tile at a time from the store,
+ * so that the peak memory is bounded by the points of a tile and by the output clusters rather than
+ * by the whole frame:
+ * - For each tile, pre-clusters are built and the local density maxima whose center lies in
+ *   the tile core are kept as seed candidates.
+ * - Seeds are selected among all candidates, using the maximum density over all tiles for normalization.
+ * - For each tile, the pre-clusters are rebuilt and the points of the tile core are assigned to the seed
+ *   nearest to their pre-cluster. The spread of the points around the seeds is summed over all tiles.
+ * - For each tile, the points are assigned again and those within @c clusterCoreSize of their seed,
+ *   for the spread measured over the whole frame, are added to the clusters before the next tile is loaded.
+ *
+ * Each point is assigned by the tile whose core contains it, and the halo makes its pre-cluster
+ * the same as with the whole frame unless the pre-cluster is wider than the halo.
+ * See tileHalo() for the choice of the halo width. \n
+ * Unlike the in-memory chain, outliers are never stored: the clusters and their cores both hold the core
+ * points only. The voxel downsampling, if any, is done per tile.
+ *
+ * @param store Points of the frame, grouped by tile. Flushed before clustering.
+ * @param ds Data set receiving the clusters. Its points are not used.
+ * @param config Configuration.
+ */
+void ClusteringAlg::runTiledClustering(TileStore &store, DataSet &ds, const Config &config) {
+
+  bool verbose = config.get("verbose");
+
+  TStopwatch sw;
+  if(verbose) {
+    sw.Start();
+  }
+
+  store.flush();
+
+
+  //
+  // Collect seed candidates tile by tile
+  //
+  float d = config.get("densityWindow");
+  std::vector<Cluster> candidates;
+  for(int i=0; i<store.nTiles(); i++) {
+    DataSet tileDS;
+    loadTile(store, i, config, tileDS);
+    findSeedCandidates(tileDS, [&](float x, float z) { return store.inCore(i, x, z); }, d, candidates);
+  }
+  std::vector<Cluster> &clusters = ds.clusters();
+  selectSeeds(candidates, config, clusters);
+
+  if(verbose) {
+    sw.Stop();
+    std::cout << std::endl
+	      << "Tiled seeding done: " << clusters.size() << " seeds selected among "
+	      << candidates.size() << " candidates in " << store.nTiles() << " tiles."
+	      << std::endl;
+    sw.Print("m");
+    sw.Start();
+  }
+
+  if(clusters.empty()) return;
+
+
+  //
+  // Sums of the point offsets to the seeds: x, z, xx, zz, xz and number of points
+  //
+  std::vector<double> sums(6, 0.);
+  for(int i=0; i<store.nTiles(); i++) {
+    forEachTilePoint(store, i, clusters, config, [&](const CloudPoint &cp, int icl) {
+	float dx = clusters[icl].seed().x() - cp.x();
+	float dz = clusters[icl].seed().z() - cp.z();
+	sums[0] += dx;
+	sums[1] += dz;
+	sums[2] += dx*dx;
+	sums[3] += dz*dz;
+	sums[4] += dx*dz;
+	sums[5]++;
+      });
+  }
+
+  double nPoints = sums[5];
+  double sx = sums[0]/nPoints;
+  double sz = sums[1]/nPoints;
+  double sxx = sums[2]/nPoints - sx*sx;
+  double szz = sums[3]/nPoints - sz*sz;
+  double sxz = sums[4]/nPoints - sx*sz;
+  double D = sxx*szz - sxz*sxz;
+
+  float smax = config.get("clusterCoreSize");
+  smax = smax*smax;
+
+
+  //
+  // Add the core points to the clusters tile by tile
+  //
+  for(int i=0; i<store.nTiles(); i++) {
+    forEachTilePoint(store, i, clusters, config, [&](const CloudPoint &cp, int icl) {
+	float dx = clusters[icl].seed().x() - cp.x();
+	float dz = clusters[icl].seed().z() - cp.z();
+	float dS = (dx*dx*szz + dz*dz*sxx - 2*dx*dz*sxz) / D;
+	if(dS <= smax) clusters[icl].addPoint(cp);
+      });
+  }
   for(unsigned int i=0; i<clusters.size(); i++) {
-    Cluster &cl = clusters[i];
-    const Point &clPos = cl.seed();
     Cluster *core = new Cluster();
-    for(unsigned int j=0; j<cl.points().size(); j++) {
-      float dx = (clPos.x() - cl.points()[j].x());
-      float dz = (clPos.z() - cl.points()[j].z());
-      float dS = (dx*dx*szz + dz*dz*sxx - 2*dx*dz*sxz) / D;
-      bool selected = true;
-      if(dS > smax) selected = false;
-      if(selected) {
-	core->addPoint(cl.points()[j]);
+    core->addPoints(clusters[i]);
+    clusters[i].setCore(core);
+  }
+
+  if(verbose) {
+    sw.Stop();
+    std::cout << std::endl
+	      << "Tiled clustering done: " << nPoints << " points assigned from "
+	      << store.nPoints() << " input points."
+	      << std::endl;
+    sw.Print("m");
+    sw.Start();
+  }
+}
+
+
+/**
+ * Same as the pre-clustering of the seeding pass of runTiledClustering(), with the voxel downsampling if any.
+ *
+ * @param store Points of the frame, grouped by tile.
+ * @param iTile Tile index.
+ * @param config Configuration.
+ * @param tileDS Working data set receiving the points and the pre-clusters.
+ */
+void ClusteringAlg::loadTile(const TileStore &store, int iTile, const Config &config, DataSet &tileDS) {
+
+  store.loadTile(iTile, tileDS.points());
+  if(tileDS.points().empty()) return;
+
+  float voxelSize = config.get("voxelSize");
+  tileDS.downsample(voxelSize);
+  runPreClustering(tileDS, config);
+}
+
+
+/**
+ * Pre-clusters are rebuilt with loadTile(), and each full resolution point of the tile core is passed
+ * with the index of the seed nearest to its pre-cluster.
+ *
+ * @param store Points of the frame, grouped by tile.
+ * @param iTile Tile index.
+ * @param seeds Selected seeds. Must not be empty.
+ * @param config Configuration.
+ * @param f Function called with each point and its seed index.
+ */
+template<class Function>
+void ClusteringAlg::forEachTilePoint(const TileStore &store, int iTile, const std::vector<Cluster> &seeds,
+				     const Config &config, const Function &f) {
+
+  DataSet tileDS;
+  loadTile(store, iTile, config, tileDS);
+
+  const std::vector<Cluster> &preClusters = tileDS.preClusters();
+  const std::vector<CloudPoint> &fullPoints = tileDS.fullResolutionPoints();
+  for(unsigned int i=0; i<preClusters.size(); i++) {
+    const Cluster &cli = preClusters[i];
+    int icl = -1;
+    auto visit = [&](const CloudPoint &cp) {
+      if(!store.inCore(iTile, cp.x(), cp.z())) return;
+      if(icl < 0) icl = findNearestSeed<MetricXZ>(seeds, cli.com());
+      f(cp, icl);
+    };
+    for(unsigned int j=0; j<cli.points().size(); j++) {
+      const CloudPoint &cp = cli.points()[j];
+      int iVoxel = tileDS.isDownsampled() ? tileDS.voxelIndex(cp) : -1;
+      if(iVoxel < 0) {
+	visit(cp);
+	continue;
+      }
+      for(unsigned int k=tileDS.voxelBegin(iVoxel); k<tileDS.voxelEnd(iVoxel); k++) {
+	visit(fullPoints[k]);
       }
     }
-    cl.setCore(core);
+  }
+}
+
+
+/**
+ * Runs the seeding and assignment passes of the tiled clustering on the in-memory data set, with the tiles
+ * split among worker processes (see ShardCoordinator), then removes outliers in process.
+ *
+ * @param ds Data set to be clustered.
+ * @param config Configuration.
+ * @param nShards Number of worker processes.
+ */
+void ClusteringAlg::runShardedClustering(DataSet &ds, const Config &config, int nShards) {
+
+  bool verbose = config.get("verbose");
+
+  TStopwatch sw;
+  if(verbose) {
+    sw.Start();
+  }
+
+  ShardCoordinator coordinator(nShards);
+  coordinator.runClustering(*this, ds, config);
+
+  if(verbose) {
+    sw.Stop();
+    std::cout << std::endl
+	      << "Sharded clustering done: " << ds.clusters().size() << " clusters found by "
+	      << coordinator.nShards() << " workers."
+	      << std::endl;
+    sw.Print("m");
+    sw.Start();
+  }
+
+  if(ds.clusters().empty()) return;
+
+  cleanupClusters(ds, config);
+
+  if(verbose) {
+    sw.Stop();
+    std::cout << std::endl
+	      << "Cleanup done"
+	      << std::endl;
+    sw.Print("m");
+    sw.Start();
+  }
+}
+
+
+/**
+ * The sharded clustering needs tiles even when the tiled mode is off,
+ * in which case tiles span ten density windows.
+ *
+ * @param config Configuration.
+ * @return Tile size in unit length.
+ */
+float ClusteringAlg::tileSize(const Config &config) const {
+
+  float size = config.get("tileSize");
+  if(size <= 0) {
+    float d = config.get("densityWindow");
+    size = 10*d;
+  }
+  return size;
+}
+
+
+/**
+ * The halo must be wide enough for the densities of a tile's pre-clusters and of their neighbors
+ * to be complete: by default it is set to twice the density window plus the pre-clustering size.
+ * It is never smaller than the density window.
+ *
+ * @param config Configuration.
+ * @return Halo width in unit length.
+ */
+float ClusteringAlg::tileHalo(const Config &config) const {
+
+  float d = config.get("densityWindow");
+  float halo = config.get("tileHalo");
+  if(halo <= 0) {
+    float dmin = config.get("preClusteringSize");
+    halo = 2*d + dmin;
+  }
+  if(halo < d) halo = d;
+  return halo;
+}
+
+
+/**
+ * Candidates are returned as clusters with no points, holding a seed position and an unnormalized density.
+ * Only local maxima centered in the tile core are returned, so that each candidate is found by exactly one tile.
+ *
+ * @param ds Full data set.
+ * @param grid Tile grid built on the data set points.
+ * @param iTile Tile index.
+ * @param config Configuration.
+ * @param candidates Seed candidates, appended to.
+ */
+void ClusteringAlg::findTileSeeds(DataSet &ds, const TileGrid &grid, int iTile, const Config &config,
+				  std::vector<Cluster> &candidates) {
+
+  DataSet tileDS;
+  std::vector<unsigned int> indices;
+  loadTile(ds, grid, iTile, tileDS, indices);
+  if(indices.empty()) return;
+
+  runPreClustering(tileDS, config);
+
+  float d = config.get("densityWindow");
+  findSeedCandidates(tileDS, [&](float x, float z) { return grid.inCore(iTile, x, z); }, d, candidates);
+}
+
+
+/**
+ * @param tileDS Working data set holding the pre-clusters of a tile and its halo.
+ * @param inCore Function checking whether an (x,z) position is in the tile core.
+ * @param d Half-size of the density window.
+ * @param candidates Seed candidates, appended to.
+ */
+template<class InCore>
+void ClusteringAlg::findSeedCandidates(DataSet &tileDS, const InCore &inCore, float d,
+				       std::vector<Cluster> &candidates) {
+
+  std::vector<Cluster> &preClusters = tileDS.preClusters();
+  countDensities(preClusters, d);
+  std::vector<bool> isLocalMax;
+  findLocalMaxima(preClusters, d, isLocalMax);
+
+  for(unsigned int i=0; i<preClusters.size(); i++) {
+    const Cluster &cli = preClusters[i];
+    if(!isLocalMax[i]) continue;
+    if(!inCore(cli.com().x(), cli.com().z())) continue;
+    Cluster cl;
+    cl.setSeed(cli.com());
+    cl.setDensity(cli.density());
+    candidates.push_back(cl);
+  }
+}
+
+
+/**
+ * @param candidates Seed candidates with unnormalized densities.
+ * @param config Configuration.
+ * @param seeds Selected seeds with normalized densities, appended to.
+ */
+void ClusteringAlg::selectSeeds(const std::vector<Cluster> &candidates, const Config &config,
+				std::vector<Cluster> &seeds) {
+
+  float dmax = 0;
+  for(unsigned int i=0; i<candidates.size(); i++) {
+    if(candidates[i].density() > dmax) dmax = candidates[i].density();
+  }
+
+  float densityTh = config.get("seedDensityThreshold");
+  for(unsigned int i=0; i<candidates.size(); i++) {
+    Cluster cl(candidates[i]);
+    cl.setDensity(cl.density()/dmax);
+    if(cl.density() < densityTh) continue;
+    seeds.push_back(cl);
+  }
+}
+
+
+/**
+ * Pre-clusters are rebuilt exactly as in findTileSeeds(), and those centered in the tile core
+ * are assigned as a whole to the nearest seed.
+ *
+ * @param ds Full data set.
+ * @param grid Tile grid built on the data set points.
+ * @param iTile Tile index.
+ * @param seeds Selected seeds. Must not be empty.
+ * @param config Configuration.
+ * @param assignment Index of the seed per data set point, -1 if not yet assigned.
+ */
+void ClusteringAlg::assignTile(DataSet &ds, const TileGrid &grid, int iTile, const std::vector<Cluster> &seeds,
+			       const Config &config, std::vector<int> &assignment) {
+
+  DataSet tileDS;
+  std::vector<unsigned int> indices;
+  loadTile(ds, grid, iTile, tileDS, indices);
+  if(indices.empty()) return;
+
+  runPreClustering(tileDS, config);
+
+  std::unordered_map<int, unsigned int> pointIndex;
+  for(unsigned int i=0; i<indices.size(); i++) {
+    pointIndex[tileDS.points()[i].id()] = indices[i];
+  }
+
+  const std::vector<Cluster> &preClusters = tileDS.preClusters();
+  for(unsigned int i=0; i<preClusters.size(); i++) {
+    const Cluster &cli = preClusters[i];
+    if(!grid.inCore(iTile, cli.com().x(), cli.com().z())) continue;
+    int icl = findNearestSeed<MetricXZ>(seeds, cli.com());
+    for(unsigned int j=0; j<cli.points().size(); j++) {
+      int &a = assignment[pointIndex[cli.points()[j].id()]];
+      if(a < 0) a = icl;
+    }
+  }
+}
+
+
+/**
+ * Points are added in the data set order. Points left unassigned by all tiles are assigned to the nearest seed.
+ *
+ * @param ds Data set whose clusters hold the seeds.
+ * @param assignment Index of the seed per data set point, -1 if not assigned.
+ */
+void ClusteringAlg::fillClusters(DataSet &ds, std::vector<int> &assignment) {
+
+  const std::vector<CloudPoint> &points = ds.points();
+  std::vector<Cluster> &clusters = ds.clusters();
+  for(unsigned int i=0; i<points.size(); i++) {
+    if(assignment[i] < 0) {
+      assignment[i] = findNearestSeed<MetricXZ>(clusters, points[i]);
+    }
+    clusters[assignment[i]].addPoint(points[i]);
+  }
+}
+
+
+/**
+ * @param ds Full data set.
+ * @param grid Tile grid built on the data set points.
+ * @param iTile Tile index.
+ * @param tileDS Working data set receiving the points.
+ * @param indices Indices in the full data set of the points copied.
+ */
+void ClusteringAlg::loadTile(DataSet &ds, const TileGrid &grid, int iTile, DataSet &tileDS,
+			     std::vector<unsigned int> &indices) {
+
+  grid.tilePoints(iTile, indices);
+  const std::vector<CloudPoint> &points = ds.points();
+  std::vector<CloudPoint> &tilePoints = tileDS.points();
+  tilePoints.reserve(indices.size());
+  for(unsigned int i=0; i<indices.size(); i++) {
+    tilePoints.push_back(points[indices[i]]);
+  }
+}
+
+
+/**
+ * DBSCAN variant of the clustering, which does not depend on a density threshold normalized to the whole field:
+ * - Points with a total weight of at least @c dbscanMinPoints within @c dbscanEps in the (x,z) plane
+ *   are core points. This step runs in parallel.
+ * - Core points within @c dbscanEps of each other are connected into clusters.
+ * - Other points join the cluster of their nearest core point within @c dbscanEps, if any, and are noise otherwise.
+ * - Clusters with a total weight below @c dbscanMinClusterSize are noise.
+ * - Outliers are removed as in the seeded chain, using the cluster center of mass as seed.
+ *
+ * Point counts are given for the full input frame and are scaled by the sampling fraction of the data set.
+ * Neighbors are enumerated from a grid of cells of size @c dbscanEps, so that only the 3x3 cells around
+ * a point are visited.
+ *
+ * @param ds Data set to be clustered.
+ * @param config Configuration.
+ */
+void ClusteringAlg::runDbscanClustering(DataSet &ds, const Config &config) {
+
+  bool verbose = config.get("verbose");
+
+  TStopwatch sw;
+  if(verbose) {
+    sw.Start();
+  }
+
+  float eps = config.get("dbscanEps");
+  float minPoints = config.get("dbscanMinPoints");
+  float minClusterSize = config.get("dbscanMinClusterSize");
+  minPoints *= ds.samplingFraction();
+  minClusterSize *= ds.samplingFraction();
+  int nThreads = threadCount(config);
+
+  const std::vector<CloudPoint> &points = ds.points();
+  TileGrid grid(points, eps, 0);
+
+
+  //
+  // Find core points
+  //
+  std::vector<unsigned char> isCore(points.size(), 0);
+  parallelFor(points.size(), nThreads, [&](unsigned int i) {
+      float weight = 0;
+      forEachNeighbor(grid, points, i, eps, [&](unsigned int j) {
+	  weight += points[j].weight();
+	});
+      isCore[i] = weight >= minPoints;
+    });
+
+
+  //
+  // Connect core points
+  //
+  std::vector<int> labels(points.size(), -1);
+  std::vector<unsigned int> stack;
+  int nLabels = 0;
+  for(unsigned int i=0; i<points.size(); i++) {
+    if(!isCore[i] || labels[i] >= 0) continue;
+    labels[i] = nLabels;
+    stack.push_back(i);
+    while(!stack.empty()) {
+      unsigned int j = stack.back();
+      stack.pop_back();
+      forEachNeighbor(grid, points, j, eps, [&](unsigned int k) {
+	  if(isCore[k] && labels[k] < 0) {
+	    labels[k] = nLabels;
+	    stack.push_back(k);
+	  }
+	});
+    }
+    nLabels++;
+  }
+
+
+  //
+  // Attach border points to their nearest core point
+  //
+  parallelFor(points.size(), nThreads, [&](unsigned int i) {
+      if(isCore[i]) return;
+      float minDistSq = eps*eps;
+      forEachNeighbor(grid, points, i, eps, [&](unsigned int j) {
+	  if(!isCore[j]) return;
+	  float distSq = points[j].distSq<MetricXZ>(points[i]);
+	  if(distSq <= minDistSq) {
+	    minDistSq = distSq;
+	    labels[i] = labels[j];
+	  }
+	});
+    });
+
+
+  //
+  // Build clusters, dropping small ones as noise
+  //
+  std::vector<float> weights(nLabels, 0);
+  for(unsigned int i=0; i<points.size(); i++) {
+    if(labels[i] >= 0) weights[labels[i]] += points[i].weight();
+  }
+  std::vector<int> clusterIndex(nLabels, -1);
+  std::vector<Cluster> &clusters = ds.clusters();
+  float wmax = 0;
+  for(int i=0; i<nLabels; i++) {
+    if(weights[i] < minClusterSize) continue;
+    clusterIndex[i] = clusters.size();
+    clusters.push_back(Cluster());
+    if(weights[i] > wmax) wmax = weights[i];
+  }
+  unsigned int nNoise = 0;
+  for(unsigned int i=0; i<points.size(); i++) {
+    if(labels[i] < 0 || clusterIndex[labels[i]] < 0) {
+      nNoise++;
+      continue;
+    }
+    clusters[clusterIndex[labels[i]]].addPoint(points[i]);
+  }
+  for(unsigned int i=0; i<clusters.size(); i++) {
+    clusters[i].setSeed(clusters[i].com());
+    clusters[i].setDensity(clusters[i].weight()/wmax);
   }
 
+  if(verbose) {
+    sw.Stop();
+    std::cout << std::endl
+	      << "DBSCAN clustering done: " << clusters.size() << " clusters, "
+	      << nNoise << " noise points."
+	      << std::endl;
+    sw.Print("m");
+    sw.Start();
+  }
+
+  if(clusters.empty()) return;
+
+
+  //
+  // Cleanup clusters
+  //
+  cleanupClusters(ds, config);
+
+  if(verbose) {
+    sw.Stop();
+    std::cout << std::endl
+	      << "Cleanup done"
+	      << std::endl;
+    sw.Print("m");
+    sw.Start();
+  }
+}
+
+
+/**
+ * Points are fed to the streaming engine in packets of @c packetSize points, as if they were received
+ * from the sensor. This is used when the frame was read before clustering, for instance after downsampling.
+ *
+ * @param ds Data set to be clustered.
+ * @param config Configuration.
+ */
+void ClusteringAlg::runStreamingClustering(DataSet &ds, const Config &config) {
+
+  bool verbose = config.get("verbose");
+
+  TStopwatch sw;
+  if(verbose) {
+    sw.Start();
+  }
+
+  const std::vector<CloudPoint> &points = ds.points();
+  int packetSize = config.get("packetSize");
+  StreamingClustering stream(config);
+  for(unsigned int begin=0; begin<points.size(); begin+=packetSize) {
+    stream.addPoints(points, begin, std::min<unsigned int>(begin+packetSize, points.size()));
+  }
+  stream.finish(ds);
+
+  if(verbose) {
+    sw.Stop();
+    std::cout << std::endl
+	      << "Streaming clustering done: " << stream.nPackets() << " packets, "
+	      << stream.nCandidates() << " seed candidates, "
+	      << ds.clusters().size() << " clusters."
+	      << std::endl;
+    sw.Print("m");
+    sw.Start();
+  }
+}
+
+
+/**
+ * Only the cells adjacent to the cell of the point are visited, the grid cell size must be at least @c eps.
+ * The point itself is included.
+ *
+ * @param grid Grid built on the points.
+ * @param points Points.
+ * @param i Index of the point.
+ * @param eps Neighborhood radius.
+ * @param f Function called with the index of each neighbor.
+ */
+template<class Function>
+void ClusteringAlg::forEachNeighbor(const TileGrid &grid, const std::vector<CloudPoint> &points,
+				    unsigned int i, float eps, const Function &f) const {
+
+  const CloudPoint &cp = points[i];
+  float epsSq = eps*eps;
+  int iCell = grid.tileIndex(cp.x(), cp.z());
+  int ix = iCell % grid.nx();
+  int iz = iCell / grid.nx();
+  for(int jz=std::max(0, iz-1); jz<=std::min(grid.nz()-1, iz+1); jz++) {
+    for(int jx=std::max(0, ix-1); jx<=std::min(grid.nx()-1, ix+1); jx++) {
+      int jCell = jz*grid.nx() + jx;
+      for(unsigned int k=grid.coreBegin(jCell); k<grid.coreEnd(jCell); k++) {
+	unsigned int j = grid.corePoint(k);
+	if(points[j].distSq<MetricXZ>(cp) <= epsSq) f(j);
+      }
+    }
+  }
 }
@@ -0,0 +1,238 @@
+#include "ColorModel.h"
+
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include "Parallel.h"
+
+ColorModel::ColorModel() :
+  m_moments(0)
+{
+}
+
+ColorModel::~ColorModel()
+{
+}
+
+/**
+ * @param moments Moments of the training features.
+ */
+void ColorModel::train(const PCA::Accumulator &moments)
+{
+  m_moments = moments;
+  m_pca.train(m_moments);
+  projectCentroids();
+}
+
+/**
+ * @param features Mean features of the members of each centroid, nVariables values per centroid.
+ * @param weights Number of members of each centroid.
+ * @param classIds Class index of each centroid.
+ * @param classNames Class names, ordered by class index.
+ */
+void ColorModel::setCentroids(const std::vector<double> &features, const std::vector<double> &weights,
+			      const std::vector<int> &classIds, const std::vector<std::string> &classNames)
+{
+  m_centroidFeatures = features;
+  m_centroidWeights = weights;
+  m_classIds = classIds;
+  m_classNames = classNames;
+  projectCentroids();
+}
+
+/**
+ * The new features are assigned to the centroids of the current model before it is updated.
+ *
+ * @param features Features of the clusters of a new frame.
+ * @param forgetting Weight factor of the previous frames, between 0 and 1.
+ * @param nThreads Number of threads.
+ * @param blockSize Number of rows per block of the moment accumulation. Put 0 to use one block per thread.
+ */
+void ColorModel::update(const FeatureMatrix &features, double forgetting, int nThreads, unsigned int blockSize)
+{
+  if(features.nRows() == 0) return;
+  unsigned int n = m_pca.nVariables();
+
+  std::vector<Point> colors;
+  project(features, colors, nThreads);
+
+
+  //
+  // Mini-batch k-means step
+  //
+  for(unsigned int j=0; j<m_centroidWeights.size(); j++) {
+    m_centroidWeights[j] *= forgetting;
+  }
+  float buffer[3*FeatureMatrix::kMaxLayers];
+  for(unsigned int i=0; i<features.nRows(); i++) {
+    int j = closestCentroid(colors[i]);
+    double *centroid = &m_centroidFeatures[j*n];
+    const float *row = features.row(i, buffer);
+    m_centroidWeights[j] += 1;
+    double step = 1/m_centroidWeights[j];
+    for(unsigned int v=0; v<n; v++) {
+      centroid[v] += step*(row[v] - centroid[v]);
+    }
+  }
+
+
+  //
+  // PCA with exponential forgetting
+  //
+  m_moments.decay(forgetting);
+  m_moments.merge(PCA::accumulate(features, nThreads, blockSize));
+  m_pca.train(m_moments);
+  projectCentroids();
+}
+
+/**
+ * @param features Input features.
+ * @param colors Output 3 leading PCA components, one per row of features.
+ * @param nThreads Number of threads.
+ */
+void ColorModel::project(const FeatureMatrix &features, std::vector<Point> &colors, int nThreads) const
+{
+  std::vector<float> components;
+  m_pca.project(features, 3, components, nThreads);
+
+  colors.clear();
+  colors.reserve(features.nRows());
+  for(unsigned int i=0; i<features.nRows(); i++) {
+    colors.push_back(Point(components[3*i], components[3*i+1], components[3*i+2]));
+  }
+}
+
+/**
+ * @param features Input features.
+ * @param colors Output 3 leading PCA components, one per row of features.
+ * @param classIds Output class index, one per row of features.
+ * @param nThreads Number of threads.
+ */
+void ColorModel::classify(const FeatureMatrix &features, std::vector<Point> &colors,
+			  std::vector<int> &classIds, int nThreads) const
+{
+  project(features, colors, nThreads);
+
+  classIds.resize(colors.size());
+  parallelFor(colors.size(), nThreads, [&](unsigned int i) {
+      classIds[i] = m_classIds[closestCentroid(colors[i])];
+    });
+}
+
+void ColorModel::projectCentroids()
+{
+  unsigned int n = m_pca.nVariables();
+  m_centroids.clear();
+  if(n == 0) return;
+  for(unsigned int j=0; j<m_centroidWeights.size(); j++) {
+    double components[3];
+    m_pca.project(&m_centroidFeatures[j*n], 3, components);
+    m_centroids.push_back(Point(components[0], components[1], components[2]));
+  }
+}
+
+/**
+ * @param color Point of the PCA space.
+ * @return Index of the closest centroid.
+ */
+int ColorModel::closestCentroid(const Point &color) const
+{
+  int jj = 0;
+  float minDist = color.distSq<MetricXYZ>(m_centroids[0]);
+  for(unsigned int j=1; j<m_centroids.size(); j++) {
+    float dist = color.distSq<MetricXYZ>(m_centroids[j]);
+    if(dist < minDist) {
+      minDist = dist;
+      jj = j;
+    }
+  }
+  return jj;
+}
+
+/**
+ * @param fileName Output file.
+ */
+void ColorModel::write(const std::string &fileName) const
+{
+  Header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, "PCCOLOR\0", 8);
+  header.version = 2;
+
+  std::string names;
+  for(unsigned int i=0; i<m_classNames.size(); i++) {
+    names += m_classNames[i];
+    names += '\0';
+  }
+  header.nVariables = m_pca.nVariables();
+  header.nCentroids = m_centroidWeights.size();
+  header.namesSize = names.size();
+
+  std::ofstream ofile(fileName.c_str(), std::ios::out | std::ios::binary);
+  if(!ofile) {
+    throw std::runtime_error("ERROR: could not write color model " + fileName);
+  }
+  ofile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  m_moments.write(ofile);
+  ofile.write(reinterpret_cast<const char*>(&m_centroidFeatures[0]), m_centroidFeatures.size()*sizeof(double));
+  ofile.write(reinterpret_cast<const char*>(&m_centroidWeights[0]), m_centroidWeights.size()*sizeof(double));
+  ofile.write(reinterpret_cast<const char*>(&m_classIds[0]), m_classIds.size()*sizeof(int));
+  ofile.write(names.data(), names.size());
+  if(!ofile) {
+    throw std::runtime_error("ERROR: could not write color model " + fileName);
+  }
+}
+
+/**
+ * @param fileName Input file.
+ */
+void ColorModel::read(const std::string &fileName)
+{
+  std::ifstream ifile(fileName.c_str(), std::ios::in | std::ios::binary);
+  if(!ifile) {
+    throw std::runtime_error("ERROR: could not open color model " + fileName);
+  }
+
+  Header header;
+  ifile.read(reinterpret_cast<char*>(&header), sizeof(header));
+  if(!ifile || memcmp(header.magic, "PCCOLOR\0", 8) != 0 || header.version != 2 ||
+     header.nVariables == 0 || header.nCentroids == 0) {
+    throw std::runtime_error("ERROR: invalid color model " + fileName);
+  }
+
+  unsigned int n = header.nVariables;
+  unsigned int k = header.nCentroids;
+  PCA::Accumulator moments(n);
+  moments.read(ifile, n);
+  std::vector<double> features(k*n);
+  std::vector<double> weights(k);
+  std::vector<int> classIds(k);
+  std::string names(header.namesSize, '\0');
+  ifile.read(reinterpret_cast<char*>(&features[0]), features.size()*sizeof(double));
+  ifile.read(reinterpret_cast<char*>(&weights[0]), weights.size()*sizeof(double));
+  ifile.read(reinterpret_cast<char*>(&classIds[0]), classIds.size()*sizeof(int));
+  ifile.read(&names[0], names.size());
+  if(!ifile) {
+    throw std::runtime_error("ERROR: truncated color model " + fileName);
+  }
+  if(names.empty() || names[names.size()-1] != '\0') {
+    throw std::runtime_error("ERROR: invalid color model " + fileName);
+  }
+
+  std::vector<std::string> classNames;
+  for(size_t pos=0; pos<names.size(); pos=names.find('\0', pos)+1) {
+    classNames.push_back(names.c_str()+pos);
+  }
+  for(unsigned int j=0; j<k; j++) {
+    if(classIds[j] < 0 || classIds[j] >= (int)classNames.size()) {
+      throw std::runtime_error("ERROR: invalid color model " + fileName);
+    }
+  }
+
+  // The centroids of the previous model may not match the new transformation
+  m_centroidFeatures.clear();
+  m_centroidWeights.clear();
+  train(moments);
+  setCentroids(features, weights, classIds, classNames);
+}
@@ -0,0 +1,111 @@
+#include "CompiledBDT.h"
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+#include <dlfcn.h>
+
+#include "Parallel.h"
+
+CompiledBDT::CompiledBDT() :
+  m_handle(0),
+  m_evaluate(0),
+  m_nVariables(0)
+{
+}
+
+CompiledBDT::~CompiledBDT()
+{
+  unload();
+}
+
+/**
+ * A plugin which does not exist is silently ignored.
+ * A plugin which was generated from another model, or by another version of the generator,
+ * is ignored with a warning.
+ *
+ * @param pluginFile Shared library built from the source written by BDTModel::writeSource().
+ * @param modelHash Hash of the current binary model file, see BDTModel::fileHash().
+ * @return @c true if the plugin can be used.
+ */
+bool CompiledBDT::load(const std::string &pluginFile, unsigned long long modelHash)
+{
+  unload();
+
+  m_handle = dlopen(pluginFile.c_str(), RTLD_NOW | RTLD_LOCAL);
+  if(!m_handle) return false;
+
+  typedef unsigned int (*UIntFunction)();
+  typedef unsigned long long (*HashFunction)();
+  typedef const char *(*NameFunction)(unsigned int);
+  UIntFunction version = reinterpret_cast<UIntFunction>(dlsym(m_handle, "bdtPluginVersion"));
+  HashFunction hash = reinterpret_cast<HashFunction>(dlsym(m_handle, "bdtModelHash"));
+  UIntFunction nVariables = reinterpret_cast<UIntFunction>(dlsym(m_handle, "bdtNVariables"));
+  UIntFunction nClasses = reinterpret_cast<UIntFunction>(dlsym(m_handle, "bdtNClasses"));
+  NameFunction className = reinterpret_cast<NameFunction>(dlsym(m_handle, "bdtClassName"));
+  m_evaluate = reinterpret_cast<EvaluateFunction>(dlsym(m_handle, "bdtEvaluate"));
+
+  if(!version || !hash || !nVariables || !nClasses || !className || !m_evaluate ||
+     version() != 1 || hash() != modelHash) {
+    std::cout << "WARNING: ignoring BDT plugin " << pluginFile
+	      << " which does not match the model" << std::endl;
+    unload();
+    return false;
+  }
+
+  m_nVariables = nVariables();
+  for(unsigned int i=0; i<nClasses(); i++) {
+    m_classNames.push_back(className(i));
+  }
+
+  return true;
+}
+
+/**
+ * @param row Input features.
+ * @param outputs Output probabilities, one per class.
+ */
+void CompiledBDT::evaluate(const float *row, float *outputs) const
+{
+  m_evaluate(row, 1, outputs);
+}
+
+/**
+ * Rows are processed in parallel blocks, as in BDTModel::evaluate().
+ *
+ * @param features Input float features, with one column per model variable.
+ * @param outputs Output probabilities, row-major with one row of nClasses() values per input.
+ * @param nThreads Number of threads.
+ */
+void CompiledBDT::evaluate(const FeatureMatrix &features, std::vector<float> &outputs, int nThreads) const
+{
+  if(features.nColumns() != nVariables()) {
+    throw std::runtime_error("ERROR: BDT plugin expects a different number of features");
+  }
+  if(features.storage() != FeatureMatrix::kFloat) {
+    throw std::runtime_error("ERROR: BDT plugin expects float features");
+  }
+
+  const unsigned int blockSize = 64;
+  unsigned int nRows = features.nRows();
+  unsigned int nBlocks = (nRows + blockSize - 1)/blockSize;
+  outputs.resize((size_t)nRows*nClasses());
+
+  parallelFor(nBlocks, nThreads, [&](unsigned int iBlock) {
+      unsigned int begin = iBlock*blockSize;
+      unsigned int n = std::min(blockSize, nRows - begin);
+      m_evaluate(features.row(begin), n, &outputs[(size_t)begin*nClasses()]);
+    });
+}
+
+void CompiledBDT::unload()
+{
+  if(m_handle) {
+    dlclose(m_handle);
+  }
+  m_handle = 0;
+  m_evaluate = 0;
+  m_nVariables = 0;
+  m_classNames.clear();
+}
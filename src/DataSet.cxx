@@ -1,11 +1,16 @@
 #include "DataSet.h"
 
+#include "IngestFilter.h"
+#include "RandomStream.h"
+
+#include <cmath>
 #include <iostream>
 
 /** 
  * Initialize an empty data set.
  */
-DataSet::DataSet()
+DataSet::DataSet() :
+  m_samplingFraction(1)
 {
   m_mins.resize(6);
   m_maxs.resize(6);
@@ -20,20 +25,28 @@ DataSet::~DataSet()
  *  - X, Y, Z: the ​ xyz position of the 3d point  \n
  *  - R, G, B: the ​ rgb component of the color of the 3d point
  * 
- * Data points are split into training and evaluation sets.
- * The ranges (min,max) of the data coordinates is comuted at this stage.
+ * Points are read in packets of @c packetSize points and passed through the ingest filter (see IngestFilter)
+ * before being stored, so that rejected points are never copied into the data sets. \n
+ * Data points are split into training and evaluation sets from their index in the input, whatever the filter.
+ * The ranges (min,max) of the data coordinates is comuted at this stage. \n
+ * After each packet, the callback is called for each data set which received points,
+ * so that processing can start before the end of the input.
  *
  * @param config Configuration.
  * @param trainingData Training data set.
  * @param evaluationData Evaluation data set.
+ * @param onPacket Function called after each packet, if any.
  * @return @c true upon success, @c false upon failure.
  */
 bool DataSet::readFromFile(const Config &config,
 			   DataSet &trainingData,
-			   DataSet &evaluationData) {
+			   DataSet &evaluationData,
+			   const PacketCallback &onPacket) {
 
   std::string fileName = config.get("inputFile");
   float evalFrac = config.get("evaluationDataFraction");
+  int seed = config.get("randomSeed");
+  const RandomStream rng(seed, RandomStream::kDataSplit);
 
   std::ifstream ifile(fileName.c_str(), std::ios::in);
   if(!ifile) {
@@ -41,10 +54,18 @@ bool DataSet::readFromFile(const Config &config,
     return false;
   }
 
+  IngestFilter filter(config);
+
   std::vector<float> mins(6);
   std::vector<float> maxs(6);
 
+  int packetSize = config.get("packetSize");
+  const unsigned int batchSize = packetSize;
+  std::vector<CloudPoint> batch;
+  batch.reserve(batchSize);
+
   bool isFirst = true;
+  unsigned long long nRead = 0;
   while(!ifile.eof()) {
     
     CloudPoint cp;
@@ -52,51 +73,34 @@ bool DataSet::readFromFile(const Config &config,
     
     if(ifile.good()) {
       if(cp.isValid()) {
-	
-	float r = rand() / float(RAND_MAX);
-	if(r < evalFrac) {
-	  evaluationData.m_points.push_back(cp);
-	}else{
-	  trainingData.m_points.push_back(cp);
-	}
-	
-	if(isFirst) {
-	  isFirst = false;
-	  mins[0] = cp.x();
-	  mins[1] = cp.y();
-	  mins[2] = cp.z();
-	  mins[3] = cp.r();
-	  mins[4] = cp.g();
-	  mins[5] = cp.b();
-	  maxs[0] = cp.x();
-	  maxs[1] = cp.y();
-	  maxs[2] = cp.z();
-	  maxs[3] = cp.r();
-	  maxs[4] = cp.g();
-	  maxs[5] = cp.b();
-	}else{
-	  if(mins[0] > cp.x()) mins[0] = cp.x();
-	  if(mins[1] > cp.y()) mins[1] = cp.y();
-	  if(mins[2] > cp.z()) mins[2] = cp.z();
-	  if(mins[3] > cp.r()) mins[3] = cp.r();
-	  if(mins[4] > cp.g()) mins[4] = cp.g();
-	  if(mins[5] > cp.b()) mins[5] = cp.b();
-	  if(maxs[0] < cp.x()) maxs[0] = cp.x();
-	  if(maxs[1] < cp.y()) maxs[1] = cp.y();
-	  if(maxs[2] < cp.z()) maxs[2] = cp.z();
-	  if(maxs[3] < cp.r()) maxs[3] = cp.r();
-	  if(maxs[4] < cp.g()) maxs[4] = cp.g();
-	  if(maxs[5] < cp.b()) maxs[5] = cp.b();
-	}
+	batch.push_back(cp);
       }else{
 	std::cout << "Error: invalid data read: " << cp << std::endl;
 	return false;
       }
     }
+
+    if(batch.size() == batchSize || (!ifile.good() && !batch.empty())) {
+      unsigned int trainingBegin = trainingData.m_points.size();
+      unsigned int evaluationBegin = evaluationData.m_points.size();
+      addPoints(batch, evalFrac, rng, nRead, filter, trainingData, evaluationData, isFirst, mins, maxs);
+      batch.clear();
+
+      if(onPacket) {
+	if(trainingData.m_points.size() > trainingBegin) onPacket(trainingData, trainingBegin);
+	if(evaluationData.m_points.size() > evaluationBegin) onPacket(evaluationData, evaluationBegin);
+      }
+    }
   }
 
   ifile.close();
 
+  if(filter.isActive() && config.get("verbose")) {
+    filter.print(std::cout);
+  }
+
+  trainingData.m_samplingFraction = 1-evalFrac;
+  evaluationData.m_samplingFraction = evalFrac;
   trainingData.m_mins = mins;
   trainingData.m_maxs = maxs;
   evaluationData.m_mins = mins;
@@ -105,6 +109,187 @@ bool DataSet::readFromFile(const Config &config,
   return true;
 }
 
+/**
+ * Points are randomly split into the training and evaluation sets, passed through the ingest filter,
+ * and the coordinates ranges are updated. \n
+ * The split is drawn before filtering, so that the set of a point only depends on its position in the input.
+ *
+ * @param batch Points read from the input, used as buffer.
+ * @param evalFrac Fraction of points to add to the evaluation set.
+ * @param rng Random stream of the split, point @c i of the input uses draw @c i.
+ * @param nRead Number of points read from the input so far, updated.
+ * @param filter Ingest filter.
+ * @param trainingData Training data set.
+ * @param evaluationData Evaluation data set.
+ * @param isFirst Whether no point was added yet, updated.
+ * @param mins Minimum of each coordinate, updated.
+ * @param maxs Maximum of each coordinate, updated.
+ */
+void DataSet::addPoints(std::vector<CloudPoint> &batch, float evalFrac,
+			const RandomStream &rng, unsigned long long &nRead, IngestFilter &filter,
+			DataSet &trainingData, DataSet &evaluationData,
+			bool &isFirst, std::vector<float> &mins, std::vector<float> &maxs) {
+
+  std::vector<double> draws(batch.size());
+  rng.uniform(0, nRead, draws.size(), draws.data());
+  nRead += batch.size();
+
+  std::vector<CloudPoint> evaluationBatch;
+  unsigned int nTraining = 0;
+  for(unsigned int i=0; i<batch.size(); i++) {
+    if(draws[i] < evalFrac) {
+      evaluationBatch.push_back(batch[i]);
+    }else{
+      if(nTraining != i) batch[nTraining] = batch[i];
+      nTraining++;
+    }
+  }
+  batch.erase(batch.begin()+nTraining, batch.end());
+  filter.apply(batch);
+  filter.apply(evaluationBatch);
+  trainingData.m_points.insert(trainingData.m_points.end(), batch.begin(), batch.end());
+  evaluationData.m_points.insert(evaluationData.m_points.end(), evaluationBatch.begin(), evaluationBatch.end());
+
+  for(unsigned int i=0; i<batch.size()+evaluationBatch.size(); i++) {
+
+    const CloudPoint &cp = i < batch.size() ? batch[i] : evaluationBatch[i-batch.size()];
+
+    if(isFirst) {
+      isFirst = false;
+      mins[0] = cp.x();
+      mins[1] = cp.y();
+      mins[2] = cp.z();
+      mins[3] = cp.r();
+      mins[4] = cp.g();
+      mins[5] = cp.b();
+      maxs[0] = cp.x();
+      maxs[1] = cp.y();
+      maxs[2] = cp.z();
+      maxs[3] = cp.r();
+      maxs[4] = cp.g();
+      maxs[5] = cp.b();
+    }else{
+      if(mins[0] > cp.x()) mins[0] = cp.x();
+      if(mins[1] > cp.y()) mins[1] = cp.y();
+      if(mins[2] > cp.z()) mins[2] = cp.z();
+      if(mins[3] > cp.r()) mins[3] = cp.r();
+      if(mins[4] > cp.g()) mins[4] = cp.g();
+      if(mins[5] > cp.b()) mins[5] = cp.b();
+      if(maxs[0] < cp.x()) maxs[0] = cp.x();
+      if(maxs[1] < cp.y()) maxs[1] = cp.y();
+      if(maxs[2] < cp.z()) maxs[2] = cp.z();
+      if(maxs[3] < cp.r()) maxs[3] = cp.r();
+      if(maxs[4] < cp.g()) maxs[4] = cp.g();
+      if(maxs[5] < cp.b()) maxs[5] = cp.b();
+    }
+  }
+}
+
+/**
+ * Each occupied voxel of the (x,y,z) grid is represented by a single point at the centroid of its points,
+ * with their mean color and with a weight equal to their number.
+ * The clustering consumes the weights, so that densities are still expressed in number of input points. \n
+ * The full resolution points remain available, grouped by voxel, see restoreFullResolution().
+ *
+ * @param voxelSize Size of the voxels in unit length.
+ */
+void DataSet::downsample(float voxelSize)
+{
+  if(voxelSize <= 0 || isDownsampled()) return;
+
+  //
+  // Find the voxel of each point, numbering voxels in order of first occurrence
+  //
+  std::unordered_map<long long, int> voxelKeys;
+  std::vector<int> voxels(m_points.size());
+  std::vector<unsigned int> counts;
+  for(unsigned int i=0; i<m_points.size(); i++) {
+    const CloudPoint &cp = m_points[i];
+    long long ix = (long long)std::floor(cp.x()/voxelSize);
+    long long iy = (long long)std::floor(cp.y()/voxelSize);
+    long long iz = (long long)std::floor(cp.z()/voxelSize);
+    long long key = ((ix & 0x1FFFFF) << 42) | ((iy & 0x1FFFFF) << 21) | (iz & 0x1FFFFF);
+    std::unordered_map<long long, int>::iterator itr = voxelKeys.find(key);
+    if(itr == voxelKeys.end()) {
+      itr = voxelKeys.insert(std::make_pair(key, (int)counts.size())).first;
+      counts.push_back(0);
+    }
+    voxels[i] = itr->second;
+    counts[itr->second]++;
+  }
+
+  //
+  // Group full resolution points by voxel
+  //
+  m_voxelOffsets.assign(counts.size()+1, 0);
+  for(unsigned int i=0; i<counts.size(); i++) {
+    m_voxelOffsets[i+1] = m_voxelOffsets[i] + counts[i];
+  }
+  m_fullPoints.resize(m_points.size());
+  std::vector<unsigned int> next(m_voxelOffsets.begin(), m_voxelOffsets.end()-1);
+  for(unsigned int i=0; i<m_points.size(); i++) {
+    m_fullPoints[next[voxels[i]]++] = m_points[i];
+  }
+
+  //
+  // Build one weighted point per voxel
+  //
+  m_points.clear();
+  m_voxelIds.clear();
+  for(unsigned int i=0; i+1<m_voxelOffsets.size(); i++) {
+    double x = 0, y = 0, z = 0;
+    int r = 0, g = 0, b = 0;
+    int n = m_voxelOffsets[i+1] - m_voxelOffsets[i];
+    for(unsigned int j=m_voxelOffsets[i]; j<m_voxelOffsets[i+1]; j++) {
+      const CloudPoint &cp = m_fullPoints[j];
+      x += cp.x();
+      y += cp.y();
+      z += cp.z();
+      r += cp.r();
+      g += cp.g();
+      b += cp.b();
+    }
+    CloudPoint voxel(x/n, y/n, z/n, (r+n/2)/n, (g+n/2)/n, (b+n/2)/n);
+    voxel.setWeight(n);
+    m_voxelIds[voxel.id()] = i;
+    m_points.push_back(voxel);
+  }
+}
+
+/**
+ * Clusters keep their seed, density and class, only their points are replaced.
+ * Classification features are therefore computed from the full resolution data.
+ */
+void DataSet::restoreFullResolution()
+{
+  for(unsigned int i=0; i<m_clusters.size(); i++) {
+    Cluster &cl = m_clusters[i];
+    std::vector<CloudPoint> voxels = cl.points();
+    cl.clearPoints();
+    for(unsigned int j=0; j<voxels.size(); j++) {
+      int iVoxel = voxelIndex(voxels[j]);
+      if(iVoxel < 0) {
+	cl.addPoint(voxels[j]);
+	continue;
+      }
+      for(unsigned int k=voxelBegin(iVoxel); k<voxelEnd(iVoxel); k++) {
+	cl.addPoint(m_fullPoints[k]);
+      }
+    }
+  }
+}
+
+/**
+ * @param cp Point to look up.
+ * @return Voxel index, or -1 if the point is not a voxel of this data set.
+ */
+int DataSet::voxelIndex(const CloudPoint &cp) const
+{
+  std::unordered_map<int, int>::const_iterator itr = m_voxelIds.find(cp.id());
+  if(itr == m_voxelIds.end()) return -1;
+  return itr->second;
+}
+
 /**
  * Returns the absolute minimum of a given coordinate.
  *
@@ -0,0 +1,201 @@
+#include "FeatureMatrix.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <numeric>
+#include <stdexcept>
+
+#include "Parallel.h"
+#include "RandomStream.h"
+
+/**
+ * @param nLayers Number of layers per cluster.
+ * @param storage Storage type of the features.
+ */
+FeatureMatrix::FeatureMatrix(int nLayers, Storage storage) :
+  m_nLayers(nLayers),
+  m_storage(storage),
+  m_tolerance(0),
+  m_maxSamples(0),
+  m_seed(0),
+  m_nRows(0),
+  m_data(0)
+{
+  if(nLayers < 1 || nLayers > kMaxLayers) {
+    throw std::runtime_error("ERROR: invalid number of layers per cluster");
+  }
+}
+
+FeatureMatrix::~FeatureMatrix()
+{
+  free(m_data);
+}
+
+/**
+ * @param name Storage name, "float" or "uint8".
+ * @return Storage type.
+ */
+FeatureMatrix::Storage FeatureMatrix::storageFromName(const std::string &name)
+{
+  if(name == "float") return kFloat;
+  if(name == "uint8") return kUInt8;
+  throw std::runtime_error("ERROR: unknown feature storage " + name);
+}
+
+/**
+ * With @c \-\-featureTolerance above 0, the points of each cluster are sampled until the standard error
+ * of the layer color means falls below it, or until @c \-\-featureMaxSamples points. By default, all points
+ * are used.
+ *
+ * @param config Configuration.
+ */
+void FeatureMatrix::setSampling(const Config &config)
+{
+  m_tolerance = config.get("featureTolerance");
+  m_maxSamples = config.get("featureMaxSamples");
+  m_seed = config.get("randomSeed");
+}
+
+/**
+ * Rows are filled in parallel, each cluster being scanned once (see Cluster::layerFeatures()).
+ * Without point sampling, the features are cached in the clusters (see Cluster::cachedLayerFeatures()),
+ * so that clusters reused from a previous frame are not scanned again.
+ * With point sampling, the points of cluster @c i are visited in the order drawn from element @c i
+ * of the feature sampling stream (see Cluster::sampledLayerFeatures()).
+ * Layers with no points are counted per row and reported once all rows are filled.
+ * The previous content of the matrix is discarded.
+ *
+ * @param clusters Clusters, one per row.
+ * @param nThreads Number of threads.
+ */
+void FeatureMatrix::fill(const std::vector<const Cluster*> &clusters, int nThreads)
+{
+  allocate(clusters.size());
+
+  std::vector<int> nEmpty(m_nRows, 0);
+  if(m_tolerance > 0) {
+    const RandomStream rng(m_seed, RandomStream::kFeatureSampling);
+    parallelFor(m_nRows, nThreads, [&](unsigned int i) {
+	std::vector<int> values(nColumns());
+	nEmpty[i] = clusters[i]->sampledLayerFeatures(m_nLayers, m_tolerance, m_maxSamples, rng, i, &values[0]);
+	if(m_storage == kUInt8) {
+	  std::copy(values.begin(), values.end(), static_cast<unsigned char*>(m_data) + i*nColumns());
+	}else{
+	  std::copy(values.begin(), values.end(), static_cast<float*>(m_data) + i*nColumns());
+	}
+      });
+  }
+  else if(m_storage == kUInt8) {
+    unsigned char *data = static_cast<unsigned char*>(m_data);
+    parallelFor(m_nRows, nThreads, [&](unsigned int i) {
+	const std::vector<int> &values = clusters[i]->cachedLayerFeatures(m_nLayers);
+	std::copy(values.begin(), values.end(), data + i*nColumns());
+	nEmpty[i] = clusters[i]->nEmptyLayers();
+      });
+  }else{
+    float *data = static_cast<float*>(m_data);
+    parallelFor(m_nRows, nThreads, [&](unsigned int i) {
+	const std::vector<int> &values = clusters[i]->cachedLayerFeatures(m_nLayers);
+	std::copy(values.begin(), values.end(), data + i*nColumns());
+	nEmpty[i] = clusters[i]->nEmptyLayers();
+      });
+  }
+  int nEmptyLayers = std::accumulate(nEmpty.begin(), nEmpty.end(), 0);
+  if(nEmptyLayers > 0) std::cout << "WARNING: " << nEmptyLayers << " layers with no points found" << std::endl;
+}
+
+/**
+ * Each sample keeps every point of its cluster with probability @p fraction,
+ * and gets the features of a cluster made of the kept points (see Cluster::layerFeatures()),
+ * without building that cluster: the kept points are only referenced by index.
+ * Sample @c j of cluster @c i is stored in row <tt>i*nSamples+j</tt>, and point @c k is kept
+ * according to draw @c k of element <tt>i*nSamples+j</tt> of the bootstrap stream,
+ * so that the result does not depend on the number of threads.
+ *
+ * @param clusters Clusters to sample.
+ * @param nSamples Number of samples per cluster.
+ * @param fraction Fraction of points per sample.
+ * @param seed Seed of the random streams.
+ * @param nThreads Number of threads.
+ */
+void FeatureMatrix::fillBootstrap(const std::vector<const Cluster*> &clusters, int nSamples, float fraction,
+				  unsigned long long seed, int nThreads)
+{
+  allocate(clusters.size()*nSamples);
+  const RandomStream rng(seed, RandomStream::kBootstrap);
+
+  std::vector<int> nEmpty(m_nRows, 0);
+  parallelFor(m_nRows, nThreads, [&](unsigned int iRow) {
+      const std::vector<CloudPoint> &points = clusters[iRow/nSamples]->points();
+
+      //
+      // Select points
+      //
+      std::vector<double> draws(points.size());
+      rng.uniform(iRow, 0, draws.size(), draws.data());
+      std::vector<unsigned int> selected;
+      selected.reserve(fraction*points.size() + 1);
+      float ymax = 0;
+      for(unsigned int j=0; j<points.size(); j++) {
+	if(draws[j] < fraction) {
+	  selected.push_back(j);
+	  if(points[j].y() > ymax) ymax = points[j].y();
+	}
+      }
+
+      //
+      // Average colors per layer
+      //
+      std::vector<int> sums(3*m_nLayers, 0);
+      std::vector<int> nPointsPerLayer(m_nLayers, 0);
+      for(unsigned int j=0; j<selected.size(); j++) {
+	const CloudPoint &p = points[selected[j]];
+	int iLayer = (int)(m_nLayers*p.y()/ymax);
+	if(iLayer >= m_nLayers) iLayer = m_nLayers-1;
+	sums[3*iLayer+0] += p.r();
+	sums[3*iLayer+1] += p.g();
+	sums[3*iLayer+2] += p.b();
+	nPointsPerLayer[iLayer]++;
+      }
+
+      for(int k=0; k<m_nLayers; k++) {
+	int n = nPointsPerLayer[k];
+	if(n == 0) {
+	  nEmpty[iRow]++;
+	  n = 1;
+	}
+	sums[3*k+0] /= n;
+	sums[3*k+1] /= n;
+	sums[3*k+2] /= n;
+      }
+      if(m_storage == kUInt8) {
+	std::copy(sums.begin(), sums.end(), static_cast<unsigned char*>(m_data) + iRow*nColumns());
+      }else{
+	std::copy(sums.begin(), sums.end(), static_cast<float*>(m_data) + iRow*nColumns());
+      }
+    });
+  int nEmptyLayers = std::accumulate(nEmpty.begin(), nEmpty.end(), 0);
+  if(nEmptyLayers > 0) std::cout << "WARNING: " << nEmptyLayers << " layers with no points found" << std::endl;
+}
+
+/**
+ * The previous content of the matrix is discarded.
+ * The storage is aligned on a cache line.
+ *
+ * @param nRows Number of rows.
+ */
+void FeatureMatrix::allocate(unsigned int nRows)
+{
+  free(m_data);
+  m_data = 0;
+  m_nRows = nRows;
+
+  size_t size = memorySize();
+  if(size == 0) return;
+  if(posix_memalign(&m_data, 64, size) != 0) {
+    m_data = 0;
+    throw std::bad_alloc();
+  }
+}
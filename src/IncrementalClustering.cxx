@@ -0,0 +1,200 @@
+#include "IncrementalClustering.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "ClusteringAlg.h"
+
+/**
+ * The cell size defaults to the density window.
+ * The margin around changed cells covers the density window and the pre-clustering size.
+ *
+ * @param config Configuration.
+ */
+IncrementalClustering::IncrementalClustering(const Config &config) :
+  m_config(config),
+  m_dmax(0),
+  m_nFrames(0),
+  m_dirtyFraction(0),
+  m_reclusteredFraction(0),
+  m_nReused(0)
+{
+  float d = config.get("densityWindow");
+  float dmin = config.get("preClusteringSize");
+  m_cellSize = config.get("dirtyCellSize");
+  if(m_cellSize <= 0) m_cellSize = d;
+  m_tolerance = config.get("dirtyTolerance");
+  m_margin = int(ceil((d+dmin)/m_cellSize));
+}
+
+IncrementalClustering::~IncrementalClustering()
+{
+}
+
+/**
+ * @param x x position.
+ * @param z z position.
+ * @return Cell key.
+ */
+long long IncrementalClustering::cellKey(float x, float z) const
+{
+  return cellKey(int(floor(x/m_cellSize)), int(floor(z/m_cellSize)));
+}
+
+/**
+ * @param ix Cell index along x.
+ * @param iz Cell index along z.
+ * @return Cell key.
+ */
+long long IncrementalClustering::cellKey(int ix, int iz)
+{
+  return ((long long)ix << 32) | (unsigned int)iz;
+}
+
+/**
+ * @param key Key of the changed cell.
+ * @param dirty Dirty cells, updated.
+ */
+void IncrementalClustering::markDirty(long long key, std::unordered_set<long long> &dirty) const
+{
+  int ix = key >> 32;
+  int iz = (int)(key & 0xffffffff);
+  for(int jx=ix-m_margin; jx<=ix+m_margin; jx++) {
+    for(int jz=iz-m_margin; jz<=iz+m_margin; jz++) {
+      dirty.insert(cellKey(jx, jz));
+    }
+  }
+}
+
+/**
+ * The first frame is fully clustered. For the following frames:
+ * - A cell is changed if its count differs from the previous frame by more than @c dirtyTolerance
+ *   standard deviations of the difference of two Poisson counts.
+ * - Clusters of the previous frame with a core point in the dirty region extend it to the cells of all
+ *   their points, until no other cluster is reached. The other clusters are copied to the data set.
+ * - The points of the dirty region, outside the cells holding core points of reused clusters,
+ *   are clustered with the in-memory chain. Densities are normalized
+ *   to at least the maximum seed density of the reused clusters, so that the seed threshold keeps
+ *   referring to the whole field.
+ *
+ * Reused clusters keep the points of the frame they were built from. Their densities are kept unnormalized
+ * between frames, and normalized to the maximum density of each frame.
+ * The layer features of the new cluster cores, as consumed by FeatureMatrix::fill(), are computed before
+ * the clusters are kept, so that the classification of the next frames does not scan the reused clusters again.
+ * Features sampled with @c \-\-featureTolerance depend on the row of the cluster and are not cached.
+ *
+ * @param ds Data set of the frame, with no clusters.
+ */
+void IncrementalClustering::processFrame(DataSet &ds)
+{
+
+  const std::vector<CloudPoint> &points = ds.points();
+  bool isFirst = m_nFrames == 0;
+
+  //
+  // Count points per cell and find the dirty region
+  //
+  std::unordered_map<long long, float> counts;
+  for(unsigned int i=0; i<points.size(); i++) {
+    counts[cellKey(points[i].x(), points[i].z())] += points[i].weight();
+  }
+
+  std::unordered_set<long long> dirty;
+  if(!isFirst) {
+    for(std::unordered_map<long long, float>::const_iterator itr=counts.begin(); itr!=counts.end(); itr++) {
+      std::unordered_map<long long, float>::const_iterator prev = m_counts.find(itr->first);
+      float n = itr->second;
+      float nPrev = prev != m_counts.end() ? prev->second : 0;
+      if(fabs(n-nPrev) > m_tolerance*sqrt(n+nPrev)) markDirty(itr->first, dirty);
+    }
+    for(std::unordered_map<long long, float>::const_iterator itr=m_counts.begin(); itr!=m_counts.end(); itr++) {
+      if(counts.find(itr->first) != counts.end()) continue;
+      if(itr->second > m_tolerance*sqrt(itr->second)) markDirty(itr->first, dirty);
+    }
+  }
+
+
+  //
+  // Reuse the clusters of the previous frame outside the dirty region
+  //
+  // A cluster with a core point in the dirty region is clustered again with all its points,
+  // which may in turn reach the core of another cluster
+  std::vector<bool> isReused(m_clusters.size(), true);
+  bool isGrown = true;
+  while(isGrown) {
+    isGrown = false;
+    for(unsigned int i=0; i<m_clusters.size(); i++) {
+      if(!isReused[i]) continue;
+      const std::vector<CloudPoint> &corePoints = m_clusters[i].core().points();
+      bool isClean = true;
+      for(unsigned int j=0; j<corePoints.size() && isClean; j++) {
+	if(dirty.count(cellKey(corePoints[j].x(), corePoints[j].z()))) isClean = false;
+      }
+      if(isClean) continue;
+      isReused[i] = false;
+      isGrown = true;
+      const std::vector<CloudPoint> &clusterPoints = m_clusters[i].points();
+      for(unsigned int j=0; j<clusterPoints.size(); j++) {
+	dirty.insert(cellKey(clusterPoints[j].x(), clusterPoints[j].z()));
+      }
+    }
+  }
+
+  std::vector<Cluster> &clusters = ds.clusters();
+  std::unordered_set<long long> reusedCells;
+  float dmaxMin = 0;
+  m_nReused = 0;
+  for(unsigned int i=0; i<m_clusters.size(); i++) {
+    if(!isReused[i]) continue;
+    const Cluster &cl = m_clusters[i];
+    const std::vector<CloudPoint> &corePoints = cl.core().points();
+    for(unsigned int j=0; j<corePoints.size(); j++) {
+      reusedCells.insert(cellKey(corePoints[j].x(), corePoints[j].z()));
+    }
+    clusters.push_back(cl);
+    dmaxMin = std::max(dmaxMin, cl.density());
+    m_nReused++;
+  }
+
+
+  //
+  // Cluster the dirty region again, leaving out the cells covered by reused clusters
+  //
+  DataSet region;
+  for(unsigned int i=0; i<points.size(); i++) {
+    long long key = cellKey(points[i].x(), points[i].z());
+    if(isFirst || (dirty.count(key) && !reusedCells.count(key))) {
+      region.points().push_back(points[i]);
+    }
+  }
+  ClusteringAlg clAlg;
+  m_dmax = clAlg.runRegionClustering(region, m_config, dmaxMin);
+  for(unsigned int i=0; i<clusters.size(); i++) {
+    clusters[i].setDensity(clusters[i].density()/m_dmax);
+  }
+  int nLayers = m_config.get("nLayersPerCluster");
+  float featureTolerance = m_config.get("featureTolerance");
+  const std::vector<Cluster> &regionClusters = region.clusters();
+  for(unsigned int i=0; i<regionClusters.size(); i++) {
+    if(featureTolerance <= 0) regionClusters[i].core().cachedLayerFeatures(nLayers);
+    clusters.push_back(regionClusters[i]);
+  }
+
+
+  //
+  // Keep the state for the next frame
+  //
+  unsigned int nDirty = 0;
+  for(std::unordered_map<long long, float>::const_iterator itr=counts.begin(); itr!=counts.end(); itr++) {
+    if(isFirst || dirty.count(itr->first)) nDirty++;
+  }
+  m_dirtyFraction = counts.empty() ? 0 : float(nDirty)/counts.size();
+  m_reclusteredFraction = points.empty() ? 0 : float(region.points().size())/points.size();
+
+  m_counts.swap(counts);
+  std::vector<Cluster>(clusters).swap(m_clusters);
+  for(unsigned int i=0; i<m_clusters.size(); i++) {
+    m_clusters[i].setDensity(m_clusters[i].density()*m_dmax);
+  }
+  m_nFrames++;
+}
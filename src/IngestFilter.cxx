@@ -0,0 +1,180 @@
+#include "IngestFilter.h"
+
+#include <sstream>
+#include <stdexcept>
+
+/**
+ * Selections set to "None" are disabled.
+ *
+ * @param config Configuration.
+ */
+IngestFilter::IngestFilter(const Config &config) :
+  m_hasPolygon(false),
+  m_hasMinHeight(false),
+  m_hasMaxHeight(false),
+  m_minHeight(0),
+  m_maxHeight(0),
+  m_floorHeight(0),
+  m_floorTolerance(0),
+  m_nInput(0),
+  m_nOutsideField(0),
+  m_nOutsideHeight(0),
+  m_nFloor(0)
+{
+  std::string polygon = config.get("fieldPolygon");
+  if(polygon != "None" && !parsePolygon(polygon)) {
+    throw std::runtime_error("ERROR: Invalid field polygon "+polygon);
+  }
+
+  std::string minHeight = config.get("minHeight");
+  if(minHeight != "None") {
+    m_hasMinHeight = true;
+    m_minHeight = config.get("minHeight");
+  }
+
+  std::string maxHeight = config.get("maxHeight");
+  if(maxHeight != "None") {
+    m_hasMaxHeight = true;
+    m_maxHeight = config.get("maxHeight");
+  }
+
+  m_floorHeight = config.get("floorHeight");
+  m_floorTolerance = config.get("floorTolerance");
+}
+
+IngestFilter::~IngestFilter()
+{
+}
+
+/**
+ * The relative order of the kept points is preserved.
+ *
+ * @param batch Points to filter, modified in place.
+ */
+void IngestFilter::apply(std::vector<CloudPoint> &batch)
+{
+  int n = batch.size();
+  m_nInput += n;
+  if(!isActive() || n == 0) return;
+
+  m_x.resize(n);
+  m_y.resize(n);
+  m_z.resize(n);
+  m_inField.assign(n, 1);
+  m_inBand.assign(n, 1);
+  m_offFloor.assign(n, 1);
+  for(int i=0; i<n; i++) {
+    m_x[i] = batch[i].x();
+    m_y[i] = batch[i].y();
+    m_z[i] = batch[i].z();
+  }
+  const float *x = &m_x[0];
+  const float *y = &m_y[0];
+  const float *z = &m_z[0];
+
+  //
+  // Field polygon: even-odd rule, one pass over the batch per edge
+  //
+  if(m_hasPolygon) {
+    unsigned char *inField = &m_inField[0];
+    for(int i=0; i<n; i++) inField[i] = 0;
+    int nVertices = m_polyX.size();
+    for(int e=0; e<nVertices; e++) {
+      float x1 = m_polyX[e];
+      float z1 = m_polyZ[e];
+      float x2 = m_polyX[(e+1)%nVertices];
+      float z2 = m_polyZ[(e+1)%nVertices];
+      if(z1 == z2) continue;
+      float slope = (x2-x1)/(z2-z1);
+      for(int i=0; i<n; i++) {
+	bool straddles = (z1 > z[i]) != (z2 > z[i]);
+	bool left = x[i] < x1 + slope*(z[i]-z1);
+	inField[i] ^= (unsigned char)(straddles & left);
+      }
+    }
+  }
+
+  //
+  // Height band
+  //
+  if(m_hasMinHeight || m_hasMaxHeight) {
+    unsigned char *inBand = &m_inBand[0];
+    float lo = m_minHeight;
+    float hi = m_maxHeight;
+    bool hasLo = m_hasMinHeight;
+    bool hasHi = m_hasMaxHeight;
+    for(int i=0; i<n; i++) {
+      inBand[i] = (unsigned char)((!hasLo | (y[i] >= lo)) & (!hasHi | (y[i] <= hi)));
+    }
+  }
+
+  //
+  // Floor plane
+  //
+  if(m_floorTolerance > 0) {
+    unsigned char *offFloor = &m_offFloor[0];
+    float floorHeight = m_floorHeight;
+    float tolerance = m_floorTolerance;
+    for(int i=0; i<n; i++) {
+      float dy = y[i] - floorHeight;
+      offFloor[i] = (unsigned char)((dy > tolerance) | (dy < -tolerance));
+    }
+  }
+
+  //
+  // Compact the batch
+  //
+  int nKept = 0;
+  for(int i=0; i<n; i++) {
+    if(!m_inField[i]) {
+      m_nOutsideField++;
+    }else if(!m_inBand[i]) {
+      m_nOutsideHeight++;
+    }else if(!m_offFloor[i]) {
+      m_nFloor++;
+    }else{
+      if(nKept != i) batch[nKept] = batch[i];
+      nKept++;
+    }
+  }
+  batch.erase(batch.begin()+nKept, batch.end());
+}
+
+/**
+ * A point failing several selections is counted once, under the first failing selection
+ * in the order: field, height band, floor.
+ *
+ * @param out Output stream.
+ */
+void IngestFilter::print(std::ostream &out) const
+{
+  out << "Ingest filter: " << nDropped() << " out of " << m_nInput << " points dropped ("
+      << m_nOutsideField << " outside the field, "
+      << m_nOutsideHeight << " outside the height band, "
+      << m_nFloor << " on the floor)."
+      << std::endl;
+}
+
+/**
+ * @param str Polygon vertices in the (x,z) plane.
+ * @return @c true upon success, @c false if the polygon is malformed or has less than 3 vertices.
+ */
+bool IngestFilter::parsePolygon(const std::string &str)
+{
+  m_polyX.clear();
+  m_polyZ.clear();
+
+  std::istringstream vertices(str);
+  std::string vertex;
+  while(std::getline(vertices, vertex, ';')) {
+    std::istringstream coordinates(vertex);
+    float x, z;
+    char comma;
+    if(!(coordinates >> x >> comma >> z) || comma != ',') return false;
+    m_polyX.push_back(x);
+    m_polyZ.push_back(z);
+  }
+
+  m_hasPolygon = m_polyX.size() >= 3;
+  return m_hasPolygon;
+}
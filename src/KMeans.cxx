@@ -0,0 +1,334 @@
+#include "KMeans.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include "Parallel.h"
+#include "RandomStream.h"
+
+/**
+ * @param config Configuration.
+ */
+KMeans::KMeans(const Config &config) :
+  m_k(0),
+  m_inertia(0)
+{
+  m_seed = config.get("randomSeed");
+  m_nIterationsMax = config.get("maxKmeansIterations");
+  m_nRestarts = config.get("kmeansRestarts");
+  int coresetSize = config.get("kmeansCoresetSize");
+  m_coresetSize = coresetSize > 0 ? coresetSize : 0;
+  m_nThreads = threadCount(config);
+  m_blockSize = reductionBlockSize(config);
+
+  if(m_nRestarts < 1) {
+    throw std::runtime_error("ERROR: the number of k-means restarts must be positive");
+  }
+}
+
+KMeans::~KMeans()
+{
+}
+
+/**
+ * @param k Number of centroids.
+ * @param points Input points.
+ * @return Number of iterations of the kept run.
+ */
+int KMeans::fit(int k, const std::vector<Point> &points)
+{
+  if(k < 1 || (unsigned int)k > points.size()) {
+    throw std::runtime_error("ERROR: not enough points for k-means");
+  }
+  m_k = k;
+
+  std::vector<double> coords(3*points.size());
+  for(unsigned int i=0; i<points.size(); i++) {
+    coords[3*i+0] = points[i].x();
+    coords[3*i+1] = points[i].y();
+    coords[3*i+2] = points[i].z();
+  }
+  std::vector<double> weights(points.size(), 1.);
+  if(m_coresetSize > 0 && m_coresetSize < points.size()) {
+    std::vector<double> coreset;
+    sampleCoreset(coords, coreset, weights);
+    coords.swap(coreset);
+  }
+
+
+  //
+  // Independent runs, in parallel
+  //
+  int nParallelRuns = std::min(m_nRestarts, m_nThreads);
+  int nThreadsPerRun = std::max(1, m_nThreads/m_nRestarts);
+  std::vector<std::vector<double> > centroids(m_nRestarts);
+  std::vector<double> inertias(m_nRestarts);
+  std::vector<int> nIterations(m_nRestarts);
+  parallelFor(m_nRestarts, nParallelRuns, [&](unsigned int iRestart) {
+      nIterations[iRestart] = run(iRestart, coords, weights, nThreadsPerRun,
+				  centroids[iRestart], inertias[iRestart]);
+    });
+
+  int best = 0;
+  for(int i=1; i<m_nRestarts; i++) {
+    if(inertias[i] < inertias[best]) best = i;
+  }
+  m_inertia = inertias[best];
+
+
+  //
+  // Sort centroids by coordinates
+  //
+  std::vector<int> order(k);
+  for(int j=0; j<k; j++) {
+    order[j] = j;
+  }
+  const std::vector<double> &bestCentroids = centroids[best];
+  std::sort(order.begin(), order.end(), [&](int a, int b) {
+      return std::lexicographical_compare(&bestCentroids[3*a], &bestCentroids[3*a+3],
+					  &bestCentroids[3*b], &bestCentroids[3*b+3]);
+    });
+  m_centroids.clear();
+  for(int j=0; j<k; j++) {
+    const double *c = &bestCentroids[3*order[j]];
+    m_centroids.push_back(Point(c[0], c[1], c[2]));
+  }
+
+  return nIterations[best];
+}
+
+/**
+ * @param points Input points.
+ * @param assignments Output index of the closest centroid of each point.
+ */
+void KMeans::assign(const std::vector<Point> &points, std::vector<int> &assignments) const
+{
+  assignments.resize(points.size());
+  parallelFor(points.size(), m_nThreads, [&](unsigned int i) {
+      int jj = 0;
+      float minDist = points[i].distSq<MetricXYZ>(m_centroids[0]);
+      for(unsigned int j=1; j<m_centroids.size(); j++) {
+	float dist = points[i].distSq<MetricXYZ>(m_centroids[j]);
+	if(dist < minDist) {
+	  minDist = dist;
+	  jj = j;
+	}
+      }
+      assignments[i] = jj;
+    });
+}
+
+/**
+ * Converges when no centroid moves by more than sqrt(0.001).
+ * The centroid sums use a parallel reduction, so that the result does not depend on the number of threads
+ * in deterministic mode.
+ *
+ * @param iRestart Index of the run.
+ * @param coords Point coordinates, 3 per point.
+ * @param weights Point weights.
+ * @param nThreads Number of threads.
+ * @param centroids Output centroid coordinates, 3 per centroid.
+ * @param inertia Output weighted sum of squared distances to the centroids.
+ * @return Number of iterations.
+ */
+int KMeans::run(unsigned int iRestart, const std::vector<double> &coords, const std::vector<double> &weights,
+		int nThreads, std::vector<double> &centroids, double &inertia) const
+{
+
+  unsigned int n = weights.size();
+  int k = m_k;
+  seed(iRestart, coords, weights, centroids);
+
+  std::vector<int> assignments(n);
+  std::vector<double> upper(n);
+  std::vector<double> lower(n);
+  auto assignPoint = [&](unsigned int i) {
+    double best = HUGE_VAL;
+    double second = HUGE_VAL;
+    for(int j=0; j<k; j++) {
+      double dist = distSq(&coords[3*i], &centroids[3*j]);
+      if(dist < best) {
+	second = best;
+	best = dist;
+	assignments[i] = j;
+      }else if(dist < second) {
+	second = dist;
+      }
+    }
+    upper[i] = sqrt(best);
+    lower[i] = sqrt(second);
+  };
+  parallelFor(n, nThreads, assignPoint);
+
+  auto sumPoints = [&](unsigned int begin, unsigned int end) {
+    std::vector<double> sums(4*k, 0.);
+    for(unsigned int i=begin; i<end; i++) {
+      double *sum = &sums[4*assignments[i]];
+      sum[0] += weights[i]*coords[3*i+0];
+      sum[1] += weights[i]*coords[3*i+1];
+      sum[2] += weights[i]*coords[3*i+2];
+      sum[3] += weights[i];
+    }
+    return sums;
+  };
+  auto addSums = [](const std::vector<double> &a, const std::vector<double> &b) {
+    std::vector<double> sums(a);
+    for(unsigned int i=0; i<sums.size(); i++) {
+      sums[i] += b[i];
+    }
+    return sums;
+  };
+
+  std::vector<double> shifts(k);
+  std::vector<double> halfGaps(k);
+  int nIterations = 0;
+  while(nIterations < m_nIterationsMax) {
+
+    // Update step, empty clusters keep their centroid
+    std::vector<double> sums = parallelReduce(n, nThreads, m_blockSize, std::vector<double>(4*k, 0.),
+					      sumPoints, addSums);
+    bool converged = true;
+    for(int j=0; j<k; j++) {
+      double *c = &centroids[3*j];
+      const double *sum = &sums[4*j];
+      shifts[j] = 0;
+      if(sum[3] <= 0) continue;
+      double newCentroid[3] = {sum[0]/sum[3], sum[1]/sum[3], sum[2]/sum[3]};
+      double shift = distSq(c, newCentroid);
+      if(shift > 0.001) converged = false;
+      shifts[j] = sqrt(shift);
+      std::copy(newCentroid, newCentroid+3, c);
+    }
+    nIterations++;
+    if(converged) break;
+
+    // Bounds update
+    int iMaxShift = std::max_element(shifts.begin(), shifts.end()) - shifts.begin();
+    double maxShift = shifts[iMaxShift];
+    double secondShift = 0;
+    for(int j=0; j<k; j++) {
+      if(j != iMaxShift) secondShift = std::max(secondShift, shifts[j]);
+    }
+    for(int j=0; j<k; j++) {
+      halfGaps[j] = HUGE_VAL;
+      for(int jj=0; jj<k; jj++) {
+	if(jj != j) halfGaps[j] = std::min(halfGaps[j], 0.5*sqrt(distSq(&centroids[3*j], &centroids[3*jj])));
+      }
+    }
+
+    // Assignment step, skipping points whose bounds prove that their centroid is unchanged
+    parallelFor(n, nThreads, [&](unsigned int i) {
+	int a = assignments[i];
+	upper[i] += shifts[a];
+	lower[i] -= a == iMaxShift ? secondShift : maxShift;
+	double bound = std::max(halfGaps[a], lower[i]);
+	if(upper[i] <= bound) return;
+	upper[i] = sqrt(distSq(&coords[3*i], &centroids[3*a]));
+	if(upper[i] <= bound) return;
+	assignPoint(i);
+      });
+  }
+
+  inertia = 0;
+  for(unsigned int i=0; i<n; i++) {
+    double best = HUGE_VAL;
+    for(int j=0; j<k; j++) {
+      best = std::min(best, distSq(&coords[3*i], &centroids[3*j]));
+    }
+    inertia += weights[i]*best;
+  }
+
+  return nIterations;
+}
+
+/**
+ * @param iRestart Index of the run, selecting its random numbers.
+ * @param coords Point coordinates, 3 per point.
+ * @param weights Point weights.
+ * @param centroids Output centroid coordinates, 3 per centroid.
+ */
+void KMeans::seed(unsigned int iRestart, const std::vector<double> &coords, const std::vector<double> &weights,
+		  std::vector<double> &centroids) const
+{
+  const RandomStream rng(m_seed, RandomStream::kKmeansSeeding);
+  unsigned long long iDraw = 0;
+  unsigned int n = weights.size();
+
+  // Squared distance of each point to the closest chosen centroid
+  std::vector<double> distances(n, 1.);
+  centroids.resize(3*m_k);
+  for(int j=0; j<m_k; j++) {
+
+    // Once all points coincide with a centroid, draw them by weight only
+    double total = 0;
+    for(unsigned int i=0; i<n; i++) {
+      total += weights[i]*distances[i];
+    }
+    bool useDistances = total > 0;
+    if(!useDistances) {
+      for(unsigned int i=0; i<n; i++) {
+	total += weights[i];
+      }
+    }
+    double target = total*rng.uniform(iRestart, iDraw++);
+
+    unsigned int iChosen = n-1;
+    double cumulative = 0;
+    for(unsigned int i=0; i<n; i++) {
+      cumulative += useDistances ? weights[i]*distances[i] : weights[i];
+      if(cumulative > target) {
+	iChosen = i;
+	break;
+      }
+    }
+
+    std::copy(&coords[3*iChosen], &coords[3*iChosen+3], &centroids[3*j]);
+    for(unsigned int i=0; i<n; i++) {
+      distances[i] = j == 0 ? distSq(&coords[3*i], &centroids[0])
+	: std::min(distances[i], distSq(&coords[3*i], &centroids[3*j]));
+    }
+  }
+}
+
+/**
+ * @param coords Point coordinates, 3 per point.
+ * @param coreset Output coordinates of the coreset points, 3 per point.
+ * @param weights Output weights of the coreset points.
+ */
+void KMeans::sampleCoreset(const std::vector<double> &coords, std::vector<double> &coreset,
+			   std::vector<double> &weights) const
+{
+  unsigned int n = coords.size()/3;
+  unsigned int m = m_coresetSize;
+
+  double mean[3] = {0, 0, 0};
+  for(unsigned int i=0; i<n; i++) {
+    for(int c=0; c<3; c++) {
+      mean[c] += coords[3*i+c]/n;
+    }
+  }
+  std::vector<double> cumulative(n);
+  double totalDistance = 0;
+  for(unsigned int i=0; i<n; i++) {
+    totalDistance += distSq(&coords[3*i], mean);
+  }
+  double sum = 0;
+  for(unsigned int i=0; i<n; i++) {
+    double distance = distSq(&coords[3*i], mean);
+    sum += 0.5/n + (totalDistance > 0 ? 0.5*distance/totalDistance : 0.5/n);
+    cumulative[i] = sum;
+  }
+
+  const RandomStream rng(m_seed, RandomStream::kCoreset);
+  coreset.resize(3*m);
+  weights.resize(m);
+  for(unsigned int s=0; s<m; s++) {
+    double u = rng.uniform(s, 0)*cumulative[n-1];
+    unsigned int i = std::upper_bound(cumulative.begin(), cumulative.end(), u) - cumulative.begin();
+    if(i >= n) i = n-1;
+    double probability = cumulative[i] - (i > 0 ? cumulative[i-1] : 0);
+    std::copy(&coords[3*i], &coords[3*i+3], &coreset[3*s]);
+    weights[s] = 1/(m*probability);
+  }
+}
@@ -0,0 +1,262 @@
+#include "Options.h"
+
+/**
+ * @addtogroup CloudPoints
+ *
+ * @{
+ */
+
+/** 
+ * @brief Prase command line arguments.
+ *
+ * @param config Configuration to parse into.
+ * @param argc Number of command line arguments.
+ * @param argv Array of command line arguments.
+ *
+ * #### Configuration details: 
+ */
+void parseCommandLine(Config &config, int argc, char **argv)
+{
+
+  optparse::OptionParser parser = optparse::OptionParser().description("Point Cloud Analysis");
+
+  /** - @b -v, <b> \-\-verbose </b> Turns ON verbose mode. */
+  parser.add_option("-v", "--verbose").action("store_true").dest("verbose").set_default(false)
+    .help("Turns ON verbose mode.");
+
+  /** - @b -i, <b> \-\-inputFile </b> Name of the data input file.*/
+  parser.add_option("-i", "--inputFile").action("store").dest("inputFile").set_default("./share/point_cloud_data.txt")
+    .help("Name of the data input file.");
+
+  /** - @b -f, <b> \-\-evaluationDataFraction </b> Fraction of data to use for evaluation. */
+  parser.add_option("-f", "--evaluationDataFraction").action("store").dest("evaluationDataFraction").set_default(0.2)
+    .help("Fraction of data to use for evaluation.");
+
+  /** - <b> \-\-fieldPolygon </b> Field polygon in the (x,z) plane as "x1,z1;x2,z2;...". Points outside are dropped at ingest. Put "None" to keep all points. */
+  parser.add_option("--fieldPolygon").action("store").dest("fieldPolygon").set_default("None")
+    .help("Field polygon in the (x,z) plane as \"x1,z1;x2,z2;...\". Points outside are dropped at ingest. Put \"None\" to keep all points.");
+
+  /** - <b> \-\-minHeight </b> Minimum point height y kept at ingest. Put "None" for no minimum. */
+  parser.add_option("--minHeight").action("store").dest("minHeight").set_default("None")
+    .help("Minimum point height y kept at ingest. Put \"None\" for no minimum.");
+
+  /** - <b> \-\-maxHeight </b> Maximum point height y kept at ingest. Put "None" for no maximum. */
+  parser.add_option("--maxHeight").action("store").dest("maxHeight").set_default("None")
+    .help("Maximum point height y kept at ingest. Put \"None\" for no maximum.");
+
+  /** - <b> \-\-floorHeight </b> Height y of the floor plane. */
+  parser.add_option("--floorHeight").action("store").dest("floorHeight").set_default(0)
+    .help("Height y of the floor plane.");
+
+  /** - <b> \-\-floorTolerance </b> Points within this distance of the floor plane are dropped at ingest. Put 0 to keep them. */
+  parser.add_option("--floorTolerance").action("store").dest("floorTolerance").set_default(0)
+    .help("Points within this distance of the floor plane are dropped at ingest. Put 0 to keep them.");
+
+  /** - <b> \-\-voxelSize </b> Size of the voxels for downsampling before clustering. Put 0 to skip downsampling. */
+  parser.add_option("--voxelSize").action("store").dest("voxelSize").set_default(0)
+    .help("Size of the voxels for downsampling before clustering. Put 0 to skip downsampling.");
+
+  /** - <b> \-\-nThreads </b> Number of threads for parallel algorithms. Put 0 to use all hardware threads. */
+  parser.add_option("--nThreads").action("store").dest("nThreads").set_default(1)
+    .help("Number of threads for parallel algorithms. Put 0 to use all hardware threads.");
+
+  /** - <b> \-\-deterministic </b> Make parallel results independent of the number of threads. */
+  parser.add_option("--deterministic").action("store_true").dest("deterministic").set_default(false)
+    .help("Make parallel results independent of the number of threads.");
+
+  /** - <b> \-\-randomSeed </b> Seed of the random number streams. */
+  parser.add_option("--randomSeed").action("store").dest("randomSeed").set_default(123)
+    .help("Seed of the random number streams.");
+
+  /** - <b> \-\-clusteringEngine </b> Clustering engine: "seeded", "dbscan" or "streaming". */
+  parser.add_option("--clusteringEngine").action("store").dest("clusteringEngine").set_default("seeded")
+    .help("Clustering engine: \"seeded\", \"dbscan\" or \"streaming\".");
+
+  /** - <b> \-\-packetSize </b> Number of points per packet when reading the input. */
+  parser.add_option("--packetSize").action("store").dest("packetSize").set_default(4096)
+    .help("Number of points per packet when reading the input.");
+
+  /** - <b> \-\-dbscanEps </b> Neighborhood radius of the DBSCAN engine in the (x,z) plane. */
+  parser.add_option("--dbscanEps").action("store").dest("dbscanEps").set_default(0.4)
+    .help("Neighborhood radius of the DBSCAN engine in the (x,z) plane.");
+
+  /** - <b> \-\-dbscanMinPoints </b> Minimum number of points in the neighborhood of a DBSCAN core point, for the full input frame. */
+  parser.add_option("--dbscanMinPoints").action("store").dest("dbscanMinPoints").set_default(60)
+    .help("Minimum number of points in the neighborhood of a DBSCAN core point, for the full input frame.");
+
+  /** - <b> \-\-dbscanMinClusterSize </b> Minimum number of points in a DBSCAN cluster, for the full input frame. Smaller clusters are noise. */
+  parser.add_option("--dbscanMinClusterSize").action("store").dest("dbscanMinClusterSize").set_default(800)
+    .help("Minimum number of points in a DBSCAN cluster, for the full input frame. Smaller clusters are noise.");
+
+  /** - @b -p, <b> \-\-skipPreClustering </b> Don't run pre-clustering. */
+  parser.add_option("-p", "--skipPreClustering").action("store_true").dest("skipPreClustering").set_default(false)
+    .help("Don't run pre-clustering.");
+  
+  /** - @b -P, <b> \-\-preClusteringSize </b> Size parameter in unit length for pre-clustering. */
+  parser.add_option("-P", "--preClusteringSize").action("store").dest("preClusteringSize").set_default(0.2)
+    .help("Size parameter in unit length for pre-clustering.");
+
+  /** - <b> \-\-preClusteringMode </b> Pre-clustering mode: "greedy" or "components" (order independent and parallel). */
+  parser.add_option("--preClusteringMode").action("store").dest("preClusteringMode").set_default("greedy")
+    .help("Pre-clustering mode: \"greedy\" or \"components\" (order independent and parallel).");
+
+  /** - <b> \-\-preClusteringLinkLength </b> Maximum distance between linked points in the components pre-clustering. */
+  parser.add_option("--preClusteringLinkLength").action("store").dest("preClusteringLinkLength").set_default(0.1)
+    .help("Maximum distance between linked points in the components pre-clustering.");
+
+  /** - @b -d, <b> \-\-densityWindow </b> Size of the window used to compute densities. */
+  parser.add_option("-d", "--densityWindow").action("store").dest("densityWindow").set_default(0.5)
+    .help("Size of the window used to compute densities.");
+  
+  /** - <b> \-\-densitySampleRate </b> Fraction of pre-clusters sampled to estimate densities. Put 1 for exact densities. */
+  parser.add_option("--densitySampleRate").action("store").dest("densitySampleRate").set_default(1)
+    .help("Fraction of pre-clusters sampled to estimate densities. Put 1 for exact densities.");
+
+  /** - <b> \-\-densityConfidence </b> Half-width of the confidence interval of estimated densities, in standard errors. */
+  parser.add_option("--densityConfidence").action("store").dest("densityConfidence").set_default(3)
+    .help("Half-width of the confidence interval of estimated densities, in standard errors.");
+
+  /** - @b -D, <b> \-\-seedDensityThreshold </b> Density threshold for seed selection, normalized to maximum density. */
+  parser.add_option("-D", "--seedDensityThreshold").action("store").dest("seedDensityThreshold").set_default(0.5)
+    .help("Density threshold for seed selection, normalized to maximum density.");
+
+  /** - <b> \-\-frameFiles </b> Comma-separated list of input files of consecutive frames. */
+  parser.add_option("--frameFiles").action("store").dest("frameFiles").set_default("None")
+    .help("Comma-separated list of input files of consecutive frames.");
+
+  /** - <b> \-\-dirtyCellSize </b> Size of the cells compared between frames. Put 0 to use the density window. */
+  parser.add_option("--dirtyCellSize").action("store").dest("dirtyCellSize").set_default(0)
+    .help("Size of the cells compared between frames. Put 0 to use the density window.");
+
+  /** - <b> \-\-dirtyTolerance </b> Count change between frames above which a cell is recomputed, in standard deviations. */
+  parser.add_option("--dirtyTolerance").action("store").dest("dirtyTolerance").set_default(3)
+    .help("Count change between frames above which a cell is recomputed, in standard deviations.");
+
+  /** - <b> \-\-tileSize </b> Size of the x/z tiles for tiled clustering, which spills the input to one temporary file per tile and loads one tile at a time. Put 0 to run the clustering chain on the whole field at once. */
+  parser.add_option("--tileSize").action("store").dest("tileSize").set_default(0)
+    .help("Size of the x/z tiles for tiled clustering, which spills the input to one temporary file per tile and loads one tile at a time. Put 0 to run the clustering chain on the whole field at once.");
+
+  /** - <b> \-\-tileHalo </b> Width of the halo around tiles, at least the density window. Put 0 for automatic. */
+  parser.add_option("--tileHalo").action("store").dest("tileHalo").set_default(0)
+    .help("Width of the halo around tiles, at least the density window. Put 0 for automatic.");
+
+  /** - <b> \-\-nShards </b> Number of worker processes for sharded clustering. Put 0 or 1 to cluster in process. */
+  parser.add_option("--nShards").action("store").dest("nShards").set_default(0)
+    .help("Number of worker processes for sharded clustering. Put 0 or 1 to cluster in process.");
+
+  /** - @b -c, <b> \-\-clusterCoreSize </b> Size parameter in units of standard deviations for outlier removal. */
+  parser.add_option("-c", "--clusterCoreSize").action("store").dest("clusterCoreSize").set_default(2)
+    .help("Size parameter in units of standard deviations for outlier removal.");
+
+  /** - @b -u, <b> \-\-unsupervisedClassification </b> Run unsuppervised classification. */
+  parser.add_option("-u", "--unsupervisedClassification").action("store_true").dest("unsupervisedClassification").set_default(false)
+    .help("Run unsuppervised classification.");
+
+  /** - @b -l, <b> \-\-nLayersPerCluster </b> Number of layers per cluster for color analysis. */
+  parser.add_option("-l", "--nLayersPerCluster").action("store").dest("nLayersPerCluster").set_default(5)
+    .help("Number of layers per cluster for color analysis.");
+
+  /** - @b -t, <b> \-\-runMVATraining </b> Runs MVA training when runing in supervised classification mode, retrains the saved PCA/k-means model otherwise. */
+  parser.add_option("-t", "--runMVATraining").action("store_true").dest("runMVATraining").set_default(false)
+    .help("Runs MVA training when runing in supervised classification mode, retrains the saved PCA/k-means model otherwise.");
+
+  /** - <b> \-\-mvaEngine </b> BDT inference engine: "native" (compiled plugin if up to date, else flat binary model) or "tmva". */
+  parser.add_option("--mvaEngine").action("store").dest("mvaEngine").set_default("native")
+    .help("BDT inference engine: \"native\" (compiled plugin if up to date, else flat binary model) or \"tmva\".");
+
+  /** - <b> \-\-mvaTrainer </b> BDT training engine: "tmva" or "native" (multithreaded, writes the binary model only). */
+  parser.add_option("--mvaTrainer").action("store").dest("mvaTrainer").set_default("tmva")
+    .help("BDT training engine: \"tmva\" or \"native\" (multithreaded, writes the binary model only).");
+
+  /** - <b> \-\-bdtTrees </b> Number of boosting iterations of the BDT training. */
+  parser.add_option("--bdtTrees").action("store").dest("bdtTrees").set_default(200)
+    .help("Number of boosting iterations of the BDT training.");
+
+  /** - <b> \-\-bdtShrinkage </b> Learning rate of the BDT training. */
+  parser.add_option("--bdtShrinkage").action("store").dest("bdtShrinkage").set_default(0.3)
+    .help("Learning rate of the BDT training.");
+
+  /** - <b> \-\-bdtBaggedFraction </b> Fraction of the training events used by each tree. Put 0 to disable bagging. */
+  parser.add_option("--bdtBaggedFraction").action("store").dest("bdtBaggedFraction").set_default(0.5)
+    .help("Fraction of the training events used by each tree. Put 0 to disable bagging.");
+
+  /** - <b> \-\-bdtMaxDepth </b> Maximum depth of the BDT trees. */
+  parser.add_option("--bdtMaxDepth").action("store").dest("bdtMaxDepth").set_default(2)
+    .help("Maximum depth of the BDT trees.");
+
+  /** - @b -o, <b> \-\-tmvaOutputFile </b> Output file to save TMVA performance histograms. Put "None" to skip saving histograms. */
+  parser.add_option("-o", "--tmvaOutputFile").action("store").dest("tmvaOutputFile").set_default("None")
+    .help("Output file to save TMVA performance histograms. Put \"None\" to skip saving histograms.");
+
+  /** - @b -T, <b> \-\-truePositionsFileName </b> File name containing truth player positions and teams. */
+  parser.add_option("-T", "--truePositionsFileName").action("store").dest("truePositionsFileName")
+    .set_default("./share/point_cloud_true_positions.txt")
+    .help("File name containing truth player positions and teams.");
+
+  /** - @b -N, <b> \-\-trainingClustersSplitN </b> Number of sub-clusters for training splitting. */
+  parser.add_option("-N", "--trainingClustersSplitN").action("store").dest("trainingClustersSplitN").set_default(300)
+    .help("Number of sub-clusters for training splitting.");
+
+  /** - @b -F, <b> \-\-trainingClustersSplitF </b> Fraction of points in each sub-cluster for training splitting. */
+  parser.add_option("-F", "--trainingClustersSplitF").action("store").dest("trainingClustersSplitF").set_default(0.25)
+    .help("Fraction of points in each sub-cluster for training splitting.");
+
+  /** - <b> \-\-featureStorage </b> Storage of the training features: "uint8" (lossless, a quarter of the memory) or "float". */
+  parser.add_option("--featureStorage").action("store").dest("featureStorage").set_default("uint8")
+    .help("Storage of the training features: \"uint8\" (lossless, a quarter of the memory) or \"float\".");
+
+  /** - <b> \-\-featureTolerance </b> Standard error of the layer color means at which the points of a cluster stop being sampled. Put 0 to use all points. */
+  parser.add_option("--featureTolerance").action("store").dest("featureTolerance").set_default(0)
+    .help("Standard error of the layer color means at which the points of a cluster stop being sampled. Put 0 to use all points.");
+
+  /** - <b> \-\-featureMaxSamples </b> Largest number of points added to the layers of a cluster when --featureTolerance is set. Put 0 for no limit. */
+  parser.add_option("--featureMaxSamples").action("store").dest("featureMaxSamples").set_default(0)
+    .help("Largest number of points added to the layers of a cluster when --featureTolerance is set. Put 0 for no limit.");
+  
+  /** - <b> \-\-pcaModelFile </b> File of the unsupervised PCA/k-means model: trained and saved if missing or with -t, else loaded and applied. Put "None" to retrain every run. */
+  parser.add_option("--pcaModelFile").action("store").dest("pcaModelFile").set_default("None")
+    .help("File of the unsupervised PCA/k-means model: trained and saved if missing or with -t, else loaded and applied. Put \"None\" to retrain every run.");
+
+  /** - <b> \-\-pcaForgetting </b> Weight of the previous frames in the PCA/k-means model updated at each new frame. */
+  parser.add_option("--pcaForgetting").action("store").dest("pcaForgetting").set_default(0.9)
+    .help("Weight of the previous frames in the PCA/k-means model updated at each new frame.");
+
+  /** - <b> \-\-checkpointInterval </b> Number of frames between saves of the PCA/k-means model to --pcaModelFile. Put 0 to never save. */
+  parser.add_option("--checkpointInterval").action("store").dest("checkpointInterval").set_default(0)
+    .help("Number of frames between saves of the PCA/k-means model to --pcaModelFile. Put 0 to never save.");
+
+  /** - <b> \-\-trackPlayers </b> Track the players across frames and only classify new, ambiguous or refreshed tracks. */
+  parser.add_option("--trackPlayers").action("store_true").dest("trackPlayers").set_default(false)
+    .help("Track the players across frames and only classify new, ambiguous or refreshed tracks.");
+
+  /** - <b> \-\-trackingGate </b> Largest distance between a track and a cluster of the next frame. */
+  parser.add_option("--trackingGate").action("store").dest("trackingGate").set_default(1.0)
+    .help("Largest distance between a track and a cluster of the next frame.");
+
+  /** - <b> \-\-trackingRefresh </b> Number of frames after which a track is classified again. Put 0 to never refresh. */
+  parser.add_option("--trackingRefresh").action("store").dest("trackingRefresh").set_default(50)
+    .help("Number of frames after which a track is classified again. Put 0 to never refresh.");
+
+  /** - <b> \-\-trackingMaxMissed </b> Number of frames a track is kept without matching cluster. */
+  parser.add_option("--trackingMaxMissed").action("store").dest("trackingMaxMissed").set_default(5)
+    .help("Number of frames a track is kept without matching cluster.");
+
+  /** - @b -K, <b> \-\-maxKmeansIterations </b> Maximum number of k-means iterations during PCA/kmeans classification. */
+  parser.add_option("-K", "--maxKmeansIterations").action("store").dest("maxKmeansIterations").set_default(1000)
+    .help("Maximum number of k-means iterations during PCA/kmeans classification.");
+
+  /** - <b> \-\-kmeansRestarts </b> Number of k-means runs from different seeds, the one with the smallest inertia being kept. */
+  parser.add_option("--kmeansRestarts").action("store").dest("kmeansRestarts").set_default(4)
+    .help("Number of k-means runs from different seeds, the one with the smallest inertia being kept.");
+
+  /** - <b> \-\-kmeansCoresetSize </b> Number of weighted points summarizing the k-means inputs. Put 0 to use all inputs. */
+  parser.add_option("--kmeansCoresetSize").action("store").dest("kmeansCoresetSize").set_default(0)
+    .help("Number of weighted points summarizing the k-means inputs. Put 0 to use all inputs.");
+
+  config = parser.parse_args(argc, argv);
+
+}
+
+/**
+ * @}
+ */
@@ -0,0 +1,342 @@
+#include "PCA.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include "Parallel.h"
+
+/**
+ * @param nVariables Number of variables.
+ */
+PCA::Accumulator::Accumulator(unsigned int nVariables) :
+  m_count(0),
+  m_mean(nVariables, 0.),
+  m_comoments(nVariables*nVariables, 0.)
+{
+}
+
+/**
+ * @param row Values of all variables.
+ */
+void PCA::Accumulator::add(const float *row)
+{
+  unsigned int n = nVariables();
+  m_count += 1;
+  for(unsigned int i=0; i<n; i++) {
+    m_mean[i] += (row[i] - m_mean[i])/m_count;
+  }
+  if(m_count == 1) return;
+
+  // The deviation from the previous mean is (count/(count-1)) times the deviation from the new mean
+  double factor = m_count/(m_count - 1);
+  for(unsigned int i=0; i<n; i++) {
+    double *comoments = &m_comoments[i*n];
+    double di = factor*(row[i] - m_mean[i]);
+    for(unsigned int j=0; j<n; j++) {
+      comoments[j] += di*(row[j] - m_mean[j]);
+    }
+  }
+}
+
+/**
+ * @param other Accumulator of other rows.
+ */
+void PCA::Accumulator::merge(const Accumulator &other)
+{
+  if(other.m_count == 0) return;
+  if(m_count == 0) {
+    *this = other;
+    return;
+  }
+
+  unsigned int n = nVariables();
+  double count = m_count + other.m_count;
+  double weight = m_count*other.m_count/count;
+
+  for(unsigned int i=0; i<n; i++) {
+    double di = other.m_mean[i] - m_mean[i];
+    for(unsigned int j=0; j<n; j++) {
+      double dj = other.m_mean[j] - m_mean[j];
+      m_comoments[i*n+j] += other.m_comoments[i*n+j] + di*dj*weight;
+    }
+  }
+  for(unsigned int i=0; i<n; i++) {
+    m_mean[i] += (other.m_mean[i] - m_mean[i])*other.m_count/count;
+  }
+  m_count = count;
+}
+
+/**
+ * Exponential forgetting: the moments become those of rows weighted by @c factor,
+ * the means being unchanged.
+ *
+ * @param factor Weight factor, between 0 and 1.
+ */
+void PCA::Accumulator::decay(double factor)
+{
+  m_count *= factor;
+  for(unsigned int i=0; i<m_comoments.size(); i++) {
+    m_comoments[i] *= factor;
+  }
+}
+
+/**
+ * Writes the weighted number of rows, the means and the co-moments as doubles.
+ * The number of variables is not written and must be stored by the caller.
+ *
+ * @param os Output stream, opened in binary mode.
+ */
+void PCA::Accumulator::write(std::ostream &os) const
+{
+  os.write(reinterpret_cast<const char*>(&m_count), sizeof(double));
+  os.write(reinterpret_cast<const char*>(&m_mean[0]), m_mean.size()*sizeof(double));
+  os.write(reinterpret_cast<const char*>(&m_comoments[0]), m_comoments.size()*sizeof(double));
+}
+
+/**
+ * @param is Input stream, opened in binary mode.
+ * @param nVariables Number of variables.
+ */
+void PCA::Accumulator::read(std::istream &is, unsigned int nVariables)
+{
+  m_mean.resize(nVariables);
+  m_comoments.resize(nVariables*nVariables);
+  is.read(reinterpret_cast<char*>(&m_count), sizeof(double));
+  is.read(reinterpret_cast<char*>(&m_mean[0]), m_mean.size()*sizeof(double));
+  is.read(reinterpret_cast<char*>(&m_comoments[0]), m_comoments.size()*sizeof(double));
+  if(!is) {
+    throw std::runtime_error("ERROR: truncated PCA moments");
+  }
+}
+
+PCA::PCA()
+{
+}
+
+PCA::~PCA()
+{
+}
+
+/**
+ * The rows are accumulated in blocks merged in a fixed order, so that the result only depends on the
+ * block size.
+ *
+ * @param features Input features.
+ * @param nThreads Number of threads.
+ * @param blockSize Number of rows per block. Put 0 to use one block per thread.
+ * @return Moments of all rows.
+ */
+PCA::Accumulator PCA::accumulate(const FeatureMatrix &features, int nThreads, unsigned int blockSize)
+{
+  auto accumulateBlock = [&](unsigned int begin, unsigned int end) {
+    Accumulator moments(features.nColumns());
+    float buffer[3*FeatureMatrix::kMaxLayers];
+    for(unsigned int i=begin; i<end; i++) {
+      moments.add(features.row(i, buffer));
+    }
+    return moments;
+  };
+  auto mergeBlocks = [](const Accumulator &a, const Accumulator &b) {
+    Accumulator moments(a);
+    moments.merge(b);
+    return moments;
+  };
+  return parallelReduce(features.nRows(), nThreads, blockSize, Accumulator(features.nColumns()),
+			accumulateBlock, mergeBlocks);
+}
+
+/**
+ * @param features Training features.
+ * @param nThreads Number of threads.
+ * @param blockSize Number of rows per block of the accumulation. Put 0 to use one block per thread.
+ */
+void PCA::train(const FeatureMatrix &features, int nThreads, unsigned int blockSize)
+{
+  train(accumulate(features, nThreads, blockSize));
+}
+
+/**
+ * Variables with no variance are only centered.
+ *
+ * @param moments Moments of the training rows.
+ */
+void PCA::train(const Accumulator &moments)
+{
+  if(moments.count() == 0) {
+    throw std::runtime_error("ERROR: no training data for the PCA");
+  }
+  unsigned int n = moments.nVariables();
+
+
+  //
+  // Correlation matrix
+  //
+  std::vector<double> sigmas(n);
+  for(unsigned int i=0; i<n; i++) {
+    double variance = moments.covariance(i, i);
+    sigmas[i] = variance > 0 ? sqrt(variance) : 1;
+  }
+  std::vector<double> correlations(n*n);
+  for(unsigned int i=0; i<n; i++) {
+    for(unsigned int j=0; j<n; j++) {
+      correlations[i*n+j] = moments.covariance(i, j)/(sigmas[i]*sigmas[j]);
+    }
+  }
+
+
+  //
+  // Principal components, ordered by decreasing eigenvalue
+  //
+  std::vector<double> values;
+  std::vector<double> vectors;
+  diagonalize(n, correlations, values, vectors);
+
+  std::vector<unsigned int> order(n);
+  for(unsigned int i=0; i<n; i++) {
+    order[i] = i;
+  }
+  std::stable_sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b) {
+      return values[a] > values[b];
+    });
+
+
+  //
+  // Projection matrix, including the normalization
+  //
+  m_eigenvalues.resize(n);
+  m_projection.resize(n*n);
+  m_offsets.resize(n);
+  for(unsigned int k=0; k<n; k++) {
+    unsigned int iVector = order[k];
+    m_eigenvalues[k] = values[iVector];
+
+    unsigned int iMax = 0;
+    for(unsigned int j=1; j<n; j++) {
+      if(fabs(vectors[j*n+iVector]) > fabs(vectors[iMax*n+iVector])) iMax = j;
+    }
+    double sign = vectors[iMax*n+iVector] < 0 ? -1 : 1;
+
+    m_offsets[k] = 0;
+    for(unsigned int j=0; j<n; j++) {
+      m_projection[k*n+j] = sign*vectors[j*n+iVector]/sigmas[j];
+      m_offsets[k] += m_projection[k*n+j]*moments.mean(j);
+    }
+  }
+}
+
+/**
+ * @param features Input features.
+ * @param nComponents Number of leading components to compute.
+ * @param outputs Output components, row-major with one row of nComponents values per input.
+ * @param nThreads Number of threads.
+ */
+void PCA::project(const FeatureMatrix &features, unsigned int nComponents,
+		  std::vector<float> &outputs, int nThreads) const
+{
+  unsigned int n = nVariables();
+  if(features.nColumns() != n || nComponents > n) {
+    throw std::runtime_error("ERROR: PCA features do not match the training features");
+  }
+
+  outputs.resize(features.nRows()*nComponents);
+  parallelFor(features.nRows(), nThreads, [&](unsigned int i) {
+      float buffer[3*FeatureMatrix::kMaxLayers];
+      const float *row = features.row(i, buffer);
+      for(unsigned int k=0; k<nComponents; k++) {
+	const double *projection = &m_projection[k*n];
+	double p = -m_offsets[k];
+	for(unsigned int j=0; j<n; j++) {
+	  p += projection[j]*row[j];
+	}
+	outputs[i*nComponents+k] = p;
+      }
+    });
+}
+
+/**
+ * @param row Values of all variables.
+ * @param nComponents Number of leading components to compute.
+ * @param components Output components.
+ */
+void PCA::project(const double *row, unsigned int nComponents, double *components) const
+{
+  unsigned int n = nVariables();
+  for(unsigned int k=0; k<nComponents; k++) {
+    const double *projection = &m_projection[k*n];
+    double p = -m_offsets[k];
+    for(unsigned int j=0; j<n; j++) {
+      p += projection[j]*row[j];
+    }
+    components[k] = p;
+  }
+}
+
+/**
+ * Cyclic Jacobi method: each sweep zeroes every off-diagonal element in turn with a plane rotation,
+ * until the off-diagonal norm is negligible compared to the diagonal.
+ *
+ * @param n Matrix size.
+ * @param matrix Symmetric matrix, row-major. Overwritten.
+ * @param values Output eigenvalues, in no particular order.
+ * @param vectors Output eigenvectors, row-major with eigenvector @c k in column @c k.
+ */
+void PCA::diagonalize(unsigned int n, std::vector<double> &matrix,
+		      std::vector<double> &values, std::vector<double> &vectors)
+{
+  const int nSweepsMax = 50;
+  double *a = &matrix[0];
+
+  vectors.assign(n*n, 0.);
+  for(unsigned int i=0; i<n; i++) {
+    vectors[i*n+i] = 1;
+  }
+
+  for(int iSweep=0; iSweep<nSweepsMax; iSweep++) {
+    double diagonal = 0;
+    double offDiagonal = 0;
+    for(unsigned int p=0; p<n; p++) {
+      diagonal += a[p*n+p]*a[p*n+p];
+      for(unsigned int q=p+1; q<n; q++) {
+	offDiagonal += a[p*n+q]*a[p*n+q];
+      }
+    }
+    if(offDiagonal <= 1e-30*diagonal) break;
+
+    for(unsigned int p=0; p<n; p++) {
+      for(unsigned int q=p+1; q<n; q++) {
+	double apq = a[p*n+q];
+	if(apq == 0) continue;
+
+	double theta = (a[q*n+q] - a[p*n+p])/(2*apq);
+	double t = (theta >= 0 ? 1 : -1)/(fabs(theta) + sqrt(theta*theta + 1));
+	double c = 1/sqrt(t*t + 1);
+	double s = t*c;
+
+	for(unsigned int k=0; k<n; k++) {
+	  double akp = a[k*n+p];
+	  double akq = a[k*n+q];
+	  a[k*n+p] = c*akp - s*akq;
+	  a[k*n+q] = s*akp + c*akq;
+	}
+	for(unsigned int k=0; k<n; k++) {
+	  double apk = a[p*n+k];
+	  double aqk = a[q*n+k];
+	  a[p*n+k] = c*apk - s*aqk;
+	  a[q*n+k] = s*apk + c*aqk;
+	}
+	for(unsigned int k=0; k<n; k++) {
+	  double vkp = vectors[k*n+p];
+	  double vkq = vectors[k*n+q];
+	  vectors[k*n+p] = c*vkp - s*vkq;
+	  vectors[k*n+q] = s*vkp + c*vkq;
+	}
+      }
+    }
+  }
+
+  values.resize(n);
+  for(unsigned int i=0; i<n; i++) {
+    values[i] = a[i*n+i];
+  }
+}
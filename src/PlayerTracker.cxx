@@ -0,0 +1,121 @@
+#include "PlayerTracker.h"
+
+#include <algorithm>
+#include <utility>
+
+/**
+ * @param config Configuration.
+ */
+PlayerTracker::PlayerTracker(const Config &config) :
+  m_config(config),
+  m_nFrames(0),
+  m_nClassified(0),
+  m_nAmbiguous(0)
+{
+  m_gate = config.get("trackingGate");
+  m_refresh = config.get("trackingRefresh");
+  m_maxMissed = config.get("trackingMaxMissed");
+}
+
+PlayerTracker::~PlayerTracker()
+{
+}
+
+/**
+ * All clusters of the first frame are new, and classified. The first refresh of a new track comes
+ * after 1 to @c \-\-trackingRefresh frames, depending on its cluster index, so that the refreshes of the
+ * tracks created on the same frame are spread over the following frames.
+ *
+ * @param ds Data set of the frame, with all its clusters.
+ * @param classAlg Classification holding the model of the previous frames.
+ */
+void PlayerTracker::processFrame(DataSet &ds, ClassificationAlg &classAlg)
+{
+
+  std::vector<Cluster> &clusters = ds.clusters();
+  float gateSq = m_gate*m_gate;
+
+
+  //
+  // Candidate pairs within the gate, and ambiguous clusters
+  //
+  std::vector<std::pair<float, std::pair<unsigned int, unsigned int> > > pairs;
+  std::vector<bool> ambiguous(clusters.size(), false);
+  for(unsigned int i=0; i<clusters.size(); i++) {
+    const Point &com = clusters[i].core().com();
+    int classId = -1;
+    for(unsigned int t=0; t<m_tracks.size(); t++) {
+      float dist = com.dist2DSq(m_tracks[t].position);
+      if(dist > gateSq) continue;
+      pairs.push_back(std::make_pair(dist, std::make_pair(i, t)));
+      if(classId >= 0 && classId != m_tracks[t].classId) ambiguous[i] = true;
+      classId = m_tracks[t].classId;
+    }
+  }
+  std::sort(pairs.begin(), pairs.end());
+
+
+  //
+  // Greedy matching by increasing distance
+  //
+  std::vector<int> trackOfCluster(clusters.size(), -1);
+  std::vector<bool> matched(m_tracks.size(), false);
+  for(unsigned int k=0; k<pairs.size(); k++) {
+    unsigned int i = pairs[k].second.first;
+    unsigned int t = pairs[k].second.second;
+    if(trackOfCluster[i] >= 0 || matched[t]) continue;
+    trackOfCluster[i] = t;
+    matched[t] = true;
+  }
+
+
+  //
+  // Carry the class of the tracks forward, select the clusters to classify
+  //
+  std::vector<unsigned int> selection;
+  std::vector<bool> selected(clusters.size(), false);
+  m_nAmbiguous = 0;
+  for(unsigned int i=0; i<clusters.size(); i++) {
+    int t = trackOfCluster[i];
+    if(ambiguous[i]) m_nAmbiguous++;
+    if(t < 0 || ambiguous[i] || (m_refresh > 0 && (int)m_nFrames - m_tracks[t].classified >= m_refresh)) {
+      selection.push_back(i);
+      selected[i] = true;
+    }else{
+      clusters[i].core().setClassId(m_tracks[t].classId);
+      clusters[i].setClassId(m_tracks[t].classId);
+    }
+  }
+  if(!selection.empty()) {
+    classAlg.classifyFrame(ds, selection, m_config);
+  }
+  m_nClassified = selection.size();
+
+
+  //
+  // Update the tracks
+  //
+  std::vector<Track> tracks;
+  for(unsigned int t=0; t<m_tracks.size(); t++) {
+    if(!matched[t] && m_tracks[t].nMissed < m_maxMissed) {
+      tracks.push_back(m_tracks[t]);
+      tracks.back().nMissed++;
+    }
+  }
+  for(unsigned int i=0; i<clusters.size(); i++) {
+    Track track;
+    if(selected[i]) {
+      track.classId = clusters[i].classId();
+      track.classified = m_nFrames;
+      // Stagger the first refresh of the new tracks, which would otherwise all refresh on the same frame
+      if(trackOfCluster[i] < 0 && m_refresh > 0) track.classified -= i%m_refresh;
+    }else{
+      track = m_tracks[trackOfCluster[i]];
+    }
+    track.position = clusters[i].core().com();
+    track.nMissed = 0;
+    tracks.push_back(track);
+  }
+  m_tracks.swap(tracks);
+  m_nFrames++;
+}
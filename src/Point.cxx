@@ -34,7 +34,7 @@ Point::~Point()
  */
 float Point::dist2DSq(const Point &p) const
 {
-  return (p.m_x-m_x)*(p.m_x-m_x) + (p.m_z-m_z)*(p.m_z-m_z);
+  return distSq<MetricXZ>(p);
 }
 
 
@@ -47,6 +47,6 @@ float Point::dist2DSq(const Point &p) const
  */
 float Point::dist3DSq(const Point &p) const
 {
-  return (p.m_x-m_x)*(p.m_x-m_x) + (p.m_y-m_y)*(p.m_y-m_y) + (p.m_z-m_z)*(p.m_z-m_z);
+  return distSq<MetricXYZ>(p);
 }
 
@@ -0,0 +1,35 @@
+#include "RandomStream.h"
+
+/**
+ * The key mixes the seed and the stage,
+ * so that the streams of different stages are not correlated.
+ *
+ * @param seed Global seed.
+ * @param stage Processing stage, see Stage.
+ */
+RandomStream::RandomStream(unsigned long long seed, unsigned int stage) :
+  m_key(mix(mix(seed + kGolden) ^ (stage*kGolden)))
+{
+}
+
+RandomStream::~RandomStream()
+{
+}
+
+/**
+ * Gives the same numbers as calls to uniform(element, firstDraw+i).
+ * Draws do not depend on each other, so that the loop has no carried dependency
+ * and can be vectorized by the compiler.
+ *
+ * @param element Element index.
+ * @param firstDraw Index of the first draw.
+ * @param n Number of draws.
+ * @param out Output array of size n.
+ */
+void RandomStream::uniform(unsigned long long element, unsigned long long firstDraw, unsigned int n, double *out) const
+{
+  const unsigned long long base = elementKey(element) + (firstDraw+1)*kGolden;
+  for(unsigned int i=0; i<n; i++) {
+    out[i] = toUniform(mix(base + i*kGolden));
+  }
+}
@@ -0,0 +1,305 @@
+#include "ShardCoordinator.h"
+
+#include <stdexcept>
+
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/**
+ * @param nShards Number of shards, i.e. of worker processes.
+ */
+ShardCoordinator::ShardCoordinator(int nShards) :
+  m_nShards(nShards < 1 ? 1 : nShards)
+{
+}
+
+ShardCoordinator::~ShardCoordinator()
+{
+}
+
+/**
+ * Shards are merged in order, the first shard claiming a point owns it,
+ * so that the result is identical to running findTileSeeds() and assignTile() in process with the same tiles.
+ * Outlier removal is left to the caller.
+ *
+ * @param alg Clustering algorithm run by the workers.
+ * @param ds Data set to be clustered.
+ * @param config Configuration.
+ */
+void ShardCoordinator::runClustering(ClusteringAlg &alg, DataSet &ds, const Config &config)
+{
+
+  TileGrid grid(ds.points(), alg.tileSize(config), alg.tileHalo(config));
+  makeShards(grid);
+
+
+  //
+  // Start one worker per shard
+  //
+  std::vector<pid_t> pids;
+  std::vector<int> fds;
+  bool ok = true;
+  for(int i=0; i<m_nShards && ok; i++) {
+    int sv[2];
+    if(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) {
+      ok = false;
+      break;
+    }
+    pid_t pid = fork();
+    if(pid < 0) {
+      close(sv[0]);
+      close(sv[1]);
+      ok = false;
+      break;
+    }
+    if(pid == 0) {
+      close(sv[0]);
+      for(unsigned int j=0; j<fds.size(); j++) close(fds[j]);
+      // The worker must never unwind into the coordinator code of the parent
+      bool success = false;
+      try {
+	success = runWorker(i, sv[1], alg, ds, grid, config);
+      } catch(...) {
+	success = false;
+      }
+      close(sv[1]);
+      _exit(success ? 0 : 1);
+    }
+    close(sv[1]);
+    pids.push_back(pid);
+    fds.push_back(sv[0]);
+  }
+
+
+  //
+  // Collect seed candidates and send back the selected seeds
+  //
+  std::vector<Cluster> candidates;
+  for(unsigned int i=0; i<fds.size() && ok; i++) {
+    std::vector<float> records;
+    ok = readRecords(fds[i], records);
+    for(unsigned int j=0; j+3<records.size(); j+=4) {
+      Cluster cl;
+      cl.setSeed(Point(records[j], records[j+1], records[j+2]));
+      cl.setDensity(records[j+3]);
+      candidates.push_back(cl);
+    }
+  }
+
+  std::vector<Cluster> &clusters = ds.clusters();
+  if(ok) {
+    alg.selectSeeds(candidates, config, clusters);
+  }
+
+  std::vector<float> seedRecords;
+  for(unsigned int i=0; i<clusters.size(); i++) {
+    seedRecords.push_back(clusters[i].seed().x());
+    seedRecords.push_back(clusters[i].seed().y());
+    seedRecords.push_back(clusters[i].seed().z());
+    seedRecords.push_back(clusters[i].density());
+  }
+  for(unsigned int i=0; i<fds.size() && ok; i++) {
+    ok = writeRecords(fds[i], seedRecords);
+  }
+
+
+  //
+  // Merge point assignments shard by shard
+  //
+  std::vector<int> assignment(ds.points().size(), -1);
+  for(unsigned int i=0; i<fds.size() && ok; i++) {
+    std::vector<unsigned int> records;
+    ok = readRecords(fds[i], records);
+    for(unsigned int j=0; j+1<records.size(); j+=2) {
+      int &a = assignment[records[j]];
+      if(a < 0) a = records[j+1];
+    }
+  }
+
+
+  //
+  // Stop workers
+  //
+  for(unsigned int i=0; i<fds.size(); i++) {
+    close(fds[i]);
+  }
+  for(unsigned int i=0; i<pids.size(); i++) {
+    if(!ok) kill(pids[i], SIGKILL);
+    int status = 0;
+    waitpid(pids[i], &status, 0);
+    if(!WIFEXITED(status) || WEXITSTATUS(status) != 0) ok = false;
+  }
+  if(!ok) {
+    clusters.clear();
+    throw std::runtime_error("ERROR: Sharded clustering failed");
+  }
+
+  if(!clusters.empty()) {
+    alg.fillClusters(ds, assignment);
+  }
+}
+
+/**
+ * @param grid Tile grid covering the data set.
+ */
+void ShardCoordinator::makeShards(const TileGrid &grid)
+{
+  unsigned int nPoints = 0;
+  for(int i=0; i<grid.nTiles(); i++) {
+    nPoints += grid.nCorePoints(i);
+  }
+
+  m_firstTile.assign(m_nShards+1, grid.nTiles());
+  m_firstTile[0] = 0;
+  unsigned int nSoFar = 0;
+  int iShard = 1;
+  for(int i=0; i<grid.nTiles() && iShard<m_nShards; i++) {
+    nSoFar += grid.nCorePoints(i);
+    if(nSoFar*(double)m_nShards >= iShard*(double)nPoints) {
+      m_firstTile[iShard] = i+1;
+      iShard++;
+    }
+  }
+}
+
+/**
+ * @param iShard Shard index.
+ * @param fd Socket connected to the coordinator.
+ * @param alg Clustering algorithm.
+ * @param ds Data set to be clustered.
+ * @param grid Tile grid covering the data set.
+ * @param config Configuration.
+ * @return @c true upon success, @c false upon failure.
+ */
+bool ShardCoordinator::runWorker(int iShard, int fd, ClusteringAlg &alg, DataSet &ds,
+				 const TileGrid &grid, const Config &config)
+{
+
+  std::vector<Cluster> candidates;
+  for(int i=m_firstTile[iShard]; i<m_firstTile[iShard+1]; i++) {
+    alg.findTileSeeds(ds, grid, i, config, candidates);
+  }
+
+  std::vector<float> records;
+  for(unsigned int i=0; i<candidates.size(); i++) {
+    records.push_back(candidates[i].seed().x());
+    records.push_back(candidates[i].seed().y());
+    records.push_back(candidates[i].seed().z());
+    records.push_back(candidates[i].density());
+  }
+  if(!writeRecords(fd, records)) return false;
+
+  if(!readRecords(fd, records)) return false;
+  std::vector<Cluster> seeds;
+  for(unsigned int j=0; j+3<records.size(); j+=4) {
+    Cluster cl;
+    cl.setSeed(Point(records[j], records[j+1], records[j+2]));
+    cl.setDensity(records[j+3]);
+    seeds.push_back(cl);
+  }
+
+  std::vector<unsigned int> pairs;
+  if(!seeds.empty()) {
+    std::vector<int> assignment(ds.points().size(), -1);
+    for(int i=m_firstTile[iShard]; i<m_firstTile[iShard+1]; i++) {
+      alg.assignTile(ds, grid, i, seeds, config, assignment);
+    }
+    for(unsigned int i=0; i<assignment.size(); i++) {
+      if(assignment[i] < 0) continue;
+      pairs.push_back(i);
+      pairs.push_back(assignment[i]);
+    }
+  }
+  return writeRecords(fd, pairs);
+}
+
+/**
+ * A block is made of a record count followed by the records.
+ *
+ * @param fd Socket.
+ * @param records Records to write.
+ * @return @c true upon success, @c false upon failure.
+ */
+bool ShardCoordinator::writeRecords(int fd, const std::vector<float> &records)
+{
+  unsigned int n = records.size();
+  if(!writeAll(fd, &n, sizeof(n))) return false;
+  return n == 0 || writeAll(fd, &records[0], n*sizeof(float));
+}
+
+/**
+ * @param fd Socket.
+ * @param records Records to write.
+ * @return @c true upon success, @c false upon failure.
+ */
+bool ShardCoordinator::writeRecords(int fd, const std::vector<unsigned int> &records)
+{
+  unsigned int n = records.size();
+  if(!writeAll(fd, &n, sizeof(n))) return false;
+  return n == 0 || writeAll(fd, &records[0], n*sizeof(unsigned int));
+}
+
+/**
+ * @param fd Socket.
+ * @param records Records read.
+ * @return @c true upon success, @c false upon failure.
+ */
+bool ShardCoordinator::readRecords(int fd, std::vector<float> &records)
+{
+  unsigned int n = 0;
+  if(!readAll(fd, &n, sizeof(n))) return false;
+  records.resize(n);
+  return n == 0 || readAll(fd, &records[0], n*sizeof(float));
+}
+
+/**
+ * @param fd Socket.
+ * @param records Records read.
+ * @return @c true upon success, @c false upon failure.
+ */
+bool ShardCoordinator::readRecords(int fd, std::vector<unsigned int> &records)
+{
+  unsigned int n = 0;
+  if(!readAll(fd, &n, sizeof(n))) return false;
+  records.resize(n);
+  return n == 0 || readAll(fd, &records[0], n*sizeof(unsigned int));
+}
+
+/**
+ * @param fd Socket.
+ * @param buffer Data to write.
+ * @param size Size in bytes.
+ * @return @c true upon success, @c false upon failure.
+ */
+bool ShardCoordinator::writeAll(int fd, const void *buffer, size_t size)
+{
+  const char *p = static_cast<const char*>(buffer);
+  while(size > 0) {
+    ssize_t n = send(fd, p, size, MSG_NOSIGNAL);
+    if(n <= 0) return false;
+    p += n;
+    size -= n;
+  }
+  return true;
+}
+
+/**
+ * @param fd Socket.
+ * @param buffer Buffer to read into.
+ * @param size Size in bytes.
+ * @return @c true upon success, @c false upon failure.
+ */
+bool ShardCoordinator::readAll(int fd, void *buffer, size_t size)
+{
+  char *p = static_cast<char*>(buffer);
+  while(size > 0) {
+    ssize_t n = recv(fd, p, size, 0);
+    if(n <= 0) return false;
+    p += n;
+    size -= n;
+  }
+  return true;
+}
@@ -0,0 +1,209 @@
+#include "StreamingClustering.h"
+
+#include <algorithm>
+#include <cmath>
+#include <unordered_set>
+
+#include "ClusteringAlg.h"
+
+/**
+ * The cell size is the pre-clustering size and the density window is rounded to a number of cells.
+ *
+ * @param config Configuration.
+ */
+StreamingClustering::StreamingClustering(const Config &config) :
+  m_config(config),
+  m_nCandidates(0),
+  m_nPackets(0)
+{
+  m_cellSize = config.get("preClusteringSize");
+  float d = config.get("densityWindow");
+  m_window = std::max(1, int(d/m_cellSize + 0.5));
+}
+
+StreamingClustering::~StreamingClustering()
+{
+}
+
+/**
+ * @param x x position.
+ * @param z z position.
+ * @return Cell key.
+ */
+long long StreamingClustering::cellKey(float x, float z) const
+{
+  return cellKey(int(floor(x/m_cellSize)), int(floor(z/m_cellSize)));
+}
+
+/**
+ * @param ix Cell index along x.
+ * @param iz Cell index along z.
+ * @return Cell key.
+ */
+long long StreamingClustering::cellKey(int ix, int iz)
+{
+  return ((long long)ix << 32) | (unsigned int)iz;
+}
+
+/**
+ * The points of the packet are first summed per cell. The densities of the cells within the
+ * density window of each updated cell are then incremented, and the candidate flags are re-evaluated
+ * for the cells whose density or whose neighbors density changed.
+ *
+ * @param points Points of the frame received so far.
+ * @param begin Index of the first point of the packet.
+ * @param end Index past the last point of the packet.
+ */
+void StreamingClustering::addPoints(const std::vector<CloudPoint> &points, unsigned int begin, unsigned int end)
+{
+
+  //
+  // Sum the packet points per cell
+  //
+  std::unordered_map<long long, Cell> deltas;
+  for(unsigned int i=begin; i<end; i++) {
+    const CloudPoint &cp = points[i];
+    float w = cp.weight();
+    Cell &delta = deltas[cellKey(cp.x(), cp.z())];
+    delta.weight += w;
+    delta.sumX += cp.x()*w;
+    delta.sumY += cp.y()*w;
+    delta.sumZ += cp.z()*w;
+  }
+
+
+  //
+  // Update cells and densities
+  //
+  std::unordered_set<long long> changed;
+  for(std::unordered_map<long long, Cell>::const_iterator itr=deltas.begin(); itr!=deltas.end(); itr++) {
+    addWeight(itr->first, itr->second);
+    int ix = itr->first >> 32;
+    int iz = (int)(itr->first & 0xffffffff);
+    for(int jx=ix-2*m_window; jx<=ix+2*m_window; jx++) {
+      for(int jz=iz-2*m_window; jz<=iz+2*m_window; jz++) {
+	changed.insert(cellKey(jx, jz));
+      }
+    }
+  }
+
+
+  //
+  // Update seed candidates
+  //
+  for(std::unordered_set<long long>::const_iterator itr=changed.begin(); itr!=changed.end(); itr++) {
+    std::unordered_map<long long, Cell>::iterator cell = m_cells.find(*itr);
+    if(cell == m_cells.end()) continue;
+    bool isCandidate = isLocalMax(cell->first, cell->second);
+    if(isCandidate != cell->second.isCandidate) {
+      cell->second.isCandidate = isCandidate;
+      if(isCandidate) m_nCandidates++;
+      else m_nCandidates--;
+    }
+  }
+
+  m_nPackets++;
+}
+
+/**
+ * A new cell starts with the density of its neighborhood, so that the density of each cell
+ * always equals the total weight within its window.
+ *
+ * @param key Cell key.
+ * @param delta Weight and weighted position sums to add.
+ */
+void StreamingClustering::addWeight(long long key, const Cell &delta)
+{
+  int ix = key >> 32;
+  int iz = (int)(key & 0xffffffff);
+
+  if(m_cells.find(key) == m_cells.end()) {
+    Cell cell = Cell();
+    for(int jx=ix-m_window; jx<=ix+m_window; jx++) {
+      for(int jz=iz-m_window; jz<=iz+m_window; jz++) {
+	std::unordered_map<long long, Cell>::const_iterator itr = m_cells.find(cellKey(jx, jz));
+	if(itr != m_cells.end()) cell.density += itr->second.weight;
+      }
+    }
+    m_cells[key] = cell;
+  }
+
+  Cell &cell = m_cells[key];
+  cell.weight += delta.weight;
+  cell.sumX += delta.sumX;
+  cell.sumY += delta.sumY;
+  cell.sumZ += delta.sumZ;
+
+  for(int jx=ix-m_window; jx<=ix+m_window; jx++) {
+    for(int jz=iz-m_window; jz<=iz+m_window; jz++) {
+      std::unordered_map<long long, Cell>::iterator itr = m_cells.find(cellKey(jx, jz));
+      if(itr != m_cells.end()) itr->second.density += delta.weight;
+    }
+  }
+}
+
+/**
+ * As for pre-clusters, ties are resolved in favor of the cell with the highest key.
+ *
+ * @param key Cell key.
+ * @param cell Cell.
+ * @return @c true if no cell within the density window has a higher density.
+ */
+bool StreamingClustering::isLocalMax(long long key, const Cell &cell) const
+{
+  int ix = key >> 32;
+  int iz = (int)(key & 0xffffffff);
+  for(int jx=ix-m_window; jx<=ix+m_window; jx++) {
+    for(int jz=iz-m_window; jz<=iz+m_window; jz++) {
+      long long neighborKey = cellKey(jx, jz);
+      if(neighborKey == key) continue;
+      std::unordered_map<long long, Cell>::const_iterator itr = m_cells.find(neighborKey);
+      if(itr == m_cells.end()) continue;
+      if(itr->second.density > cell.density) return false;
+      if(itr->second.density == cell.density && neighborKey > key) return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * Seeds are the candidates whose density is above @c seedDensityThreshold times the maximum density,
+ * placed at the center of mass of their cell and ordered by cell key.
+ * Points are then assigned to the nearest seed and outliers are removed as in the seeded chain.
+ *
+ * @param ds Data set holding all the points added.
+ */
+void StreamingClustering::finish(DataSet &ds)
+{
+
+  float densityTh = m_config.get("seedDensityThreshold");
+
+  double dmax = 0;
+  for(std::unordered_map<long long, Cell>::const_iterator itr=m_cells.begin(); itr!=m_cells.end(); itr++) {
+    dmax = std::max(dmax, itr->second.density);
+  }
+
+  std::vector<long long> seedKeys;
+  for(std::unordered_map<long long, Cell>::const_iterator itr=m_cells.begin(); itr!=m_cells.end(); itr++) {
+    const Cell &cell = itr->second;
+    if(cell.isCandidate && cell.density >= densityTh*dmax) {
+      seedKeys.push_back(itr->first);
+    }
+  }
+  std::sort(seedKeys.begin(), seedKeys.end());
+
+  std::vector<Cluster> &clusters = ds.clusters();
+  for(unsigned int i=0; i<seedKeys.size(); i++) {
+    const Cell &cell = m_cells[seedKeys[i]];
+    Cluster cl;
+    cl.setSeed(Point(cell.sumX/cell.weight, cell.sumY/cell.weight, cell.sumZ/cell.weight));
+    cl.setDensity(cell.density/dmax);
+    clusters.push_back(cl);
+  }
+  if(clusters.empty()) return;
+
+  ClusteringAlg alg;
+  std::vector<int> assignment(ds.points().size(), -1);
+  alg.fillClusters(ds, assignment);
+  alg.cleanupClusters(ds, m_config);
+}
@@ -0,0 +1,96 @@
+#include "TMVAReaderPool.h"
+
+#include "TROOT.h"
+#include "TMVA/Tools.h"
+#include "TMVA/Reader.h"
+
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+
+#include "Parallel.h"
+
+/**
+ * @param xmlFile TMVA weights file.
+ * @param nLayers Number of layers per cluster, with 3 variables per layer.
+ * @param nReaders Number of readers, i.e. of worker threads.
+ */
+TMVAReaderPool::TMVAReaderPool(const std::string &xmlFile, int nLayers, int nReaders) :
+  m_xmlFile(xmlFile),
+  m_nLayers(nLayers)
+{
+  if(nReaders < 1) nReaders = 1;
+  if(nReaders > 1) {
+    // The ROOT global state used by the readers is only protected in thread-safe mode
+    ROOT::EnableThreadSafety();
+  }
+  TMVA::Tools::Instance();
+
+  // The buffers are allocated before binding, so that their addresses are stable
+  // The readers are only handed to the pool once all are booked, so that a failure does not leak them
+  m_vars.assign(nReaders, std::vector<float>(3*nLayers));
+  std::vector< std::unique_ptr<TMVA::Reader> > readers;
+  for(int t=0; t<nReaders; t++) {
+    readers.push_back(std::unique_ptr<TMVA::Reader>(new TMVA::Reader( "!Color:Silent" )));
+    TMVA::Reader *reader = readers.back().get();
+    std::vector<float> &vars = m_vars[t];
+    for(int k=0; k<nLayers; k++) {
+      TString suffix = TString::Format("%d", k);
+      reader->AddVariable( "r"+suffix, &vars[3*k+0] );
+      reader->AddVariable( "g"+suffix, &vars[3*k+1] );
+      reader->AddVariable( "b"+suffix, &vars[3*k+2] );
+    }
+    if(!reader->BookMVA( "BDT", xmlFile.c_str() )) {
+      throw std::runtime_error("ERROR: could not book BDT from " + xmlFile);
+    }
+  }
+  m_readers.reserve(readers.size());
+  for(unsigned int t=0; t<readers.size(); t++) {
+    m_readers.push_back(readers[t].release());
+  }
+
+  TMVA::Reader *reader = m_readers[0];
+  for(unsigned int i=0; i<reader->DataInfo().GetNClasses(); i++) {
+    m_classNames.push_back(reader->DataInfo().GetClassInfo(i)->GetName());
+  }
+}
+
+TMVAReaderPool::~TMVAReaderPool()
+{
+  for(unsigned int t=0; t<m_readers.size(); t++) {
+    delete m_readers[t];
+  }
+}
+
+/**
+ * The rows are split into contiguous chunks, one per reader.
+ * The outputs do not depend on the number of readers.
+ *
+ * @param features Input features, with the number of layers of the pool.
+ * @param outputs Output probabilities, row-major with one row per input and one column per class.
+ */
+void TMVAReaderPool::evaluate(const FeatureMatrix &features, std::vector<float> &outputs)
+{
+  if(features.nLayers() != m_nLayers) {
+    throw std::runtime_error("ERROR: feature matrix does not match the TMVA readers");
+  }
+
+  unsigned int nRows = features.nRows();
+  unsigned int nClasses = m_classNames.size();
+  unsigned int nReaders = m_readers.size();
+  if(nReaders > nRows) nReaders = nRows;
+  outputs.resize(nRows*nClasses);
+
+  parallelFor(nReaders, nReaders, [&](unsigned int t) {
+      TMVA::Reader *reader = m_readers[t];
+      std::vector<float> &vars = m_vars[t];
+      unsigned int begin = (unsigned long long)nRows*t/nReaders;
+      unsigned int end = (unsigned long long)nRows*(t+1)/nReaders;
+      for(unsigned int i=begin; i<end; i++) {
+	const float *row = features.row(i, &vars[0]);
+	std::copy(row, row+features.nColumns(), vars.begin());
+	const std::vector<float> &res = reader->EvaluateMulticlass("BDT");
+	std::copy(res.begin(), res.begin()+nClasses, &outputs[i*nClasses]);
+      }
+    });
+}
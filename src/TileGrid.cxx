@@ -0,0 +1,108 @@
+#include "TileGrid.h"
+
+#include <algorithm>
+#include <cmath>
+
+/**
+ * The grid covers the bounding box of the points in the (x,z) plane.
+ * Points are bucketed by tile once so that loading a tile only visits the neighboring tiles.
+ *
+ * @param points Points to partition. Must outlive the grid.
+ * @param tileSize Size of the tile cores in unit length.
+ * @param halo Width of the halo around each tile core in unit length.
+ */
+TileGrid::TileGrid(const std::vector<CloudPoint> &points, float tileSize, float halo) :
+  m_points(points),
+  m_tileSize(tileSize),
+  m_halo(halo),
+  m_xmin(0),
+  m_zmin(0),
+  m_nx(1),
+  m_nz(1)
+{
+  float xmax = 0;
+  float zmax = 0;
+  for(unsigned int i=0; i<points.size(); i++) {
+    const CloudPoint &cp = points[i];
+    if(i == 0 || cp.x() < m_xmin) m_xmin = cp.x();
+    if(i == 0 || cp.z() < m_zmin) m_zmin = cp.z();
+    if(i == 0 || cp.x() > xmax) xmax = cp.x();
+    if(i == 0 || cp.z() > zmax) zmax = cp.z();
+  }
+  m_nx = (int)((xmax-m_xmin)/m_tileSize) + 1;
+  m_nz = (int)((zmax-m_zmin)/m_tileSize) + 1;
+
+  //
+  // Bucket points by tile, keeping the input order within each tile
+  //
+  std::vector<int> tiles(points.size());
+  m_offsets.assign(nTiles()+1, 0);
+  for(unsigned int i=0; i<points.size(); i++) {
+    tiles[i] = tileIndex(points[i].x(), points[i].z());
+    m_offsets[tiles[i]+1]++;
+  }
+  for(int i=0; i<nTiles(); i++) {
+    m_offsets[i+1] += m_offsets[i];
+  }
+  m_indices.resize(points.size());
+  std::vector<unsigned int> next(m_offsets.begin(), m_offsets.end()-1);
+  for(unsigned int i=0; i<points.size(); i++) {
+    m_indices[next[tiles[i]]++] = i;
+  }
+}
+
+TileGrid::~TileGrid()
+{
+}
+
+/**
+ * Positions outside the grid are attributed to the nearest border tile.
+ *
+ * @param x x position.
+ * @param z z position.
+ * @return Tile index.
+ */
+int TileGrid::tileIndex(float x, float z) const
+{
+  int ix = (int)std::floor((x-m_xmin)/m_tileSize);
+  int iz = (int)std::floor((z-m_zmin)/m_tileSize);
+  if(ix < 0) ix = 0;
+  if(iz < 0) iz = 0;
+  if(ix >= m_nx) ix = m_nx-1;
+  if(iz >= m_nz) iz = m_nz-1;
+  return iz*m_nx + ix;
+}
+
+/**
+ * Indices are returned in increasing order, i.e. in the order of the input points,
+ * so that order-dependent algorithms behave on a tile as they would on the full data.
+ *
+ * @param iTile Tile index.
+ * @param indices Output point indices.
+ */
+void TileGrid::tilePoints(int iTile, std::vector<unsigned int> &indices) const
+{
+  indices.clear();
+
+  int ix = iTile % m_nx;
+  int iz = iTile / m_nx;
+  float xlo = m_xmin + ix*m_tileSize - m_halo;
+  float xhi = m_xmin + (ix+1)*m_tileSize + m_halo;
+  float zlo = m_zmin + iz*m_tileSize - m_halo;
+  float zhi = m_zmin + (iz+1)*m_tileSize + m_halo;
+  int nReach = (int)std::ceil(m_halo/m_tileSize);
+
+  for(int jz=std::max(0, iz-nReach); jz<=std::min(m_nz-1, iz+nReach); jz++) {
+    for(int jx=std::max(0, ix-nReach); jx<=std::min(m_nx-1, ix+nReach); jx++) {
+      int jTile = jz*m_nx + jx;
+      for(unsigned int k=m_offsets[jTile]; k<m_offsets[jTile+1]; k++) {
+	const CloudPoint &cp = m_points[m_indices[k]];
+	if(cp.x() < xlo || cp.x() >= xhi) continue;
+	if(cp.z() < zlo || cp.z() >= zhi) continue;
+	indices.push_back(m_indices[k]);
+      }
+    }
+  }
+
+  std::sort(indices.begin(), indices.end());
+}
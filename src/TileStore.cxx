@@ -0,0 +1,169 @@
+#include "TileStore.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include <unistd.h>
+
+/** Number of values per point record: x, y, z, r, g, b and weight. */
+static const unsigned int kRecordSize = 7;
+
+/** Number of buffered points above which all tiles are written. */
+static const unsigned int kBufferPoints = 1 << 16;
+
+/**
+ * The tile files are created in a new directory under @c TMPDIR, or @c /tmp if unset.
+ *
+ * @param tileSize Size of the tile cores in unit length.
+ * @param halo Width of the halo around each tile core in unit length.
+ */
+TileStore::TileStore(float tileSize, float halo) :
+  m_tileSize(tileSize),
+  m_halo(halo),
+  m_nBuffered(0),
+  m_nPoints(0)
+{
+  const char *tmp = getenv("TMPDIR");
+  std::string pattern = std::string(tmp ? tmp : "/tmp") + "/pointCloudTiles.XXXXXX";
+  std::vector<char> name(pattern.begin(), pattern.end());
+  name.push_back('\0');
+  if(!mkdtemp(&name[0])) {
+    throw std::runtime_error("ERROR: could not create tile directory " + pattern);
+  }
+  m_dir = &name[0];
+}
+
+TileStore::~TileStore()
+{
+  for(int i=0; i<nTiles(); i++) {
+    std::ostringstream fileName;
+    fileName << m_dir << "/tile" << i << ".bin";
+    unlink(fileName.str().c_str());
+  }
+  rmdir(m_dir.c_str());
+}
+
+/**
+ * @param ix Tile index along x.
+ * @param iz Tile index along z.
+ * @return Tile key.
+ */
+long long TileStore::tileKey(int ix, int iz)
+{
+  return ((long long)ix << 32) | (unsigned int)iz;
+}
+
+/**
+ * Tiles are numbered in order of first occurrence.
+ *
+ * @param ix Tile index along x.
+ * @param iz Tile index along z.
+ * @return Tile index.
+ */
+int TileStore::tileIndex(int ix, int iz)
+{
+  long long key = tileKey(ix, iz);
+  std::unordered_map<long long, int>::iterator itr = m_tiles.find(key);
+  if(itr != m_tiles.end()) return itr->second;
+  int iTile = m_keys.size();
+  m_tiles[key] = iTile;
+  m_keys.push_back(key);
+  m_buffers.push_back(std::vector<float>());
+  return iTile;
+}
+
+/**
+ * @param points Points holding the packet.
+ * @param begin Index of the first point to add.
+ * @param end Index past the last point to add.
+ */
+void TileStore::addPoints(const std::vector<CloudPoint> &points, unsigned int begin, unsigned int end)
+{
+  for(unsigned int i=begin; i<end; i++) {
+    const CloudPoint &cp = points[i];
+    int ixlo = (int)std::floor((cp.x()-m_halo)/m_tileSize);
+    int ixhi = (int)std::floor((cp.x()+m_halo)/m_tileSize);
+    int izlo = (int)std::floor((cp.z()-m_halo)/m_tileSize);
+    int izhi = (int)std::floor((cp.z()+m_halo)/m_tileSize);
+    for(int iz=izlo; iz<=izhi; iz++) {
+      for(int ix=ixlo; ix<=ixhi; ix++) {
+	std::vector<float> &buffer = m_buffers[tileIndex(ix, iz)];
+	buffer.push_back(cp.x());
+	buffer.push_back(cp.y());
+	buffer.push_back(cp.z());
+	buffer.push_back(cp.r());
+	buffer.push_back(cp.g());
+	buffer.push_back(cp.b());
+	buffer.push_back(cp.weight());
+	m_nBuffered++;
+      }
+    }
+  }
+  m_nPoints += end-begin;
+  if(m_nBuffered >= kBufferPoints) flush();
+}
+
+/**
+ * Must be called once all points are added, before loading tiles.
+ */
+void TileStore::flush()
+{
+  for(int i=0; i<nTiles(); i++) {
+    std::vector<float> &buffer = m_buffers[i];
+    if(buffer.empty()) continue;
+    std::ostringstream fileName;
+    fileName << m_dir << "/tile" << i << ".bin";
+    std::ofstream ofile(fileName.str().c_str(), std::ios::out | std::ios::binary | std::ios::app);
+    ofile.write(reinterpret_cast<const char*>(&buffer[0]), buffer.size()*sizeof(float));
+    if(!ofile) {
+      throw std::runtime_error("ERROR: could not write tile file " + fileName.str());
+    }
+    std::vector<float>().swap(buffer);
+  }
+  m_nBuffered = 0;
+}
+
+/**
+ * Points are returned in the order they were added.
+ *
+ * @param iTile Tile index.
+ * @param points Output points of the tile core and halo.
+ */
+void TileStore::loadTile(int iTile, std::vector<CloudPoint> &points) const
+{
+  points.clear();
+
+  std::ostringstream fileName;
+  fileName << m_dir << "/tile" << iTile << ".bin";
+  std::ifstream ifile(fileName.str().c_str(), std::ios::in | std::ios::binary);
+  if(!ifile) return;
+
+  std::vector<float> records(kBufferPoints*kRecordSize);
+  while(ifile) {
+    ifile.read(reinterpret_cast<char*>(&records[0]), records.size()*sizeof(float));
+    unsigned int n = ifile.gcount()/sizeof(float);
+    for(unsigned int k=0; k+kRecordSize<=n; k+=kRecordSize) {
+      const float *r = &records[k];
+      CloudPoint cp(r[0], r[1], r[2], (int)r[3], (int)r[4], (int)r[5]);
+      cp.setWeight((int)r[6]);
+      points.push_back(cp);
+    }
+  }
+  if(!ifile.eof()) {
+    throw std::runtime_error("ERROR: could not read tile file " + fileName.str());
+  }
+}
+
+/**
+ * @param iTile Tile index.
+ * @param x x position.
+ * @param z z position.
+ * @return @c true if the position is in the tile core.
+ */
+bool TileStore::inCore(int iTile, float x, float z) const
+{
+  return tileKey((int)std::floor(x/m_tileSize), (int)std::floor(z/m_tileSize)) == m_keys[iTile];
+}
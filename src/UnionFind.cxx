@@ -0,0 +1,60 @@
+#include "UnionFind.h"
+
+/**
+ * Each index starts in its own set.
+ *
+ * @param n Number of indices.
+ */
+UnionFind::UnionFind(unsigned int n) :
+  m_parents(n)
+{
+  for(unsigned int i=0; i<n; i++) {
+    m_parents[i].store(i, std::memory_order_relaxed);
+  }
+}
+
+UnionFind::~UnionFind()
+{
+}
+
+/**
+ * Safe to call concurrently with unite().
+ * The result is only guaranteed to be the final representative once all merges are done.
+ *
+ * @param i Index.
+ * @return Representative index.
+ */
+unsigned int UnionFind::find(unsigned int i)
+{
+  while(true) {
+    unsigned int parent = m_parents[i].load(std::memory_order_acquire);
+    if(parent == i) return i;
+    unsigned int grandParent = m_parents[parent].load(std::memory_order_acquire);
+    if(grandParent != parent) {
+      m_parents[i].compare_exchange_weak(parent, grandParent, std::memory_order_acq_rel);
+    }
+    i = grandParent;
+  }
+}
+
+/**
+ * Safe to call concurrently from several threads.
+ *
+ * @param i First index.
+ * @param j Second index.
+ */
+void UnionFind::unite(unsigned int i, unsigned int j)
+{
+  while(true) {
+    unsigned int ri = find(i);
+    unsigned int rj = find(j);
+    if(ri == rj) return;
+    if(ri < rj) {
+      unsigned int tmp = ri;
+      ri = rj;
+      rj = tmp;
+    }
+    unsigned int expected = ri;
+    if(m_parents[ri].compare_exchange_strong(expected, rj, std::memory_order_acq_rel)) return;
+  }
+}
@@ -0,0 +1,295 @@
+/**
+ * @file
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "TMVA/Tools.h"
+#include "TMVA/Reader.h"
+
+#include "DataSet.h"
+#include "TStopwatch.h"
+#include "BDTModel.h"
+#include "ClusteringAlg.h"
+#include "CompiledBDT.h"
+#include "FeatureMatrix.h"
+#include "Options.h"
+#include "Parallel.h"
+#include "TMVAReaderPool.h"
+
+void printTiming(const std::string &engine, double loadTime, double latency, double batchLatency,
+		 float maxDiff, int nDiffering);
+float compareOutputs(const std::vector<float> &reference, const std::vector<float> &outputs,
+		     unsigned int nClasses, int &nDiffering);
+
+/**
+ * @defgroup Inference BDT Inference
+ *
+ * @brief Timing and validation of the BDT inference engines.
+ *
+ * @{
+ */
+
+/**
+ * @brief Compares the native BDT inference with TMVA.
+ *
+ * Clusters the evaluation data with the same options as the main program and classifies the cluster cores
+ * with the trained BDT (see @c \-\-runMVATraining), using:
+ * - TMVA::Reader::EvaluateMulticlass(), one cluster at a time, and for all clusters at once
+ *   with a TMVAReaderPool of one reader per thread.
+ * - BDTModel, one cluster at a time and for all clusters at once.
+ * - CompiledBDT, the same way, if the plugin was built from the current weights (see @c make @c bdtplugin).
+ *
+ * Reports the model load time, the latency per cluster, the largest difference with the TMVA outputs
+ * and the number of clusters classified differently.
+ * Exits with 1 if the engines do not classify all clusters in the same way.
+ *
+ * @param argc Number of command line arguments.
+ * @param argv Array of command line arguments.
+ * @return 0 upon successfull exit
+ */
+int main(int argc, char **argv) {
+
+  Config config;
+  parseCommandLine(config, argc, argv);
+
+  const std::string xmlFile = BDTModel::kBaseName + ".weights.xml";
+  const std::string binaryFile = BDTModel::kBaseName + ".bin";
+  const std::string pluginFile = BDTModel::kBaseName + ".so";
+  const int nRepeats = 1000;
+  int nThreads = threadCount(config);
+  int nLayers = config.get("nLayersPerCluster");
+
+  DataSet trainingData;
+  DataSet evaluationData;
+  if(!DataSet::readFromFile(config, trainingData, evaluationData)) {
+    return 1;
+  }
+  ClusteringAlg clAlg;
+  clAlg.runClustering(evaluationData, config);
+
+  std::vector<const Cluster*> cores;
+  for(unsigned int i=0; i<evaluationData.clusters().size(); i++) {
+    cores.push_back(&evaluationData.clusters()[i].core());
+  }
+  FeatureMatrix features(nLayers);
+  features.setSampling(config);
+  features.fill(cores, nThreads);
+  unsigned int nRows = features.nRows();
+  if(nRows == 0) {
+    std::cout << "Error: no clusters found" << std::endl;
+    return 1;
+  }
+
+
+  //
+  // TMVA
+  //
+  TStopwatch sw;
+  sw.Start();
+  TMVA::Tools::Instance();
+  TMVA::Reader reader( "!Color:Silent" );
+  std::vector<float> vars(3*nLayers);
+  for(int k=0; k<nLayers; k++) {
+    TString suffix = TString::Format("%d", k);
+    reader.AddVariable( "r"+suffix, &vars[3*k+0] );
+    reader.AddVariable( "g"+suffix, &vars[3*k+1] );
+    reader.AddVariable( "b"+suffix, &vars[3*k+2] );
+  }
+  reader.BookMVA( "BDT", xmlFile.c_str() );
+  sw.Stop();
+  double tmvaLoad = sw.RealTime();
+
+  std::vector<float> tmvaOutputs;
+  sw.Start();
+  for(int r=0; r<nRepeats; r++) {
+    tmvaOutputs.clear();
+    for(unsigned int i=0; i<nRows; i++) {
+      std::copy(features.row(i), features.row(i)+features.nColumns(), vars.begin());
+      const std::vector<float> &res = reader.EvaluateMulticlass("BDT");
+      tmvaOutputs.insert(tmvaOutputs.end(), res.begin(), res.end());
+    }
+  }
+  sw.Stop();
+  double tmvaLatency = sw.RealTime()/nRepeats/nRows;
+
+  TMVAReaderPool pool(xmlFile, nLayers, nThreads);
+  std::vector<float> tmvaBatchOutputs;
+  sw.Start();
+  for(int r=0; r<nRepeats; r++) {
+    pool.evaluate(features, tmvaBatchOutputs);
+  }
+  sw.Stop();
+  double tmvaBatchLatency = sw.RealTime()/nRepeats/nRows;
+
+
+  //
+  // Native engine
+  //
+  sw.Start();
+  BDTModel::convert(xmlFile, binaryFile);
+  sw.Stop();
+  double convertTime = sw.RealTime();
+
+  BDTModel model;
+  sw.Start();
+  model.load(binaryFile);
+  sw.Stop();
+  double nativeLoad = sw.RealTime();
+
+  unsigned int nClasses = model.nClasses();
+  std::vector<float> rowOutputs(nRows*nClasses);
+  sw.Start();
+  for(int r=0; r<nRepeats; r++) {
+    for(unsigned int i=0; i<nRows; i++) {
+      model.evaluate(features.row(i), &rowOutputs[i*nClasses]);
+    }
+  }
+  sw.Stop();
+  double nativeLatency = sw.RealTime()/nRepeats/nRows;
+
+  std::vector<float> batchOutputs;
+  sw.Start();
+  for(int r=0; r<nRepeats; r++) {
+    model.evaluate(features, batchOutputs, nThreads);
+  }
+  sw.Stop();
+  double batchLatency = sw.RealTime()/nRepeats/nRows;
+
+
+  //
+  // Compiled plugin
+  //
+  CompiledBDT compiled;
+  sw.Start();
+  bool hasPlugin = compiled.load(pluginFile, BDTModel::fileHash(binaryFile));
+  sw.Stop();
+  double compiledLoad = sw.RealTime();
+
+  std::vector<float> compiledRowOutputs(nRows*nClasses);
+  std::vector<float> compiledBatchOutputs;
+  double compiledLatency = 0;
+  double compiledBatchLatency = 0;
+  if(hasPlugin) {
+    sw.Start();
+    for(int r=0; r<nRepeats; r++) {
+      for(unsigned int i=0; i<nRows; i++) {
+	compiled.evaluate(features.row(i), &compiledRowOutputs[i*nClasses]);
+      }
+    }
+    sw.Stop();
+    compiledLatency = sw.RealTime()/nRepeats/nRows;
+
+    sw.Start();
+    for(int r=0; r<nRepeats; r++) {
+      compiled.evaluate(features, compiledBatchOutputs, nThreads);
+    }
+    sw.Stop();
+    compiledBatchLatency = sw.RealTime()/nRepeats/nRows;
+  }
+
+
+  //
+  // Report
+  //
+  std::cout << std::endl << "BDT inference, " << nRows << " clusters, "
+	    << model.nTrees() << " trees:" << std::endl;
+  std::cout << std::setw(10) << "engine"
+	    << std::setw(12) << "load [ms]"
+	    << std::setw(16) << "latency [us]"
+	    << std::setw(16) << "batch [us]"
+	    << std::setw(12) << "max diff"
+	    << std::setw(12) << "differing"
+	    << std::endl;
+
+  int nDiffering = 0;
+  int nTotalDiffering = 0;
+  float maxDiff = compareOutputs(tmvaOutputs, tmvaBatchOutputs, nClasses, nDiffering);
+  nTotalDiffering += nDiffering;
+  printTiming("tmva", tmvaLoad, tmvaLatency, tmvaBatchLatency, maxDiff, nDiffering);
+
+  maxDiff = compareOutputs(tmvaOutputs, rowOutputs, nClasses, nDiffering);
+  maxDiff = std::max(maxDiff, compareOutputs(tmvaOutputs, batchOutputs, nClasses, nDiffering));
+  nTotalDiffering += nDiffering;
+  printTiming("native", nativeLoad, nativeLatency, batchLatency, maxDiff, nDiffering);
+
+  if(hasPlugin) {
+    maxDiff = compareOutputs(tmvaOutputs, compiledRowOutputs, nClasses, nDiffering);
+    maxDiff = std::max(maxDiff, compareOutputs(tmvaOutputs, compiledBatchOutputs, nClasses, nDiffering));
+    nTotalDiffering += nDiffering;
+    printTiming("compiled", compiledLoad, compiledLatency, compiledBatchLatency, maxDiff, nDiffering);
+  }else{
+    std::cout << "No up to date BDT plugin found, run: make bdtplugin" << std::endl;
+  }
+
+  std::cout << "Conversion of the weights file: "
+	    << std::fixed << std::setprecision(3) << 1e3*convertTime << " ms" << std::endl;
+
+  return nTotalDiffering == 0 ? 0 : 1;
+}
+
+/**
+ * @brief Compares BDT outputs to a reference.
+ *
+ * @param reference Reference outputs.
+ * @param outputs Outputs to compare, with the same layout.
+ * @param nClasses Number of classes.
+ * @param nDiffering Output number of rows with a different best class.
+ * @return Largest absolute difference.
+ */
+float compareOutputs(const std::vector<float> &reference, const std::vector<float> &outputs,
+		     unsigned int nClasses, int &nDiffering)
+{
+  float maxDiff = 0;
+  nDiffering = 0;
+  for(unsigned int i=0; i<reference.size()/nClasses; i++) {
+    unsigned int referenceClass = 0;
+    unsigned int outputClass = 0;
+    for(unsigned int ic=0; ic<nClasses; ic++) {
+      unsigned int k = i*nClasses+ic;
+      maxDiff = std::max(maxDiff, std::fabs(reference[k]-outputs[k]));
+      if(reference[k] > reference[i*nClasses+referenceClass]) referenceClass = ic;
+      if(outputs[k] > outputs[i*nClasses+outputClass]) outputClass = ic;
+    }
+    if(referenceClass != outputClass) nDiffering++;
+  }
+  return maxDiff;
+}
+
+/**
+ * @brief Prints a line of the timing table.
+ *
+ * @param engine Engine name.
+ * @param loadTime Model load time in seconds.
+ * @param latency Time per cluster in seconds, one cluster at a time.
+ * @param batchLatency Time per cluster in seconds, all clusters at once. Negative if not available.
+ * @param maxDiff Largest output difference with TMVA. Negative if not available.
+ * @param nDiffering Number of clusters classified differently from TMVA. Negative if not available.
+ */
+void printTiming(const std::string &engine, double loadTime, double latency, double batchLatency,
+		 float maxDiff, int nDiffering)
+{
+  std::cout << std::setw(10) << engine
+	    << std::setw(12) << std::fixed << std::setprecision(3) << 1e3*loadTime
+	    << std::setw(16) << 1e6*latency;
+  if(batchLatency >= 0) {
+    std::cout << std::setw(16) << 1e6*batchLatency;
+  }else{
+    std::cout << std::setw(16) << "-";
+  }
+  if(maxDiff >= 0) {
+    std::cout << std::setw(12) << std::scientific << std::setprecision(1) << maxDiff
+	      << std::setw(12) << nDiffering;
+  }else{
+    std::cout << std::setw(12) << "-" << std::setw(12) << "-";
+  }
+  std::cout << std::endl;
+}
+
+/**
+ * @}
+ */
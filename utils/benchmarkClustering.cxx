@@ -0,0 +1,348 @@
+/**
+ * @file
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <cstring>
+#include <algorithm>
+
+#include "DataSet.h"
+#include "TStopwatch.h"
+#include "ClusteringAlg.h"
+#include "ClassificationAlg.h"
+#include "IngestFilter.h"
+#include "Options.h"
+#include "Parallel.h"
+
+void benchmarkSharding(DataSet &data, const Config &config);
+void benchmarkEngines(DataSet &data, const Config &config);
+void benchmarkPrefilter(const Config &config);
+void benchmarkDensities(DataSet &data, const Config &config);
+bool sameBits(const Point &a, const Point &b);
+bool checkDeterminism(const DataSet &trainingData, const DataSet &evaluationData, const Config &config);
+
+/**
+ * @defgroup Benchmarks Benchmarks
+ *
+ * @brief Timing of the clustering variants.
+ *
+ * @{
+ */
+
+/**
+ * @brief Benchmarks of the clustering variants.
+ *
+ * Reads the input data with the same options as the main program and runs:
+ * - The sharded clustering with 1, 2, 4, ... worker processes up to @c \-\-nShards.
+ * - The seeded, DBSCAN and streaming clustering engines.
+ * - The exact and sampled density estimations.
+ * - If an ingest filter is configured, the clustering with and without the filter.
+ *
+ * With @c \-\-deterministic, it also checks that clustering and classification
+ * give bitwise identical results with 1 and @c \-\-nThreads threads, and exits with 1 otherwise.
+ *
+ * @param argc Number of command line arguments.
+ * @param argv Array of command line arguments.
+ * @return 0 upon successfull exit
+ */
+int main(int argc, char **argv) {
+
+  Config config;
+  parseCommandLine(config, argc, argv);
+
+  DataSet trainingData;
+  DataSet evaluationData;
+  if(!DataSet::readFromFile(config, trainingData, evaluationData)) {
+    return 1;
+  }
+
+  if(config.get("deterministic")) {
+    if(!checkDeterminism(trainingData, evaluationData, config)) {
+      return 1;
+    }
+  }
+
+  benchmarkSharding(trainingData, config);
+  benchmarkEngines(trainingData, config);
+  benchmarkDensities(trainingData, config);
+
+  IngestFilter filter(config);
+  if(filter.isActive()) {
+    benchmarkPrefilter(config);
+  }
+
+  return 0;
+}
+
+/**
+ * @brief Reports the wall time and speedup of the sharded clustering with respect to a single worker.
+ *
+ * @param data Data set to cluster.
+ * @param config Configuration.
+ */
+void benchmarkSharding(DataSet &data, const Config &config)
+{
+  int maxShards = config.get("nShards");
+  if(maxShards < 1) maxShards = 1;
+
+  ClusteringAlg clAlg;
+  double t1 = 0;
+
+  std::cout << std::endl << "Sharded clustering:" << std::endl;
+  std::cout << std::setw(8) << "shards"
+	    << std::setw(12) << "time [s]"
+	    << std::setw(10) << "speedup"
+	    << std::setw(10) << "clusters"
+	    << std::endl;
+
+  for(int nShards=1; nShards<=maxShards; nShards*=2) {
+    DataSet ds(data);
+
+    TStopwatch sw;
+    sw.Start();
+    clAlg.runShardedClustering(ds, config, nShards);
+    sw.Stop();
+
+    double t = sw.RealTime();
+    if(nShards == 1) t1 = t;
+    std::cout << std::setw(8) << nShards
+	      << std::setw(12) << std::fixed << std::setprecision(4) << t
+	      << std::setw(10) << std::setprecision(2) << t1/t
+	      << std::setw(10) << ds.clusters().size()
+	      << std::endl;
+  }
+}
+
+/**
+ * @brief Reports the wall time and number of clusters of each clustering engine.
+ *
+ * @param data Data set to cluster.
+ * @param config Configuration.
+ */
+void benchmarkEngines(DataSet &data, const Config &config)
+{
+  const char *engines[3] = {"seeded", "dbscan", "streaming"};
+
+  std::cout << std::endl << "Clustering engines:" << std::endl;
+  std::cout << std::setw(10) << "engine"
+	    << std::setw(12) << "time [s]"
+	    << std::setw(10) << "clusters"
+	    << std::endl;
+
+  for(int i=0; i<3; i++) {
+    Config engineConfig = config;
+    engineConfig["clusteringEngine"] = engines[i];
+
+    DataSet ds(data);
+
+    ClusteringAlg clAlg;
+    TStopwatch sw;
+    sw.Start();
+    clAlg.runClustering(ds, engineConfig);
+    sw.Stop();
+
+    std::cout << std::setw(10) << engines[i]
+	      << std::setw(12) << std::fixed << std::setprecision(4) << sw.RealTime()
+	      << std::setw(10) << ds.clusters().size()
+	      << std::endl;
+  }
+}
+
+/**
+ * @brief Reports the wall time of the clustering with exact and sampled densities,
+ * and the number of seeds which match the exact computation.
+ *
+ * @param data Data set to cluster.
+ * @param config Configuration.
+ */
+void benchmarkDensities(DataSet &data, const Config &config)
+{
+  const char *rates[4] = {"1", "0.5", "0.2", "0.1"};
+  std::vector<Point> exactSeeds;
+
+  std::cout << std::endl << "Density sampling:" << std::endl;
+  std::cout << std::setw(8) << "rate"
+	    << std::setw(12) << "time [s]"
+	    << std::setw(10) << "clusters"
+	    << std::setw(14) << "exact seeds"
+	    << std::endl;
+
+  for(int i=0; i<4; i++) {
+    Config rateConfig = config;
+    rateConfig["densitySampleRate"] = rates[i];
+    rateConfig["clusteringEngine"] = "seeded";
+    rateConfig["nShards"] = "1";
+    rateConfig["tileSize"] = "0";
+
+    DataSet ds(data);
+
+    ClusteringAlg clAlg;
+    TStopwatch sw;
+    sw.Start();
+    clAlg.runClustering(ds, rateConfig);
+    sw.Stop();
+
+    const std::vector<Cluster> &clusters = ds.clusters();
+    int nExact = 0;
+    for(unsigned int j=0; j<clusters.size(); j++) {
+      if(i == 0) exactSeeds.push_back(clusters[j].seed());
+      if(j < exactSeeds.size() && sameBits(clusters[j].seed(), exactSeeds[j])) nExact++;
+    }
+
+    std::cout << std::setw(8) << rates[i]
+	      << std::setw(12) << std::fixed << std::setprecision(4) << sw.RealTime()
+	      << std::setw(10) << clusters.size()
+	      << std::setw(14) << nExact
+	      << std::endl;
+  }
+}
+
+/**
+ * @brief Reports the number of points dropped by the ingest filter and the clustering time it saves.
+ *
+ * @param config Configuration with the ingest filter.
+ */
+void benchmarkPrefilter(const Config &config)
+{
+  Config unfiltered = config;
+  unfiltered["fieldPolygon"] = "None";
+  unfiltered["minHeight"] = "None";
+  unfiltered["maxHeight"] = "None";
+  unfiltered["floorTolerance"] = "0";
+
+  const Config *configs[2] = {&unfiltered, &config};
+  const char *names[2] = {"off", "on"};
+  double times[2] = {0, 0};
+
+  std::cout << std::endl << "Ingest filter:" << std::endl;
+  std::cout << std::setw(8) << "filter"
+	    << std::setw(10) << "points"
+	    << std::setw(12) << "time [s]"
+	    << std::setw(10) << "clusters"
+	    << std::endl;
+
+  for(int i=0; i<2; i++) {
+    DataSet trainingData;
+    DataSet evaluationData;
+    DataSet::readFromFile(*configs[i], trainingData, evaluationData);
+    unsigned int nPoints = trainingData.points().size();
+
+    ClusteringAlg clAlg;
+    TStopwatch sw;
+    sw.Start();
+    clAlg.runClustering(trainingData, *configs[i]);
+    sw.Stop();
+    times[i] = sw.RealTime();
+
+    std::cout << std::setw(8) << names[i]
+	      << std::setw(10) << nPoints
+	      << std::setw(12) << std::fixed << std::setprecision(4) << times[i]
+	      << std::setw(10) << trainingData.clusters().size()
+	      << std::endl;
+  }
+
+  std::cout << "Clustering time saved by the ingest filter: "
+	    << std::setprecision(4) << times[0]-times[1] << " s ("
+	    << std::setprecision(1) << 100*(times[0]-times[1])/times[0] << "%)"
+	    << std::endl;
+}
+
+/**
+ * @brief Checks whether two points have bitwise identical coordinates.
+ *
+ * @param a First point.
+ * @param b Second point.
+ * @return true if the coordinates are identical.
+ */
+bool sameBits(const Point &a, const Point &b)
+{
+  float va[3] = {a.x(), a.y(), a.z()};
+  float vb[3] = {b.x(), b.y(), b.z()};
+  return std::memcmp(va, vb, sizeof(va)) == 0;
+}
+
+/**
+ * @brief Checks whether two lists of clusters are bitwise identical.
+ *
+ * Compares the points, seeds, centers of mass, cores and class IDs.
+ *
+ * @param a First list of clusters.
+ * @param b Second list of clusters.
+ * @return Number of differing clusters.
+ */
+int compareClusters(const std::vector<Cluster> &a, const std::vector<Cluster> &b)
+{
+  if(a.size() != b.size()) return std::max(a.size(), b.size());
+
+  int nDiffs = 0;
+  for(unsigned int i=0; i<a.size(); i++) {
+    const Cluster &ca = a[i];
+    const Cluster &cb = b[i];
+    bool same = ca.classId() == cb.classId() &&
+      sameBits(ca.seed(), cb.seed()) &&
+      sameBits(ca.com(), cb.com()) &&
+      sameBits(ca.core().com(), cb.core().com()) &&
+      ca.points().size() == cb.points().size() &&
+      ca.core().points().size() == cb.core().points().size();
+    for(unsigned int j=0; same && j<ca.points().size(); j++) {
+      same = ca.points()[j].id() == cb.points()[j].id();
+    }
+    if(!same) nDiffs++;
+  }
+  return nDiffs;
+}
+
+/**
+ * @brief Checks that clustering and classification do not depend on the number of threads.
+ *
+ * Runs the full chain in deterministic mode with 1 thread and with @c \-\-nThreads threads
+ * (all hardware threads if 1), and compares the clusters and class IDs of both data sets.
+ *
+ * @param trainingData Training data set.
+ * @param evaluationData Evaluation data set.
+ * @param config Configuration.
+ * @return true if the results are bitwise identical.
+ */
+bool checkDeterminism(const DataSet &trainingData, const DataSet &evaluationData, const Config &config)
+{
+  int nThreads = threadCount(config);
+  if(nThreads == 1) {
+    Config allThreads = config;
+    allThreads["nThreads"] = "0";
+    nThreads = threadCount(allThreads);
+  }
+  int threads[2] = {1, nThreads};
+
+  std::vector<DataSet> training(2, trainingData);
+  std::vector<DataSet> evaluation(2, evaluationData);
+  for(int i=0; i<2; i++) {
+    Config threadConfig = config;
+    threadConfig["nThreads"] = std::to_string(threads[i]);
+
+    ClusteringAlg clAlg;
+    clAlg.runClustering(training[i], threadConfig);
+    clAlg.runClustering(evaluation[i], threadConfig);
+
+    ClassificationAlg classAlg;
+    classAlg.classifyClusters(training[i], evaluation[i], threadConfig);
+  }
+
+  int nTrainingDiffs = compareClusters(training[0].clusters(), training[1].clusters());
+  int nEvaluationDiffs = compareClusters(evaluation[0].clusters(), evaluation[1].clusters());
+
+  std::cout << std::endl << "Determinism check, 1 vs " << nThreads << " threads:" << std::endl;
+  std::cout << "  training clusters:   " << training[1].clusters().size()
+	    << ", " << nTrainingDiffs << " differing" << std::endl;
+  std::cout << "  evaluation clusters: " << evaluation[1].clusters().size()
+	    << ", " << nEvaluationDiffs << " differing" << std::endl;
+
+  bool ok = nTrainingDiffs == 0 && nEvaluationDiffs == 0;
+  std::cout << (ok ? "Results are identical." : "ERROR: Results depend on the number of threads.")
+	    << std::endl;
+  return ok;
+}
+
+/**
+ * @}
+ */
@@ -0,0 +1,56 @@
+/**
+ * @file
+ */
+
+#include <iostream>
+#include <string>
+
+#include "BDTModel.h"
+#include "Options.h"
+
+/**
+ * @addtogroup Inference
+ *
+ * @{
+ */
+
+/**
+ * @brief Generates the C++ source of the BDT plugin from the trained weights.
+ *
+ * Converts the TMVA weights file if needed (see BDTModel::convert()) and writes
+ * @c outputs/weights/TMVAMulticlass_BDT.cxx from the binary model, where each tree is compiled code.
+ * The plugin is built with:
+ * > make bdtplugin
+ *
+ * and used by the main program as long as the model is unchanged.
+ *
+ * @param argc Number of command line arguments.
+ * @param argv Array of command line arguments.
+ * @return 0 upon successfull exit
+ */
+int main(int argc, char **argv) {
+
+  Config config;
+  parseCommandLine(config, argc, argv);
+
+  const std::string xmlFile = BDTModel::kBaseName + ".weights.xml";
+  const std::string binaryFile = BDTModel::kBaseName + ".bin";
+  const std::string sourceFile = BDTModel::kBaseName + ".cxx";
+
+  if(!BDTModel::isUpToDate(xmlFile, binaryFile)) {
+    BDTModel::convert(xmlFile, binaryFile);
+  }
+  BDTModel model;
+  model.load(binaryFile);
+  model.writeSource(sourceFile, BDTModel::fileHash(binaryFile));
+
+  if(config.get("verbose")) {
+    std::cout << "Generated " << sourceFile << " with " << model.nTrees() << " trees." << std::endl;
+  }
+
+  return 0;
+}
+
+/**
+ * @}
+ */
@@ -6,14 +6,15 @@
 #include <unistd.h>
 #include <string>
 #include <iomanip>
+#include <memory>
 
 #include "DataSet.h"
 #include "TStopwatch.h"
 #include "ClusteringAlg.h"
 #include "ClassificationAlg.h"
-#include "optparse.h"
-
-void parseCommandLine(Config &config, int argc, char **argv);
+#include "Options.h"
+#include "StreamingClustering.h"
+#include "TileStore.h"
 
 /**
  * @defgroup CloudPoints Main Program
@@ -43,8 +44,6 @@ void parseCommandLine(Config &config, int argc, char **argv);
  */
 int main(int argc, char **argv) {
 
-  srand(123);
-  
   //
   // Initialize program settings
   //
@@ -60,39 +59,98 @@ int main(int argc, char **argv) {
 
   
   //
-  // Read data from the input file
+  // Read data from the input file.
+  // With the streaming engine, packets are clustered as they are read.
+  // With the tiled clustering, packets are spilled to tile files and the points are not kept in memory.
   //
   DataSet trainingData;
   DataSet evaluationData;
+  ClusteringAlg clAlg;
+  std::string engine = config.get("clusteringEngine");
+  float voxelSize = config.get("voxelSize");
+  float tileSize = config.get("tileSize");
+  int nShards = config.get("nShards");
+  bool streaming = engine == "streaming" && voxelSize <= 0;
+  bool tiled = engine == "seeded" && nShards <= 1 && tileSize > 0;
+  StreamingClustering trainingStream(config);
+  StreamingClustering evaluationStream(config);
+  std::unique_ptr<TileStore> trainingTiles;
+  std::unique_ptr<TileStore> evaluationTiles;
+  DataSet::PacketCallback onPacket;
+  if(streaming) {
+    onPacket = [&](DataSet &ds, unsigned int begin) {
+      StreamingClustering &stream = &ds == &trainingData ? trainingStream : evaluationStream;
+      stream.addPoints(ds.points(), begin, ds.points().size());
+    };
+  }
+  if(tiled) {
+    trainingTiles.reset(new TileStore(clAlg.tileSize(config), clAlg.tileHalo(config)));
+    evaluationTiles.reset(new TileStore(clAlg.tileSize(config), clAlg.tileHalo(config)));
+    onPacket = [&](DataSet &ds, unsigned int begin) {
+      TileStore &tiles = &ds == &trainingData ? *trainingTiles : *evaluationTiles;
+      tiles.addPoints(ds.points(), begin, ds.points().size());
+      ds.points().clear();
+    };
+  }
   DataSet::readFromFile(config,
 			trainingData,
-			evaluationData);
+			evaluationData,
+			onPacket);
 
   if(config.get("verbose")) {
     sw.Stop();
     std::cout << std::endl
 	      << "Reading data done: "
-	      << trainingData.points().size() << " (training) and "
-	      << evaluationData.points().size() << " (evaluation) data points are read."
+	      << (tiled ? trainingTiles->nPoints() : trainingData.points().size()) << " (training) and "
+	      << (tiled ? evaluationTiles->nPoints() : evaluationData.points().size()) << " (evaluation) data points are read."
 	      << std::endl;
     sw.Print("m");
     sw.Start();
   }
+
+  //
+  // Downsample data into voxels if requested, tile by tile for the tiled clustering
+  //
+  if(voxelSize > 0 && !tiled) {
+    trainingData.downsample(voxelSize);
+    evaluationData.downsample(voxelSize);
+
+    if(config.get("verbose")) {
+      sw.Stop();
+      std::cout << std::endl
+		<< "Downsampling done: "
+		<< trainingData.points().size() << " (training) and "
+		<< evaluationData.points().size() << " (evaluation) voxels."
+		<< std::endl;
+      sw.Print("m");
+      sw.Start();
+    }
+  }
   
   //
   // Runs clustering algorithm
   //
-  ClusteringAlg clAlg;
-
   if(config.get("verbose")) {
     std::cout << std::endl << "Running clustering on training data" << std::endl;
   }  
-  clAlg.runClustering(trainingData, config);
+  if(streaming) {
+    trainingStream.finish(trainingData);
+  }else if(tiled) {
+    clAlg.runTiledClustering(*trainingTiles, trainingData, config);
+  }else{
+    clAlg.runClustering(trainingData, config);
+  }
 
   if(config.get("verbose")) {
     std::cout << std::endl << "Running clustering on evaluation data" << std::endl;
   }  
-  clAlg.runClustering(evaluationData, config);
+  if(streaming) {
+    evaluationStream.finish(evaluationData);
+  }else if(tiled) {
+    clAlg.runTiledClustering(*evaluationTiles, evaluationData, config);
+  }else{
+    clAlg.runClustering(evaluationData, config);
+  }
   
   if(config.get("verbose")) {
     sw.Stop();
@@ -143,89 +201,6 @@ int main(int argc, char **argv) {
   return 0;
 }
 
-/** 
- * @brief Prase command line arguments.
- *
- * @param config Configuration to parse into.
- * @param argc Number of command line arguments.
- * @param argv Array of command line arguments.
- *
- * #### Configuration details: 
- */
-void parseCommandLine(Config &config, int argc, char **argv)
-{
-
-  optparse::OptionParser parser = optparse::OptionParser().description("Point Cloud Analysis");
-
-  /** - @b -v, <b> \-\-verbose </b> Turns ON verbose mode. */
-  parser.add_option("-v", "--verbose").action("store_true").dest("verbose").set_default(false)
-    .help("Turns ON verbose mode.");
-
-  /** - @b -i, <b> \-\-inputFile </b> Name of the data input file.*/
-  parser.add_option("-i", "--inputFile").action("store").dest("inputFile").set_default("./share/point_cloud_data.txt")
-    .help("Name of the data input file.");
-
-  /** - @b -f, <b> \-\-evaluationDataFraction </b> Fraction of data to use for evaluation. */
-  parser.add_option("-f", "--evaluationDataFraction").action("store").dest("evaluationDataFraction").set_default(0.2)
-    .help("Fraction of data to use for evaluation.");
-
-  /** - @b -p, <b> \-\-skipPreClustering </b> Don't run pre-clustering. */
-  parser.add_option("-p", "--skipPreClustering").action("store_true").dest("skipPreClustering").set_default(false)
-    .help("Don't run pre-clustering.");
-  
-  /** - @b -P, <b> \-\-preClusteringSize </b> Size parameter in unit length for pre-clustering. */
-  parser.add_option("-P", "--preClusteringSize").action("store").dest("preClusteringSize").set_default(0.2)
-    .help("Size parameter in unit length for pre-clustering.");
-
-  /** - @b -d, <b> \-\-densityWindow </b> Size of the window used to compute densities. */
-  parser.add_option("-d", "--densityWindow").action("store").dest("densityWindow").set_default(0.5)
-    .help("Size of the window used to compute densities.");
-  
-  /** - @b -D, <b> \-\-seedDensityThreshold </b> Density threshold for seed selection, normalized to maximum density. */
-  parser.add_option("-D", "--seedDensityThreshold").action("store").dest("seedDensityThreshold").set_default(0.5)
-    .help("Density threshold for seed selection, normalized to maximum density.");
-
-  /** - @b -c, <b> \-\-clusterCoreSize </b> Size parameter in units of standard deviations for outlier removal. */
-  parser.add_option("-c", "--clusterCoreSize").action("store").dest("clusterCoreSize").set_default(2)
-    .help("Size parameter in units of standard deviations for outlier removal.");
-
-  /** - @b -u, <b> \-\-unsupervisedClassification </b> Run unsuppervised classification. */
-  parser.add_option("-u", "--unsupervisedClassification").action("store_true").dest("unsupervisedClassification").set_default(false)
-    .help("Run unsuppervised classification.");
-
-  /** - @b -l, <b> \-\-nLayersPerCluster </b> Number of layers per cluster for color analysis. */
-  parser.add_option("-l", "--nLayersPerCluster").action("store").dest("nLayersPerCluster").set_default(5)
-    .help("Number of layers per cluster for color analysis.");
-
-  /** - @b -t, <b> \-\-runMVATraining </b> Runs MVA training when runing in supervised classification mode. */
-  parser.add_option("-t", "--runMVATraining").action("store_true").dest("runMVATraining").set_default(false)
-    .help("Runs MVA training when runing in supervised classification mode.");
-
-  /** - @b -o, <b> \-\-tmvaOutputFile </b> Output file to save TMVA performance histograms. Put "None" to skip saving histograms. */
-  parser.add_option("-o", "--tmvaOutputFile").action("store").dest("tmvaOutputFile").set_default("None")
-    .help("Output file to save TMVA performance histograms. Put \"None\" to skip saving histograms.");
-
-  /** - @b -T, <b> \-\-truePositionsFileName </b> File name containing truth player positions and teams. */
-  parser.add_option("-T", "--truePositionsFileName").action("store").dest("truePositionsFileName")
-    .set_default("./share/point_cloud_true_positions.txt")
-    .help("File name containing truth player positions and teams.");
-
-  /** - @b -N, <b> \-\-trainingClustersSplitN </b> Number of sub-clusters for training splitting. */
-  parser.add_option("-N", "--trainingClustersSplitN").action("store").dest("trainingClustersSplitN").set_default(300)
-    .help("Number of sub-clusters for training splitting.");
-
-  /** - @b -F, <b> \-\-trainingClustersSplitF </b> Fraction of points in each sub-cluster for training splitting. */
-  parser.add_option("-F", "--trainingClustersSplitF").action("store").dest("trainingClustersSplitF").set_default(0.25)
-    .help("Fraction of points in each sub-cluster for training splitting.");
-  
-  /** - @b -K, <b> \-\-maxKmeansIterations </b> Maximum number of k-means iterations during PCA/kmeans classification. */
-  parser.add_option("-K", "--maxKmeansIterations").action("store").dest("maxKmeansIterations").set_default(1000)
-    .help("Maximum number of k-means iterations during PCA/kmeans classification.");
-
-  config = parser.parse_args(argc, argv);
-
-}
-
 /**
  * @}
  */
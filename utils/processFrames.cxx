@@ -0,0 +1,225 @@
+/**
+ * @file
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "DataSet.h"
+#include "TStopwatch.h"
+#include "ClassificationAlg.h"
+#include "ClusteringAlg.h"
+#include "IncrementalClustering.h"
+#include "Options.h"
+#include "PlayerTracker.h"
+
+double clusterFull(DataSet &ds, const Config &config);
+double clusterIncremental(IncrementalClustering &incremental, DataSet &ds, const Config &config);
+double classifyFrame(ClassificationAlg &classAlg, DataSet &ds, const Config &config);
+double trackFrame(PlayerTracker &tracker, ClassificationAlg &classAlg, DataSet &ds);
+
+/**
+ * @defgroup Frames Frame Sequences
+ *
+ * @brief Clustering of consecutive frames.
+ *
+ * @{
+ */
+
+/**
+ * @brief Clusters a sequence of frames incrementally.
+ *
+ * Each file of @c \-\-frameFiles holds one frame, in the format of the main program input.
+ * All the points of a frame are used, there is no evaluation set. \n
+ * Frames are clustered with IncrementalClustering, and for reference with the full clustering chain.
+ * For each frame, the fraction of the field recomputed and the speedup are reported.
+ * Timings include the layer features of the cluster cores (see Cluster::cachedLayerFeatures()), which the
+ * classification reads from the cache instead of scanning the cores: the full chain computes them for all
+ * clusters, the incremental one for the new clusters only. With @c \-\-featureTolerance, the features are
+ * sampled by the classification and the timings are those of the clustering alone. \n
+ * With @c \-u, the clusters of each frame are also classified with ClassificationAlg::classifyFrame(),
+ * which adapts the unsupervised model from frame to frame, and the number of clusters per class is reported.
+ * With @c \-\-trackPlayers, the clusters are associated with the players of the previous frames by a PlayerTracker,
+ * and only the new, ambiguous or refreshed ones are classified. Their number is reported.
+ *
+ * @param argc Number of command line arguments.
+ * @param argv Array of command line arguments.
+ * @return 0 upon successfull exit
+ */
+int main(int argc, char **argv) {
+
+  Config config;
+  parseCommandLine(config, argc, argv);
+
+  std::string frameFiles = config.get("frameFiles");
+  if(frameFiles == "None") {
+    std::cout << "Error: no frame files given, use --frameFiles" << std::endl;
+    return 1;
+  }
+  std::vector<std::string> fileNames;
+  std::stringstream ss(frameFiles);
+  std::string fileName;
+  while(std::getline(ss, fileName, ',')) {
+    if(!fileName.empty()) fileNames.push_back(fileName);
+  }
+
+  IncrementalClustering incremental(config);
+  ClassificationAlg classAlg;
+  PlayerTracker tracker(config);
+  bool classify = config.get("unsupervisedClassification");
+  bool tracking = config.get("trackPlayers");
+
+  std::cout << std::setw(6) << "frame"
+	    << std::setw(9) << "points"
+	    << std::setw(10) << "dirty[%]"
+	    << std::setw(12) << "points[%]"
+	    << std::setw(8) << "reused"
+	    << std::setw(10) << "clusters"
+	    << std::setw(10) << "full[s]"
+	    << std::setw(10) << "incr[s]"
+	    << std::setw(9) << "speedup";
+  if(classify) {
+    std::cout << std::setw(10) << "class[s]";
+    if(tracking) {
+      std::cout << std::setw(12) << "classified";
+    }
+    std::cout << "  classes";
+  }
+  std::cout << std::endl;
+
+  for(unsigned int i=0; i<fileNames.size(); i++) {
+    Config frameConfig = config;
+    frameConfig["inputFile"] = fileNames[i];
+    frameConfig["evaluationDataFraction"] = "0";
+
+    DataSet frameData;
+    DataSet unused;
+    if(!DataSet::readFromFile(frameConfig, frameData, unused)) {
+      return 1;
+    }
+
+    DataSet fullData(frameData);
+    double tFull = clusterFull(fullData, frameConfig);
+    double tIncremental = clusterIncremental(incremental, frameData, frameConfig);
+
+    std::cout << std::setw(6) << i
+	      << std::setw(9) << frameData.points().size()
+	      << std::setw(10) << std::fixed << std::setprecision(1) << 100*incremental.dirtyFraction()
+	      << std::setw(12) << 100*incremental.reclusteredFraction()
+	      << std::setw(8) << incremental.nReused()
+	      << std::setw(10) << frameData.clusters().size()
+	      << std::setw(10) << std::setprecision(4) << tFull
+	      << std::setw(10) << tIncremental
+	      << std::setw(9) << std::setprecision(2) << tFull/tIncremental;
+
+    if(classify) {
+      double tClassification = tracking ?
+	trackFrame(tracker, classAlg, frameData) : classifyFrame(classAlg, frameData, frameConfig);
+      const std::vector<std::string> &classNames = classAlg.classNames();
+      std::vector<int> nPerClass(classNames.size(), 0);
+      for(unsigned int j=0; j<frameData.clusters().size(); j++) {
+	nPerClass[frameData.clusters()[j].classId()]++;
+      }
+      std::cout << std::setw(10) << std::setprecision(4) << tClassification;
+      if(tracking) {
+	std::cout << std::setw(12) << tracker.nClassified();
+      }
+      std::cout << " ";
+      for(unsigned int ic=0; ic<classNames.size(); ic++) {
+	std::cout << " " << classNames[ic] << ":" << nPerClass[ic];
+      }
+    }
+    std::cout << std::endl;
+  }
+
+  return 0;
+}
+
+/**
+ * @brief Runs the full clustering chain and computes the layer features of the cluster cores.
+ *
+ * @param ds Data set of the frame.
+ * @param config Configuration.
+ * @return Wall time in seconds.
+ */
+double clusterFull(DataSet &ds, const Config &config)
+{
+  int nLayers = config.get("nLayersPerCluster");
+  float featureTolerance = config.get("featureTolerance");
+
+  TStopwatch sw;
+  sw.Start();
+  ClusteringAlg clAlg;
+  clAlg.runClustering(ds, config);
+  std::vector<Cluster> &clusters = ds.clusters();
+  for(unsigned int i=0; i<clusters.size() && featureTolerance <= 0; i++) {
+    clusters[i].core().cachedLayerFeatures(nLayers);
+  }
+  sw.Stop();
+  return sw.RealTime();
+}
+
+/**
+ * @brief Runs the incremental clustering and computes the layer features of the cluster cores.
+ *
+ * @param incremental Incremental clustering holding the previous frame.
+ * @param ds Data set of the frame.
+ * @param config Configuration.
+ * @return Wall time in seconds.
+ */
+double clusterIncremental(IncrementalClustering &incremental, DataSet &ds, const Config &config)
+{
+  int nLayers = config.get("nLayersPerCluster");
+  float featureTolerance = config.get("featureTolerance");
+
+  TStopwatch sw;
+  sw.Start();
+  incremental.processFrame(ds);
+  std::vector<Cluster> &clusters = ds.clusters();
+  for(unsigned int i=0; i<clusters.size() && featureTolerance <= 0; i++) {
+    clusters[i].core().cachedLayerFeatures(nLayers);
+  }
+  sw.Stop();
+  return sw.RealTime();
+}
+
+/**
+ * @brief Classifies the clusters of a frame and adapts the unsupervised model.
+ *
+ * @param classAlg Classification holding the model of the previous frames.
+ * @param ds Data set of the frame.
+ * @param config Configuration.
+ * @return Wall time in seconds.
+ */
+double classifyFrame(ClassificationAlg &classAlg, DataSet &ds, const Config &config)
+{
+  TStopwatch sw;
+  sw.Start();
+  classAlg.classifyFrame(ds, config);
+  sw.Stop();
+  return sw.RealTime();
+}
+
+/**
+ * @brief Classifies the clusters of a frame which do not continue a track of the previous frames.
+ *
+ * @param tracker Tracker holding the players of the previous frames.
+ * @param classAlg Classification holding the model of the previous frames.
+ * @param ds Data set of the frame.
+ * @return Wall time in seconds.
+ */
+double trackFrame(PlayerTracker &tracker, ClassificationAlg &classAlg, DataSet &ds)
+{
+  TStopwatch sw;
+  sw.Start();
+  tracker.processFrame(ds, classAlg);
+  sw.Stop();
+  return sw.RealTime();
+}
+
+/**
+ * @}
+ */